@@ -11,10 +11,23 @@
 #include "esp_https_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_log.h"
-#include "cJSON.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "nvs_flash.h"
+#include "nvs.h"
+#include "spi_flash_mmap.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+#include "mbedtls/sha256.h"
+#include "detools.h"
+// Декодер heatshrink из состава detools: статическая конфигурация, окно 2^8, lookahead 2^7
+#include "heatshrink_decoder.h"
 
+#include <inttypes.h>
+#include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -24,7 +37,17 @@
 // Конфигурация
 #define OTA_SERVER_URL "https://your-license-server.com"
 #define OTA_DEVICE_TYPE "scales_bridge_tab5"
-#define OTA_CHECK_INTERVAL_SEC (24 * 3600)  // Проверять раз в день
+#define OTA_CHECK_INTERVAL_SEC (24 * 3600)  // Проверять раз в день (если сервер не задал интервал)
+#define OTA_NVS_NAMESPACE "ota_resume"
+#define OTA_MAX_RESUME_ATTEMPTS 5           // Докачек подряд в одном цикле
+#define OTA_RESUME_BACKOFF_MS 2000
+#define OTA_STATUS_MAX_EVENTS 8
+#define OTA_STATUS_COALESCE_MS 10000        // "downloading" не чаще раза в 10 с
+#define OTA_REQUEST_BUF_SIZE 2048           // Тело любого запроса: check или пакет статусов
+#define OTA_PIPELINE_RING_SIZE (32 * 1024)  // Буфер между чтением из сети и записью во flash
+#define OTA_PIPELINE_CHUNK 4096             // Кусок чтения/записи, равен сектору flash
+#define OTA_WRITER_STACK_SIZE 3072
+#define OTA_WRITER_PRIORITY 5
 
 typedef struct {
     uint32_t device_id;
@@ -42,8 +65,100 @@ typedef struct {
     char download_url[512];
     char file_hash[65];
     uint32_t file_size;
+    bool has_patch;          // Сервер предложил дельта-патч от текущей сборки
+    char patch_url[512];
+    uint32_t patch_size;
+    bool has_compressed;     // Сервер предложил сжатый полный образ
+    char compression[16];
+    char compressed_url[512];
+    uint32_t compressed_size;
 } ota_firmware_info_t;
 
+typedef struct {
+    uint32_t firmware_id;
+    uint32_t offset;
+    char file_hash[65];
+} ota_resume_state_t;
+
+// Потоковый разбор плоского JSON-объекта ответа /check: значения пишутся
+// сразу в ota_firmware_info_t, вложенные и неизвестные поля пропускаются
+typedef enum {
+    JSON_START,
+    JSON_KEY_OR_END,
+    JSON_KEY,
+    JSON_COLON,
+    JSON_VALUE,
+    JSON_STRING,
+    JSON_SCALAR,
+    JSON_SKIP,
+    JSON_COMMA_OR_END,
+    JSON_DONE,
+    JSON_ERROR,
+} ota_json_state_t;
+
+// Поля, которые должны прийти в ответе с обновлением
+#define OTA_FIELD_FIRMWARE_ID  (1u << 0)
+#define OTA_FIELD_VERSION      (1u << 1)
+#define OTA_FIELD_BUILD        (1u << 2)
+#define OTA_FIELD_DOWNLOAD_URL (1u << 3)
+#define OTA_FIELD_FILE_HASH    (1u << 4)
+#define OTA_FIELD_FILE_SIZE    (1u << 5)
+#define OTA_FIELD_PATCH_URL    (1u << 6)
+#define OTA_FIELD_PATCH_SIZE   (1u << 7)
+#define OTA_FIELD_COMPRESSED_URL  (1u << 8)
+#define OTA_FIELD_COMPRESSED_SIZE (1u << 9)
+#define OTA_FIELDS_REQUIRED    0x3Fu
+
+typedef struct {
+    ota_json_state_t state;
+    ota_firmware_info_t *info;
+    char key[24];
+    size_t key_len;
+    char *dest;              // Куда пишется текущая строка (NULL - пропустить)
+    size_t dest_size;
+    size_t dest_len;
+    char scalar[24];
+    size_t scalar_len;
+    bool escape;
+    int skip_depth;
+    bool skip_in_string;
+    bool update_available;
+    uint32_t fields;
+} ota_json_parser_t;
+
+// Заголовки и тело ответа /api/ota/check
+typedef struct {
+    char etag[40];
+    uint32_t next_check_after;
+    ota_json_parser_t parser;
+} ota_check_response_t;
+
+typedef struct {
+    uint32_t firmware_id;
+    char status[16];
+    uint32_t bytes_downloaded;
+    char error_message[96];
+} ota_status_event_t;
+
+// Очередь статусов для /api/ota/status/batch
+typedef struct {
+    ota_status_event_t events[OTA_STATUS_MAX_EVENTS];
+    int count;
+    int64_t last_flush_us;
+    bool session_busy;       // Соединение занято скачиванием: события только копятся
+} ota_status_reporter_t;
+
+static ota_status_reporter_t s_status;
+
+// Один HTTP клиент на все запросы к серверу (check, download, status):
+// keep-alive держит соединение внутри цикла обновления, а сохранённая
+// TLS-сессия позволяет переподключиться без полного handshake.
+static esp_http_client_handle_t s_session;
+
+// ETag последнего ответа "обновлений нет" и интервал, выбранный сервером
+static char s_check_etag[40];
+static uint32_t s_next_check_sec = OTA_CHECK_INTERVAL_SEC;
+
 static bool url_is_absolute(const char *url)
 {
     if (!url) {
@@ -88,102 +203,469 @@ static void set_auth_header(esp_http_client_handle_t client, const ota_config_t
     esp_http_client_set_header(client, "Authorization", header);
 }
 
-static esp_err_t read_response_body(esp_http_client_handle_t client, char **out_buf, int *out_len)
+static esp_err_t ota_check_event_handler(esp_http_client_event_t *evt);
+
+/**
+ * Подготовить общий клиент к следующему запросу.
+ * Заголовки и тело предыдущего запроса сбрасываются.
+ */
+static esp_http_client_handle_t ota_session_request(
+    const ota_config_t *config,
+    const char *url,
+    esp_http_client_method_t method,
+    int timeout_ms)
 {
-    const int max_size = 8 * 1024;
-    char *buffer = malloc(max_size + 1);
-    if (!buffer) {
-        return ESP_ERR_NO_MEM;
+    if (!s_session) {
+        esp_http_client_config_t http_config = {
+            .url = url,
+            .method = method,
+            .crt_bundle_attach = esp_crt_bundle_attach,
+            .timeout_ms = timeout_ms,
+            .keep_alive_enable = true,
+            // Session ticket для возобновления TLS (CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS)
+            .save_client_session = true,
+            .event_handler = ota_check_event_handler,
+        };
+        s_session = esp_http_client_init(&http_config);
+        if (!s_session) {
+            return NULL;
+        }
+    } else {
+        // Соединение переиспользуется, если хост тот же
+        esp_http_client_set_url(s_session, url);
+        esp_http_client_set_method(s_session, method);
+        esp_http_client_set_timeout_ms(s_session, timeout_ms);
+    }
+    
+    esp_http_client_delete_header(s_session, "If-None-Match");
+    esp_http_client_delete_header(s_session, "Range");
+    esp_http_client_delete_header(s_session, "If-Range");
+    if (method == HTTP_METHOD_POST) {
+        esp_http_client_set_header(s_session, "Content-Type", "application/json");
+    } else {
+        esp_http_client_delete_header(s_session, "Content-Type");
     }
+    esp_http_client_set_post_field(s_session, NULL, 0);
+    esp_http_client_set_user_data(s_session, NULL);
+    set_auth_header(s_session, config);
+    return s_session;
+}
 
-    int total = 0;
-    while (1) {
-        int bytes = esp_http_client_read(client, buffer + total, max_size - total);
-        if (bytes < 0) {
-            free(buffer);
-            return ESP_FAIL;
-        }
-        if (bytes == 0) {
-            break;
-        }
-        total += bytes;
-        if (total >= max_size) {
-            free(buffer);
-            return ESP_ERR_NO_MEM;
+/**
+ * Закрыть соединение, сохранив клиент и TLS-сессию:
+ * следующий запрос переподключится с возобновлением сессии
+ */
+static void ota_session_disconnect(void)
+{
+    if (s_session) {
+        esp_http_client_close(s_session);
+    }
+}
+
+// Запись тела запроса в фиксированный буфер, без кучи
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} json_writer_t;
+
+static char s_request_buf[OTA_REQUEST_BUF_SIZE];
+
+static void jw_raw(json_writer_t *w, const char *fmt, ...)
+{
+    if (w->overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, w->cap - w->len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= w->cap - w->len) {
+        w->overflow = true;
+        return;
+    }
+    w->len += n;
+}
+
+static void jw_string(json_writer_t *w, const char *value)
+{
+    jw_raw(w, "\"");
+    for (const char *c = value ? value : ""; *c && !w->overflow; c++) {
+        if (*c == '"' || *c == '\\') {
+            jw_raw(w, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            jw_raw(w, "\\u%04x", (unsigned char)*c);
+        } else {
+            jw_raw(w, "%c", *c);
         }
     }
+    jw_raw(w, "\"");
+}
 
-    buffer[total] = '\0';
-    *out_buf = buffer;
-    if (out_len) {
-        *out_len = total;
+static void ota_json_begin_string(ota_json_parser_t *p)
+{
+    ota_firmware_info_t *info = p->info;
+    p->dest = NULL;
+    p->dest_size = 0;
+    if (strcmp(p->key, "version") == 0) {
+        p->dest = info->version;
+        p->dest_size = sizeof(info->version);
+        p->fields |= OTA_FIELD_VERSION;
+    } else if (strcmp(p->key, "download_url") == 0) {
+        p->dest = info->download_url;
+        p->dest_size = sizeof(info->download_url);
+        p->fields |= OTA_FIELD_DOWNLOAD_URL;
+    } else if (strcmp(p->key, "file_hash") == 0) {
+        p->dest = info->file_hash;
+        p->dest_size = sizeof(info->file_hash);
+        p->fields |= OTA_FIELD_FILE_HASH;
+    } else if (strcmp(p->key, "patch_url") == 0) {
+        p->dest = info->patch_url;
+        p->dest_size = sizeof(info->patch_url);
+        p->fields |= OTA_FIELD_PATCH_URL;
+    } else if (strcmp(p->key, "compression") == 0) {
+        p->dest = info->compression;
+        p->dest_size = sizeof(info->compression);
+    } else if (strcmp(p->key, "compressed_url") == 0) {
+        p->dest = info->compressed_url;
+        p->dest_size = sizeof(info->compressed_url);
+        p->fields |= OTA_FIELD_COMPRESSED_URL;
+    }
+    p->dest_len = 0;
+    if (p->dest) {
+        p->dest[0] = '\0';
+    }
+}
+
+static void ota_json_string_char(ota_json_parser_t *p, char c)
+{
+    if (!p->dest) {
+        return;
+    }
+    if (p->dest_len + 1 >= p->dest_size) {
+        // Обрезанный URL или хеш указывал бы не на тот образ: ответ отвергается
+        p->state = JSON_ERROR;
+        return;
+    }
+    p->dest[p->dest_len++] = c;
+    p->dest[p->dest_len] = '\0';
+}
+
+static void ota_json_end_scalar(ota_json_parser_t *p)
+{
+    ota_firmware_info_t *info = p->info;
+    p->scalar[p->scalar_len] = '\0';
+    if (strcmp(p->scalar, "null") == 0) {
+        return;
+    }
+    uint32_t number = (uint32_t)strtoul(p->scalar, NULL, 10);
+    if (strcmp(p->key, "update_available") == 0) {
+        p->update_available = strcmp(p->scalar, "true") == 0;
+    } else if (strcmp(p->key, "firmware_id") == 0) {
+        info->firmware_id = number;
+        p->fields |= OTA_FIELD_FIRMWARE_ID;
+    } else if (strcmp(p->key, "build_number") == 0) {
+        info->build_number = number;
+        p->fields |= OTA_FIELD_BUILD;
+    } else if (strcmp(p->key, "file_size") == 0) {
+        info->file_size = number;
+        p->fields |= OTA_FIELD_FILE_SIZE;
+    } else if (strcmp(p->key, "patch_size") == 0) {
+        info->patch_size = number;
+        p->fields |= OTA_FIELD_PATCH_SIZE;
+    } else if (strcmp(p->key, "compressed_size") == 0) {
+        info->compressed_size = number;
+        p->fields |= OTA_FIELD_COMPRESSED_SIZE;
     }
-    return ESP_OK;
 }
 
 /**
- * Отправить статус OTA операции на сервер
+ * Подать очередной кусок тела ответа в парсер.
+ * Строка длиннее своего поля переводит парсер в JSON_ERROR, \uXXXX вне ASCII заменяется на '?'.
  */
-static esp_err_t ota_report_status(
-    const ota_config_t *config,
-    uint32_t firmware_id,
-    const char *status,
-    uint32_t bytes_downloaded,
-    const char *error_message)
+static void ota_json_feed(ota_json_parser_t *p, const char *data, int len)
 {
-    ESP_LOGI(TAG, "Reporting OTA status: %s", status);
-    
-    // Создать JSON запрос
-    cJSON *request = cJSON_CreateObject();
-    cJSON_AddNumberToObject(request, "device_id", config->device_id);
-    cJSON_AddNumberToObject(request, "firmware_id", firmware_id);
-    cJSON_AddStringToObject(request, "status", status);
-    cJSON_AddNumberToObject(request, "bytes_downloaded", bytes_downloaded);
-    
-    if (error_message) {
-        cJSON_AddStringToObject(request, "error_message", error_message);
+    for (int i = 0; i < len && p->state != JSON_ERROR; i++) {
+        char c = data[i];
+        bool is_space = c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        
+        switch (p->state) {
+        case JSON_START:
+            if (c == '{') {
+                p->state = JSON_KEY_OR_END;
+            } else if (!is_space) {
+                p->state = JSON_ERROR;
+            }
+            break;
+        case JSON_KEY_OR_END:
+            if (c == '"') {
+                p->key_len = 0;
+                p->escape = false;
+                p->state = JSON_KEY;
+            } else if (c == '}') {
+                p->state = JSON_DONE;
+            } else if (!is_space) {
+                p->state = JSON_ERROR;
+            }
+            break;
+        case JSON_KEY:
+            if (p->escape) {
+                p->escape = false;
+            } else if (c == '\\') {
+                p->escape = true;
+                break;
+            } else if (c == '"') {
+                p->key[p->key_len] = '\0';
+                p->state = JSON_COLON;
+                break;
+            }
+            if (p->key_len + 1 < sizeof(p->key)) {
+                p->key[p->key_len++] = c;
+            }
+            break;
+        case JSON_COLON:
+            if (c == ':') {
+                p->state = JSON_VALUE;
+            } else if (!is_space) {
+                p->state = JSON_ERROR;
+            }
+            break;
+        case JSON_VALUE:
+            if (is_space) {
+                break;
+            }
+            if (c == '"') {
+                ota_json_begin_string(p);
+                p->escape = false;
+                p->scalar_len = 0;  // Используется как счётчик цифр \uXXXX
+                p->state = JSON_STRING;
+            } else if (c == '{' || c == '[') {
+                p->skip_depth = 1;
+                p->skip_in_string = false;
+                p->escape = false;
+                p->state = JSON_SKIP;
+            } else {
+                p->scalar_len = 0;
+                p->scalar[p->scalar_len++] = c;
+                p->state = JSON_SCALAR;
+            }
+            break;
+        case JSON_STRING:
+            if (p->scalar_len > 0) {
+                // Цифры \uXXXX: накапливаются в scalar, символ пишется после четвёртой
+                p->scalar[p->scalar_len++] = c;
+                if (p->scalar_len == 5) {
+                    p->scalar[5] = '\0';
+                    unsigned long code = strtoul(p->scalar + 1, NULL, 16);
+                    ota_json_string_char(p, code < 0x80 ? (char)code : '?');
+                    p->scalar_len = 0;
+                }
+            } else if (p->escape) {
+                p->escape = false;
+                if (c == 'u') {
+                    p->scalar[0] = 'u';
+                    p->scalar_len = 1;
+                } else {
+                    ota_json_string_char(p, c == 'n' ? '\n' : c == 't' ? '\t' : c);
+                }
+            } else if (c == '\\') {
+                p->escape = true;
+            } else if (c == '"') {
+                p->state = JSON_COMMA_OR_END;
+            } else {
+                ota_json_string_char(p, c);
+            }
+            break;
+        case JSON_SCALAR:
+            if (c == ',' || c == '}' || is_space) {
+                ota_json_end_scalar(p);
+                p->state = c == ',' ? JSON_KEY_OR_END : c == '}' ? JSON_DONE : JSON_COMMA_OR_END;
+            } else if (p->scalar_len + 1 < sizeof(p->scalar)) {
+                p->scalar[p->scalar_len++] = c;
+            }
+            break;
+        case JSON_SKIP:
+            if (p->skip_in_string) {
+                if (p->escape) {
+                    p->escape = false;
+                } else if (c == '\\') {
+                    p->escape = true;
+                } else if (c == '"') {
+                    p->skip_in_string = false;
+                }
+            } else if (c == '"') {
+                p->skip_in_string = true;
+            } else if (c == '{' || c == '[') {
+                p->skip_depth++;
+            } else if ((c == '}' || c == ']') && --p->skip_depth == 0) {
+                p->state = JSON_COMMA_OR_END;
+            }
+            break;
+        case JSON_COMMA_OR_END:
+            if (c == ',') {
+                p->state = JSON_KEY_OR_END;
+            } else if (c == '}') {
+                p->state = JSON_DONE;
+            } else if (!is_space) {
+                p->state = JSON_ERROR;
+            }
+            break;
+        case JSON_DONE:
+        case JSON_ERROR:
+            break;
+        }
+    }
+}
+
+/**
+ * Отправить накопленные статусы одним запросом на /api/ota/status/batch.
+ * Соединение держится открытым между вызовами, чтобы не повторять TLS handshake.
+ */
+static esp_err_t ota_status_flush(const ota_config_t *config)
+{
+    if (s_status.count == 0) {
+        return ESP_OK;
     }
     
-    char *request_str = cJSON_Print(request);
-    cJSON_Delete(request);
+    // Собрать тело запроса в статический буфер
+    json_writer_t w = {.buf = s_request_buf, .cap = sizeof(s_request_buf)};
+    jw_raw(&w, "{\"device_id\":%" PRIu32 ",\"events\":[", config->device_id);
+    for (int i = 0; i < s_status.count; i++) {
+        const ota_status_event_t *event = &s_status.events[i];
+        jw_raw(&w, "%s{\"firmware_id\":%" PRIu32 ",\"status\":", i > 0 ? "," : "", event->firmware_id);
+        jw_string(&w, event->status);
+        jw_raw(&w, ",\"bytes_downloaded\":%" PRIu32, event->bytes_downloaded);
+        if (event->error_message[0] != '\0') {
+            jw_raw(&w, ",\"error_message\":");
+            jw_string(&w, event->error_message);
+        }
+        jw_raw(&w, "}");
+    }
+    jw_raw(&w, "]}");
+    if (w.overflow) {
+        return ESP_ERR_NO_MEM;
+    }
     
-    // Отправить на сервер
     char status_url[256];
-    build_url(status_url, sizeof(status_url), config->server_url, "/api/ota/status");
-
-    esp_http_client_config_t http_config = {
-        .url = status_url,
-        .method = HTTP_METHOD_POST,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .timeout_ms = 10000,
-    };
-    
-    esp_http_client_handle_t client = esp_http_client_init(&http_config);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    set_auth_header(client, config);
-    esp_http_client_set_post_field(client, request_str, strlen(request_str));
+    build_url(status_url, sizeof(status_url), config->server_url, "/api/ota/status/batch");
+    esp_http_client_handle_t client = ota_session_request(config, status_url, HTTP_METHOD_POST, 10000);
+    if (!client) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_set_post_field(client, w.buf, w.len);
     
     esp_err_t err = esp_http_client_perform(client);
     
     if (err == ESP_OK) {
         int status_code = esp_http_client_get_status_code(client);
         if (status_code == 200) {
-            ESP_LOGI(TAG, "Status reported successfully");
+            ESP_LOGI(TAG, "Reported %d OTA status event(s)", s_status.count);
+            s_status.count = 0;
         } else {
             ESP_LOGW(TAG, "Server returned status code: %d", status_code);
+            err = ESP_FAIL;
         }
     } else {
+        // Соединение оборвалось: переподключиться при следующей отправке
         ESP_LOGE(TAG, "Failed to report status: %s", esp_err_to_name(err));
+        ota_session_disconnect();
     }
+    s_status.last_flush_us = esp_timer_get_time();
     
-    esp_http_client_cleanup(client);
-    free(request_str);
+    esp_http_client_set_post_field(client, NULL, 0);
     
     return err;
 }
 
 /**
- * Проверить доступность обновлений
+ * Отправить статус OTA операции на сервер.
+ * Промежуточные "downloading" склеиваются (остаётся последний прогресс) и
+ * отправляются не чаще раза в OTA_STATUS_COALESCE_MS; остальные статусы
+ * уходят сразу вместе с накопленными.
+ */
+static esp_err_t ota_report_status(
+    const ota_config_t *config,
+    uint32_t firmware_id,
+    const char *status,
+    uint32_t bytes_downloaded,
+    const char *error_message)
+{
+    ESP_LOGI(TAG, "Reporting OTA status: %s", status);
+    
+    bool is_progress = strcmp(status, "downloading") == 0;
+    ota_status_event_t *last = s_status.count > 0 ? &s_status.events[s_status.count - 1] : NULL;
+    
+    if (is_progress && last && last->firmware_id == firmware_id && strcmp(last->status, status) == 0) {
+        last->bytes_downloaded = bytes_downloaded;
+    } else {
+        if (s_status.count == OTA_STATUS_MAX_EVENTS &&
+            (s_status.session_busy || ota_status_flush(config) != ESP_OK)) {
+            // Сервер недоступен: отбросить самое старое событие
+            memmove(&s_status.events[0], &s_status.events[1],
+                    (OTA_STATUS_MAX_EVENTS - 1) * sizeof(s_status.events[0]));
+            s_status.count--;
+        }
+        ota_status_event_t *event = &s_status.events[s_status.count++];
+        event->firmware_id = firmware_id;
+        event->bytes_downloaded = bytes_downloaded;
+        snprintf(event->status, sizeof(event->status), "%s", status);
+        snprintf(event->error_message, sizeof(event->error_message), "%s",
+                 error_message ? error_message : "");
+    }
+    
+    int64_t since_flush_ms = (esp_timer_get_time() - s_status.last_flush_us) / 1000;
+    if (s_status.session_busy || (is_progress && since_flush_ms < OTA_STATUS_COALESCE_MS)) {
+        return ESP_OK;
+    }
+    return ota_status_flush(config);
+}
+
+/**
+ * Отправить оставшиеся статусы и закрыть соединение до следующего цикла
+ */
+static void ota_status_close(const ota_config_t *config)
+{
+    ota_status_flush(config);
+    ota_session_disconnect();
+}
+
+static esp_err_t ota_check_event_handler(esp_http_client_event_t *evt)
+{
+    ota_check_response_t *response = (ota_check_response_t *)evt->user_data;
+    if (!response) {
+        return ESP_OK;
+    }
+    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+        // Тело разбирается по мере прихода, без буфера на весь ответ
+        ota_json_feed(&response->parser, (const char *)evt->data, evt->data_len);
+    } else if (evt->event_id == HTTP_EVENT_ON_HEADER) {
+        if (strcasecmp(evt->header_key, "ETag") == 0) {
+            snprintf(response->etag, sizeof(response->etag), "%s", evt->header_value);
+        } else if (strcasecmp(evt->header_key, "X-Next-Check-After") == 0) {
+            response->next_check_after = (uint32_t)strtoul(evt->header_value, NULL, 10);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * Относительный URL из ответа дополнить адресом сервера
+ */
+static void ota_absolutize_url(char *url, size_t url_size, const char *server_url)
+{
+    if (url[0] == '\0' || url_is_absolute(url)) {
+        return;
+    }
+    char path[sizeof(((ota_firmware_info_t *)0)->download_url)];
+    snprintf(path, sizeof(path), "%s", url);
+    build_url(url, url_size, server_url, path);
+}
+
+/**
+ * Проверить доступность обновлений.
+ * Если прошлый ответ был "обновлений нет", отправляет его ETag в If-None-Match,
+ * и сервер отвечает пустым 304, пока ничего не изменилось.
  */
 static esp_err_t ota_check_for_updates(
     const ota_config_t *config,
@@ -191,123 +673,267 @@ static esp_err_t ota_check_for_updates(
 {
     ESP_LOGI(TAG, "Checking for firmware updates...");
     
-    // Создать JSON запрос
-    cJSON *request = cJSON_CreateObject();
-    cJSON_AddNumberToObject(request, "device_id", config->device_id);
-    cJSON_AddStringToObject(request, "device_type", config->device_type);
-    cJSON_AddStringToObject(request, "current_version", config->current_version);
-    cJSON_AddNumberToObject(request, "current_build", config->current_build);
-    
-    char *request_str = cJSON_Print(request);
-    cJSON_Delete(request);
+    json_writer_t w = {.buf = s_request_buf, .cap = sizeof(s_request_buf)};
+    jw_raw(&w, "{\"device_id\":%" PRIu32 ",\"device_type\":", config->device_id);
+    jw_string(&w, config->device_type);
+    jw_raw(&w, ",\"current_version\":");
+    jw_string(&w, config->current_version);
+    jw_raw(&w, ",\"current_build\":%" PRIu32 "}", config->current_build);
+    if (w.overflow) {
+        return ESP_ERR_NO_MEM;
+    }
     
     // Отправить запрос
     char check_url[256];
     build_url(check_url, sizeof(check_url), config->server_url, "/api/ota/check");
 
-    esp_http_client_config_t http_config = {
-        .url = check_url,
-        .method = HTTP_METHOD_POST,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .timeout_ms = 15000,
+    ota_check_response_t response = {
+        .parser = {.state = JSON_START, .info = firmware_info},
     };
-    
-    esp_http_client_handle_t client = esp_http_client_init(&http_config);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    set_auth_header(client, config);
-    esp_http_client_set_post_field(client, request_str, strlen(request_str));
+    esp_http_client_handle_t client = ota_session_request(config, check_url, HTTP_METHOD_POST, 15000);
+    if (!client) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_set_user_data(client, &response);
+    if (s_check_etag[0] != '\0') {
+        esp_http_client_set_header(client, "If-None-Match", s_check_etag);
+    }
+    esp_http_client_set_post_field(client, w.buf, w.len);
     
     esp_err_t err = esp_http_client_perform(client);
+    esp_http_client_set_user_data(client, NULL);
+    esp_http_client_set_post_field(client, NULL, 0);
     
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        
-        if (status_code == 200) {
-            char *response_buffer = NULL;
-            int response_len = 0;
-            if (read_response_body(client, &response_buffer, &response_len) != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to read response body");
-                esp_http_client_cleanup(client);
-                free(request_str);
-                return ESP_FAIL;
-            }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to check updates: %s", esp_err_to_name(err));
+        ota_session_disconnect();
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return err;
+    }
+    
+    int status_code = esp_http_client_get_status_code(client);
+    if (response.next_check_after > 0) {
+        s_next_check_sec = response.next_check_after;
+    }
+    
+    if (status_code == 304) {
+        ESP_LOGI(TAG, "No updates available (not modified)");
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return ESP_OK;
+    }
+    if (status_code != 200) {
+        ESP_LOGW(TAG, "Server returned status code: %d", status_code);
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return ESP_OK;
+    }
+    
+    const ota_json_parser_t *parser = &response.parser;
+    if (parser->state != JSON_DONE) {
+        ESP_LOGE(TAG, "Invalid JSON response");
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return ESP_FAIL;
+    }
+    if (!parser->update_available) {
+        ESP_LOGI(TAG, "No updates available");
+        snprintf(s_check_etag, sizeof(s_check_etag), "%s", response.etag);
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return ESP_OK;
+    }
+    if ((parser->fields & OTA_FIELDS_REQUIRED) != OTA_FIELDS_REQUIRED) {
+        ESP_LOGE(TAG, "Malformed OTA response");
+        memset(firmware_info, 0, sizeof(*firmware_info));
+        return ESP_FAIL;
+    }
+    
+    ota_absolutize_url(firmware_info->download_url, sizeof(firmware_info->download_url), config->server_url);
+    firmware_info->has_patch = (parser->fields & OTA_FIELD_PATCH_URL) &&
+                               (parser->fields & OTA_FIELD_PATCH_SIZE) &&
+                               firmware_info->patch_url[0] != '\0';
+    if (firmware_info->has_patch) {
+        ota_absolutize_url(firmware_info->patch_url, sizeof(firmware_info->patch_url), config->server_url);
+    }
+    // Другие алгоритмы сжатия этот клиент не распаковывает и скачивает полный образ
+    firmware_info->has_compressed = (parser->fields & OTA_FIELD_COMPRESSED_URL) &&
+                                    (parser->fields & OTA_FIELD_COMPRESSED_SIZE) &&
+                                    strcmp(firmware_info->compression, "heatshrink") == 0;
+    if (firmware_info->has_compressed) {
+        ota_absolutize_url(firmware_info->compressed_url, sizeof(firmware_info->compressed_url),
+                           config->server_url);
+    }
+    
+    ESP_LOGI(TAG, "Update available: v%s (build %" PRIu32 ")", firmware_info->version, firmware_info->build_number);
+    s_check_etag[0] = '\0';  // Ответ с обновлением не кэшируется
+    return ESP_OK;  // Обновление доступно
+}
 
-            cJSON *response = cJSON_Parse(response_buffer);
-            if (!response) {
-                ESP_LOGE(TAG, "Invalid JSON response");
-                free(response_buffer);
-                esp_http_client_cleanup(client);
-                free(request_str);
-                return ESP_FAIL;
-            }
+/**
+ * Состояние докачки в NVS: firmware_id, file_hash и смещение (выровненное
+ * по сектору flash), до которого раздел OTA уже записан.
+ */
+static void ota_resume_load(ota_resume_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    size_t hash_len = sizeof(state->file_hash);
+    if (nvs_get_u32(nvs, "fw_id", &state->firmware_id) != ESP_OK ||
+        nvs_get_u32(nvs, "offset", &state->offset) != ESP_OK ||
+        nvs_get_str(nvs, "hash", state->file_hash, &hash_len) != ESP_OK) {
+        memset(state, 0, sizeof(*state));
+    }
+    nvs_close(nvs);
+}
 
-            cJSON *update_available = cJSON_GetObjectItemCaseInsensitive(response, "update_available");
-            if (update_available && cJSON_IsTrue(update_available)) {
-                cJSON *firmware_id = cJSON_GetObjectItem(response, "firmware_id");
-                cJSON *version = cJSON_GetObjectItem(response, "version");
-                cJSON *build_number = cJSON_GetObjectItem(response, "build_number");
-                cJSON *download_url = cJSON_GetObjectItem(response, "download_url");
-                cJSON *file_hash = cJSON_GetObjectItem(response, "file_hash");
-                cJSON *file_size = cJSON_GetObjectItem(response, "file_size");
-
-                if (!firmware_id || !version || !build_number || !download_url || !file_hash || !file_size) {
-                    ESP_LOGE(TAG, "Malformed OTA response");
-                    cJSON_Delete(response);
-                    free(response_buffer);
-                    esp_http_client_cleanup(client);
-                    free(request_str);
-                    return ESP_FAIL;
-                }
+static void ota_resume_save(uint32_t firmware_id, const char *file_hash, uint32_t bytes_written)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    // Сектор, в который шла запись, при докачке будет стёрт и записан заново
+    uint32_t offset = bytes_written - (bytes_written % SPI_FLASH_SEC_SIZE);
+    nvs_set_u32(nvs, "fw_id", firmware_id);
+    nvs_set_str(nvs, "hash", file_hash);
+    nvs_set_u32(nvs, "offset", offset);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
 
-                firmware_info->firmware_id = (uint32_t)firmware_id->valueint;
-                firmware_info->build_number = (uint32_t)build_number->valueint;
-                firmware_info->file_size = (uint32_t)file_size->valueint;
-                snprintf(firmware_info->version, sizeof(firmware_info->version), "%s", version->valuestring);
-                snprintf(firmware_info->file_hash, sizeof(firmware_info->file_hash), "%s", file_hash->valuestring);
-
-                if (url_is_absolute(download_url->valuestring)) {
-                    snprintf(
-                        firmware_info->download_url,
-                        sizeof(firmware_info->download_url),
-                        "%s",
-                        download_url->valuestring
-                    );
-                } else {
-                    build_url(
-                        firmware_info->download_url,
-                        sizeof(firmware_info->download_url),
-                        config->server_url,
-                        download_url->valuestring
-                    );
-                }
+static void ota_resume_clear(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    nvs_erase_all(nvs);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
 
-                ESP_LOGI(TAG, "Update available: v%s (build %d)", firmware_info->version, firmware_info->build_number);
-                cJSON_Delete(response);
-                free(response_buffer);
-                esp_http_client_cleanup(client);
-                free(request_str);
-                return ESP_OK;  // Обновление доступно
-            } else {
-                ESP_LOGI(TAG, "No updates available");
+/**
+ * Есть ли в NVS прогресс несжатой загрузки именно этой прошивки
+ */
+static bool ota_resume_matches(const ota_resume_state_t *resume, const ota_firmware_info_t *firmware_info)
+{
+    return resume->firmware_id == firmware_info->firmware_id &&
+           strcmp(resume->file_hash, firmware_info->file_hash) == 0 &&
+           resume->offset > 0 && resume->offset < firmware_info->file_size;
+}
+
+/**
+ * Открыть соединение на скачивание с позиции offset (Range + If-Range по ETag = file_hash)
+ */
+static esp_err_t ota_open_download(
+    esp_http_client_handle_t client,
+    const ota_firmware_info_t *firmware_info,
+    uint32_t offset,
+    int *out_status_code)
+{
+    if (offset > 0) {
+        char range[32];
+        char etag[sizeof(firmware_info->file_hash) + 2];
+        snprintf(range, sizeof(range), "bytes=%" PRIu32 "-", offset);
+        snprintf(etag, sizeof(etag), "\"%s\"", firmware_info->file_hash);
+        esp_http_client_set_header(client, "Range", range);
+        esp_http_client_set_header(client, "If-Range", etag);
+    } else {
+        esp_http_client_delete_header(client, "Range");
+        esp_http_client_delete_header(client, "If-Range");
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (esp_http_client_fetch_headers(client) < 0) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    *out_status_code = esp_http_client_get_status_code(client);
+    return ESP_OK;
+}
+
+static bool sha256_matches_hex(const uint8_t digest[32], const char *expected_hex)
+{
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    return strncasecmp(hex, expected_hex, 64) == 0;
+}
+
+/**
+ * Конвейер скачивания: текущая задача читает из сети в кольцевой буфер,
+ * отдельная задача пишет из него во flash и считает SHA256 записанного.
+ * Пока стирается сектор, радио продолжает принимать данные.
+ */
+typedef struct {
+    StreamBufferHandle_t stream;
+    esp_ota_handle_t update_handle;
+    mbedtls_sha256_context *sha;
+    volatile uint32_t bytes_written;
+    volatile esp_err_t err;
+    volatile bool eof;
+    TaskHandle_t owner;
+} ota_pipeline_t;
+
+static uint8_t s_read_chunk[OTA_PIPELINE_CHUNK];
+static uint8_t s_write_chunk[OTA_PIPELINE_CHUNK];
+
+static void ota_flash_writer_task(void *arg)
+{
+    ota_pipeline_t *pipe = (ota_pipeline_t *)arg;
+    for (;;) {
+        size_t n = xStreamBufferReceive(pipe->stream, s_write_chunk, sizeof(s_write_chunk), pdMS_TO_TICKS(100));
+        if (n == 0) {
+            if (pipe->eof && xStreamBufferIsEmpty(pipe->stream)) {
+                break;
             }
+            continue;
+        }
+        if (pipe->err != ESP_OK) {
+            continue;  // После ошибки записи буфер только вычерпывается, чтобы не блокировать чтение
+        }
+        esp_err_t err = esp_ota_write(pipe->update_handle, s_write_chunk, n);
+        if (err != ESP_OK) {
+            pipe->err = err;
+            continue;
+        }
+        mbedtls_sha256_update(pipe->sha, s_write_chunk, n);
+        pipe->bytes_written += n;
+    }
+    xTaskNotifyGive(pipe->owner);
+    vTaskDelete(NULL);
+}
 
-            cJSON_Delete(response);
-            free(response_buffer);
-        } else {
-            ESP_LOGW(TAG, "Server returned status code: %d", status_code);
+/**
+ * Досчитать SHA256 по уже записанному в раздел началу образа (докачка после перезагрузки)
+ */
+static esp_err_t ota_hash_partition_prefix(
+    const esp_partition_t *partition,
+    uint32_t length,
+    mbedtls_sha256_context *sha)
+{
+    for (uint32_t offset = 0; offset < length; offset += sizeof(s_read_chunk)) {
+        uint32_t n = length - offset < sizeof(s_read_chunk) ? length - offset : sizeof(s_read_chunk);
+        esp_err_t err = esp_partition_read(partition, offset, s_read_chunk, n);
+        if (err != ESP_OK) {
+            return err;
         }
-    } else {
-        ESP_LOGE(TAG, "Failed to check updates: %s", esp_err_to_name(err));
+        mbedtls_sha256_update(sha, s_read_chunk, n);
     }
-    
-    esp_http_client_cleanup(client);
-    free(request_str);
-    
-    return err;
+    return ESP_OK;
 }
 
 /**
  * Скачать и установить прошивку
+ *
+ * При обрыве соединения скачивание продолжается Range-запросом с текущей
+ * позиции в тот же esp_ota_handle_t. Позиция сохраняется в NVS, поэтому после
+ * перезагрузки загрузка той же прошивки продолжается через esp_ota_resume.
+ * Раздел становится загрузочным только если SHA256 образа совпал с file_hash.
  */
 static esp_err_t ota_download_and_install(
     const ota_config_t *config,
@@ -315,9 +941,6 @@ static esp_err_t ota_download_and_install(
 {
     ESP_LOGI(TAG, "Starting firmware download from %s", firmware_info->download_url);
     
-    // Отправить статус "downloading"
-    ota_report_status(config, firmware_info->firmware_id, "downloading", 0, NULL);
-    
     // Инициализировать OTA
     const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
     if (update_partition == NULL) {
@@ -327,81 +950,209 @@ static esp_err_t ota_download_and_install(
         return ESP_FAIL;
     }
     
+    // Продолжить ранее прерванную загрузку той же прошивки, если она есть
+    uint32_t bytes_downloaded = 0;
     esp_ota_handle_t update_handle = 0;
-    esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
+    esp_err_t err = ESP_FAIL;
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    ota_resume_state_t resume;
+    ota_resume_load(&resume);
+    // esp_ota_resume доступен начиная с ESP-IDF v5.3
+    if (ota_resume_matches(&resume, firmware_info) &&
+        ota_hash_partition_prefix(update_partition, resume.offset, &sha) == ESP_OK) {
+        err = esp_ota_resume(update_partition, OTA_WITH_SEQUENTIAL_WRITES, resume.offset, &update_handle);
+        if (err == ESP_OK) {
+            bytes_downloaded = resume.offset;
+            ESP_LOGI(TAG, "Resuming download at %" PRIu32 " bytes", bytes_downloaded);
+        }
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
-        ota_report_status(config, firmware_info->firmware_id, "failed",
-                         0, "OTA begin failed");
-        return err;
+        mbedtls_sha256_starts(&sha, 0);
+        err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+            mbedtls_sha256_free(&sha);
+            ota_report_status(config, firmware_info->firmware_id, "failed",
+                             0, "OTA begin failed");
+            return err;
+        }
     }
     
-    // Скачать файл
-    esp_http_client_config_t http_config = {
-        .url = firmware_info->download_url,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .timeout_ms = 60000,
-    };
+    // Отправить статус "downloading" с точкой продолжения
+    ota_report_status(config, firmware_info->firmware_id, "downloading", bytes_downloaded, NULL);
     
-    esp_http_client_handle_t client = esp_http_client_init(&http_config);
-    set_auth_header(client, config);
+    // Кольцевой буфер конвейера в DMA-памяти: память SPI RAM замедлила бы запись во flash
+    uint8_t *ring = heap_caps_malloc(OTA_PIPELINE_RING_SIZE + 1, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    StaticStreamBuffer_t ring_struct;
+    ota_pipeline_t pipe = {
+        .stream = ring ? xStreamBufferCreateStatic(OTA_PIPELINE_RING_SIZE, 1, ring, &ring_struct) : NULL,
+        .sha = &sha,
+        .owner = xTaskGetCurrentTaskHandle(),
+    };
     
-    err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
+    // Скачать файл через то же соединение, что и /check
+    esp_http_client_handle_t client = pipe.stream ? ota_session_request(
+        config, firmware_info->download_url, HTTP_METHOD_GET, 60000) : NULL;
+    if (!client) {
         esp_ota_abort(update_handle);
-        ota_report_status(config, firmware_info->firmware_id, "failed",
-                         0, "HTTP connection failed");
-        return err;
+        mbedtls_sha256_free(&sha);
+        free(ring);
+        return ESP_ERR_NO_MEM;
     }
     
-    uint32_t bytes_downloaded = 0;
-    uint8_t buffer[4096];
-    int bytes_read;
-    uint32_t last_report = 0;
+    uint32_t last_report = bytes_downloaded;
+    int attempts = 0;
+    bool complete = false;
+    const char *failure = NULL;
     
-    while (1) {
-        bytes_read = esp_http_client_read(client, buffer, sizeof(buffer));
-        
-        if (bytes_read < 0) {
-            ESP_LOGE(TAG, "Error during download");
-            esp_http_client_cleanup(client);
+    // Пока тело ответа не дочитано, статусы не отправляются через общее соединение
+    s_status.session_busy = true;
+    while (!complete && !failure) {
+        int status_code = 0;
+        err = ota_open_download(client, firmware_info, bytes_downloaded, &status_code);
+        if (err == ESP_OK && bytes_downloaded > 0 && (status_code == 200 || status_code == 416)) {
+            // Сервер отдал файл целиком (If-Range не совпал) или позиция неверна - начать заново
+            ESP_LOGW(TAG, "Server ignored range (status %d), restarting download", status_code);
             esp_ota_abort(update_handle);
-            ota_report_status(config, firmware_info->firmware_id, "failed",
-                             bytes_downloaded, "Download error");
-            return ESP_FAIL;
+            ota_resume_clear();
+            mbedtls_sha256_starts(&sha, 0);
+            bytes_downloaded = 0;
+            last_report = 0;
+            esp_err_t begin_err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+            if (begin_err != ESP_OK) {
+                esp_http_client_close(client);
+                s_status.session_busy = false;
+                mbedtls_sha256_free(&sha);
+                free(ring);
+                ota_report_status(config, firmware_info->firmware_id, "failed",
+                                 0, "OTA begin failed");
+                return begin_err;
+            }
+            if (status_code != 200) {
+                esp_http_client_close(client);
+                continue;
+            }
+        } else if (err == ESP_OK && status_code != 200 && status_code != 206) {
+            ESP_LOGE(TAG, "Download returned status code: %d", status_code);
+            esp_http_client_close(client);
+            failure = "Download rejected";
+            break;
         }
         
-        if (bytes_read == 0) {
-            break;  // Скачивание завершено
+        // Запись во flash идёт в отдельной задаче, пока здесь читается следующий кусок
+        pipe.update_handle = update_handle;
+        pipe.bytes_written = bytes_downloaded;
+        pipe.err = ESP_OK;
+        pipe.eof = false;
+        bool writer_running = false;
+        if (err == ESP_OK) {
+            if (xTaskCreate(ota_flash_writer_task, "ota_writer", OTA_WRITER_STACK_SIZE,
+                            &pipe, OTA_WRITER_PRIORITY, NULL) != pdPASS) {
+                esp_http_client_close(client);
+                err = ESP_ERR_NO_MEM;
+                failure = "OTA writer failed";
+                break;
+            }
+            writer_running = true;
         }
+        uint32_t bytes_received = bytes_downloaded;
         
-        // Записать данные в OTA раздел
-        err = esp_ota_write(update_handle, buffer, bytes_read);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
-            esp_http_client_cleanup(client);
-            esp_ota_abort(update_handle);
-            ota_report_status(config, firmware_info->firmware_id, "failed",
-                             bytes_downloaded, "OTA write failed");
-            return err;
+        while (err == ESP_OK) {
+            int bytes_read = esp_http_client_read(client, (char *)s_read_chunk, sizeof(s_read_chunk));
+            
+            if (bytes_read < 0) {
+                err = ESP_FAIL;
+                break;
+            }
+            
+            if (bytes_read == 0) {
+                if (esp_http_client_is_complete_data_received(client) ||
+                    bytes_received >= firmware_info->file_size) {
+                    complete = true;  // Скачивание завершено
+                } else {
+                    err = ESP_FAIL;  // Соединение оборвалось раньше конца файла
+                }
+                break;
+            }
+            
+            // Ждёт, только если запись во flash отстала на весь кольцевой буфер
+            xStreamBufferSend(pipe.stream, s_read_chunk, bytes_read, portMAX_DELAY);
+            bytes_received += bytes_read;
+            if (pipe.err != ESP_OK) {
+                break;
+            }
+            
+            // Отправлять статус и сохранять позицию каждые 100KB записанного
+            uint32_t bytes_written = pipe.bytes_written;
+            if (bytes_written - last_report > 100 * 1024) {
+                ota_resume_save(firmware_info->firmware_id, firmware_info->file_hash, bytes_written);
+                ota_report_status(config, firmware_info->firmware_id, "downloading",
+                                 bytes_written, NULL);
+                last_report = bytes_written;
+                ESP_LOGI(TAG, "Downloaded: %" PRIu32 " / %" PRIu32 " bytes",
+                         bytes_written, firmware_info->file_size);
+            }
         }
         
-        bytes_downloaded += bytes_read;
+        // Дождаться, пока задача записи выберет всё принятое
+        if (writer_running) {
+            pipe.eof = true;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        bytes_downloaded = pipe.bytes_written;
+        if (pipe.err != ESP_OK) {
+            ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(pipe.err));
+            err = pipe.err;
+            failure = "OTA write failed";
+            complete = false;
+            ota_resume_clear();
+        }
         
-        // Отправлять статус каждые 100KB
-        if (bytes_downloaded - last_report > 100 * 1024) {
-            ota_report_status(config, firmware_info->firmware_id, "downloading",
-                             bytes_downloaded, NULL);
-            last_report = bytes_downloaded;
-            ESP_LOGI(TAG, "Downloaded: %d / %d bytes", bytes_downloaded, firmware_info->file_size);
+        // Полностью прочитанный ответ оставляет соединение открытым для статусов
+        if (!complete) {
+            esp_http_client_close(client);
+        }
+        
+        if (complete || failure) {
+            break;
         }
+        
+        ota_resume_save(firmware_info->firmware_id, firmware_info->file_hash, bytes_downloaded);
+        if (++attempts >= OTA_MAX_RESUME_ATTEMPTS) {
+            failure = "Download error";
+            break;
+        }
+        ESP_LOGW(TAG, "Download interrupted at %" PRIu32 " bytes, resuming (attempt %d/%d)",
+                 bytes_downloaded, attempts, OTA_MAX_RESUME_ATTEMPTS);
+        vTaskDelay(pdMS_TO_TICKS(OTA_RESUME_BACKOFF_MS * attempts));
     }
+    s_status.session_busy = false;
+    vStreamBufferDelete(pipe.stream);
+    free(ring);
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
     
-    esp_http_client_cleanup(client);
+    if (failure) {
+        // Частично записанный раздел сохраняется для докачки в следующем цикле
+        esp_ota_abort(update_handle);
+        ota_report_status(config, firmware_info->firmware_id, "failed",
+                         bytes_downloaded, failure);
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
     
     // Завершить OTA
+    ota_resume_clear();
+    if (!sha256_matches_hex(digest, firmware_info->file_hash)) {
+        ESP_LOGE(TAG, "Firmware hash mismatch");
+        esp_ota_abort(update_handle);
+        ota_report_status(config, firmware_info->firmware_id, "failed",
+                         bytes_downloaded, "Hash mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
     err = esp_ota_end(update_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
@@ -429,6 +1180,320 @@ static esp_err_t ota_download_and_install(
     return ESP_OK;
 }
 
+/**
+ * Контекст применения дельта-патча (detools, sequential):
+ * старый образ читается из текущего раздела, новый пишется в раздел OTA
+ */
+typedef struct {
+    const esp_partition_t *from_partition;
+    size_t from_offset;
+    esp_ota_handle_t update_handle;
+    mbedtls_sha256_context sha;
+} ota_patch_ctx_t;
+
+static int ota_patch_from_read(void *arg_p, uint8_t *buf_p, size_t size)
+{
+    ota_patch_ctx_t *ctx = (ota_patch_ctx_t *)arg_p;
+    if (esp_partition_read(ctx->from_partition, ctx->from_offset, buf_p, size) != ESP_OK) {
+        return -1;
+    }
+    ctx->from_offset += size;
+    return 0;
+}
+
+static int ota_patch_from_seek(void *arg_p, int offset)
+{
+    ota_patch_ctx_t *ctx = (ota_patch_ctx_t *)arg_p;
+    ctx->from_offset += offset;
+    return 0;
+}
+
+static int ota_patch_to_write(void *arg_p, const uint8_t *buf_p, size_t size)
+{
+    ota_patch_ctx_t *ctx = (ota_patch_ctx_t *)arg_p;
+    if (esp_ota_write(ctx->update_handle, buf_p, size) != ESP_OK) {
+        return -1;
+    }
+    mbedtls_sha256_update(&ctx->sha, buf_p, size);
+    return 0;
+}
+
+/**
+ * Скачать дельта-патч и применить его на лету в неактивный раздел
+ *
+ * При любой ошибке возвращает ошибку без отчёта "failed" - вызывающий код
+ * переходит на полный образ.
+ */
+static esp_err_t ota_download_and_apply_patch(
+    const ota_config_t *config,
+    const ota_firmware_info_t *firmware_info)
+{
+    ESP_LOGI(TAG, "Applying delta patch (%" PRIu32 " bytes) from %s",
+             firmware_info->patch_size, firmware_info->patch_url);
+    
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL) {
+        return ESP_FAIL;
+    }
+    
+    ota_patch_ctx_t ctx = {
+        .from_partition = esp_ota_get_running_partition(),
+        .from_offset = 0,
+    };
+    esp_err_t err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &ctx.update_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mbedtls_sha256_init(&ctx.sha);
+    mbedtls_sha256_starts(&ctx.sha, 0);
+    
+    struct detools_apply_patch_t apply_patch;
+    int res = detools_apply_patch_init(&apply_patch,
+                                       ota_patch_from_read,
+                                       ota_patch_from_seek,
+                                       firmware_info->patch_size,
+                                       ota_patch_to_write,
+                                       &ctx);
+    if (res != 0) {
+        ESP_LOGE(TAG, "detools init failed: %s", detools_error_as_string(res));
+        mbedtls_sha256_free(&ctx.sha);
+        esp_ota_abort(ctx.update_handle);
+        return ESP_FAIL;
+    }
+    
+    // Статус отправляется до открытия запроса: потом соединение занято патчем
+    ota_report_status(config, firmware_info->firmware_id, "downloading", 0, NULL);
+    s_status.session_busy = true;
+    
+    esp_http_client_handle_t client = ota_session_request(
+        config, firmware_info->patch_url, HTTP_METHOD_GET, 60000);
+    int status_code = 0;
+    err = client ? ota_open_download(client, firmware_info, 0, &status_code) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK && status_code != 200) {
+        ESP_LOGE(TAG, "Patch download returned status code: %d", status_code);
+        err = ESP_FAIL;
+    }
+    
+    uint8_t buffer[4096];
+    uint32_t bytes_downloaded = 0;
+    uint32_t last_report = 0;
+    while (err == ESP_OK) {
+        int bytes_read = esp_http_client_read(client, (char *)buffer, sizeof(buffer));
+        if (bytes_read < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (bytes_read == 0) {
+            if (bytes_downloaded != firmware_info->patch_size) {
+                err = ESP_FAIL;
+            }
+            break;
+        }
+        res = detools_apply_patch_process(&apply_patch, buffer, bytes_read);
+        if (res != 0) {
+            ESP_LOGE(TAG, "detools process failed: %s", detools_error_as_string(res));
+            err = ESP_FAIL;
+            break;
+        }
+        bytes_downloaded += bytes_read;
+        if (bytes_downloaded - last_report > 100 * 1024) {
+            ota_report_status(config, firmware_info->firmware_id, "downloading",
+                             bytes_downloaded, NULL);
+            last_report = bytes_downloaded;
+        }
+    }
+    if (err != ESP_OK && client) {
+        esp_http_client_close(client);
+    }
+    s_status.session_busy = false;
+    
+    if (err == ESP_OK) {
+        res = detools_apply_patch_finalize(&apply_patch);
+        if (res < 0) {
+            ESP_LOGE(TAG, "detools finalize failed: %s", detools_error_as_string(res));
+            err = ESP_FAIL;
+        }
+    }
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&ctx.sha, digest);
+    mbedtls_sha256_free(&ctx.sha);
+    if (err == ESP_OK && !sha256_matches_hex(digest, firmware_info->file_hash)) {
+        ESP_LOGE(TAG, "Patched image hash mismatch");
+        err = ESP_ERR_INVALID_CRC;
+    }
+    
+    if (err != ESP_OK) {
+        esp_ota_abort(ctx.update_handle);
+        return err;
+    }
+    
+    err = esp_ota_end(ctx.update_handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(update_partition);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Finishing patched image failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    
+    ESP_LOGI(TAG, "Delta OTA update completed successfully");
+    ota_report_status(config, firmware_info->firmware_id, "success",
+                     bytes_downloaded, NULL);
+    return ESP_OK;
+}
+
+/**
+ * Выбрать из декодера всё распакованное и записать в раздел OTA
+ */
+static esp_err_t ota_inflate_drain(
+    heatshrink_decoder *decoder,
+    esp_ota_handle_t update_handle,
+    mbedtls_sha256_context *sha,
+    uint32_t *bytes_written)
+{
+    HSD_poll_res pres;
+    do {
+        size_t n = 0;
+        pres = heatshrink_decoder_poll(decoder, s_write_chunk, sizeof(s_write_chunk), &n);
+        if (pres < 0) {
+            return ESP_FAIL;
+        }
+        if (n > 0) {
+            esp_err_t err = esp_ota_write(update_handle, s_write_chunk, n);
+            if (err != ESP_OK) {
+                return err;
+            }
+            mbedtls_sha256_update(sha, s_write_chunk, n);
+            *bytes_written += n;
+        }
+    } while (pres == HSDR_POLL_MORE);
+    return ESP_OK;
+}
+
+/**
+ * Скачать сжатый heatshrink образ и распаковать его на лету в неактивный раздел
+ *
+ * Декодеру нужно только окно 2^8 байт и входной буфер, без кучи. Докачки нет:
+ * состояние декодера не переживает обрыв. При любой ошибке возвращает ошибку
+ * без отчёта "failed" - вызывающий код переходит на несжатый образ.
+ */
+static esp_err_t ota_download_and_install_compressed(
+    const ota_config_t *config,
+    const ota_firmware_info_t *firmware_info)
+{
+    ESP_LOGI(TAG, "Downloading compressed image (%" PRIu32 " of %" PRIu32 " bytes) from %s",
+             firmware_info->compressed_size, firmware_info->file_size, firmware_info->compressed_url);
+    
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL) {
+        return ESP_FAIL;
+    }
+    
+    // Статус отправляется до открытия запроса: потом соединение занято образом
+    ota_report_status(config, firmware_info->firmware_id, "downloading", 0, NULL);
+    
+    esp_ota_handle_t update_handle = 0;
+    esp_err_t err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    
+    static heatshrink_decoder decoder;
+    heatshrink_decoder_reset(&decoder);
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    s_status.session_busy = true;
+    
+    esp_http_client_handle_t client = ota_session_request(
+        config, firmware_info->compressed_url, HTTP_METHOD_GET, 60000);
+    int status_code = 0;
+    err = client ? ota_open_download(client, firmware_info, 0, &status_code) : ESP_ERR_NO_MEM;
+    if (err == ESP_OK && status_code != 200) {
+        ESP_LOGE(TAG, "Compressed download returned status code: %d", status_code);
+        err = ESP_FAIL;
+    }
+    
+    uint32_t bytes_downloaded = 0;
+    uint32_t bytes_written = 0;
+    uint32_t last_report = 0;
+    while (err == ESP_OK) {
+        int bytes_read = esp_http_client_read(client, (char *)s_read_chunk, sizeof(s_read_chunk));
+        if (bytes_read < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (bytes_read == 0) {
+            if (bytes_downloaded != firmware_info->compressed_size) {
+                err = ESP_FAIL;
+            }
+            break;
+        }
+        for (size_t offset = 0; offset < (size_t)bytes_read && err == ESP_OK;) {
+            size_t sunk = 0;
+            if (heatshrink_decoder_sink(&decoder, s_read_chunk + offset, bytes_read - offset, &sunk) < 0) {
+                err = ESP_FAIL;
+                break;
+            }
+            offset += sunk;
+            err = ota_inflate_drain(&decoder, update_handle, &sha, &bytes_written);
+        }
+        bytes_downloaded += bytes_read;
+        if (bytes_downloaded - last_report > 100 * 1024) {
+            ota_report_status(config, firmware_info->firmware_id, "downloading",
+                             bytes_downloaded, NULL);
+            last_report = bytes_downloaded;
+        }
+    }
+    s_status.session_busy = false;
+    if (err != ESP_OK && client) {
+        esp_http_client_close(client);
+    }
+    
+    // Дописать хвост, который декодер держал до конца входа
+    while (err == ESP_OK) {
+        HSD_finish_res fres = heatshrink_decoder_finish(&decoder);
+        if (fres < 0) {
+            err = ESP_FAIL;
+        } else if (fres == HSDR_FINISH_DONE) {
+            break;
+        } else {
+            err = ota_inflate_drain(&decoder, update_handle, &sha, &bytes_written);
+        }
+    }
+    
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (err == ESP_OK &&
+        (bytes_written != firmware_info->file_size || !sha256_matches_hex(digest, firmware_info->file_hash))) {
+        ESP_LOGE(TAG, "Decompressed image hash mismatch");
+        err = ESP_ERR_INVALID_CRC;
+    }
+    
+    if (err != ESP_OK) {
+        esp_ota_abort(update_handle);
+        return err;
+    }
+    
+    err = esp_ota_end(update_handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(update_partition);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Finishing decompressed image failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    // Раздел занят новым образом: прогресс старой несжатой загрузки больше не нужен
+    ota_resume_clear();
+    
+    ESP_LOGI(TAG, "Compressed OTA update completed successfully");
+    ota_report_status(config, firmware_info->firmware_id, "success",
+                     bytes_written, NULL);
+    return ESP_OK;
+}
+
 /**
  * Главная функция проверки и обновления
  * Должна вызываться периодически
@@ -446,11 +1511,38 @@ esp_err_t ota_check_and_update(const ota_config_t *config)
     
     // Если обновление доступно, скачать и установить
     if (firmware_info.firmware_id > 0) {
-        err = ota_download_and_install(config, &firmware_info);
+        err = ESP_FAIL;
+        // Патч и сжатый образ пишут раздел с нуля и затёрли бы начатую несжатую загрузку:
+        // если она есть, сразу продолжить её
+        ota_resume_state_t resume;
+        ota_resume_load(&resume);
+        bool resume_pending = ota_resume_matches(&resume, &firmware_info);
+        if (resume_pending) {
+            ESP_LOGI(TAG, "Unfinished raw download found, resuming it");
+        }
+        if (firmware_info.has_patch && !resume_pending) {
+            err = ota_download_and_apply_patch(config, &firmware_info);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Delta update failed, falling back to full image");
+            }
+        }
+        if (err != ESP_OK && firmware_info.has_compressed && !resume_pending) {
+            err = ota_download_and_install_compressed(config, &firmware_info);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "Compressed update failed, falling back to raw image");
+            }
+        }
+        if (err != ESP_OK) {
+            err = ota_download_and_install(config, &firmware_info);
+        }
+        ota_status_close(config);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to download and install firmware");
             return err;
         }
+    } else {
+        // До следующей проверки соединение не нужно; TLS-сессия сохраняется
+        ota_session_disconnect();
     }
     
     return ESP_OK;
@@ -487,9 +1579,11 @@ void app_main_ota_example(void)
     
     ota_config.current_version = app_desc.version;
     
-    // Периодически проверять обновления (в отдельной задаче)
+    // Периодически проверять обновления (в отдельной задаче).
+    // Интервал задаёт сервер (X-Next-Check-After, со случайным разбросом),
+    // чтобы устройства не просыпались одновременно.
     while (1) {
         ota_check_and_update(&ota_config);
-        vTaskDelay(OTA_CHECK_INTERVAL_SEC * 1000 / portTICK_PERIOD_MS);
+        vTaskDelay(pdMS_TO_TICKS((uint64_t)s_next_check_sec * 1000));
     }
 }
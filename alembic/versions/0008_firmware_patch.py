@@ -0,0 +1,41 @@
+"""Add firmware delta patches
+
+Revision ID: 0008_firmware_patch
+Revises: 0007_tenant_company_name
+Create Date: 2026-10-14 09:00:00.000000
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+# revision identifiers, used by Alembic.
+revision = "0008_firmware_patch"
+down_revision = "0007_tenant_company_name"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.create_table(
+        "firmware_patch",
+        sa.Column("id", sa.Integer(), nullable=False),
+        sa.Column("firmware_id", sa.Integer(), nullable=False),
+        sa.Column("source_firmware_id", sa.Integer(), nullable=False),
+        sa.Column("patch_path", sa.String(length=500), nullable=False),
+        sa.Column("patch_size", sa.Integer(), nullable=False),
+        sa.Column("patch_hash", sa.String(length=64), nullable=False),
+        sa.Column("compression", sa.String(length=20), nullable=False),
+        sa.Column("created_at", sa.DateTime(), nullable=False),
+        sa.ForeignKeyConstraint(["firmware_id"], ["firmware.id"], ondelete="CASCADE"),
+        sa.ForeignKeyConstraint(["source_firmware_id"], ["firmware.id"], ondelete="CASCADE"),
+        sa.PrimaryKeyConstraint("id"),
+        sa.UniqueConstraint("firmware_id", "source_firmware_id", name="uq_firmware_patch_source"),
+    )
+    op.create_index(
+        op.f("ix_firmware_patch_firmware_id"), "firmware_patch", ["firmware_id"], unique=False
+    )
+
+
+def downgrade() -> None:
+    op.drop_index(op.f("ix_firmware_patch_firmware_id"), table_name="firmware_patch")
+    op.drop_table("firmware_patch")
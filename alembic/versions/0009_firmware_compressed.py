@@ -0,0 +1,29 @@
+"""Add compressed firmware variants
+
+Revision ID: 0009_firmware_compressed
+Revises: 0008_firmware_patch
+Create Date: 2026-10-14 12:00:00.000000
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+# revision identifiers, used by Alembic.
+revision = "0009_firmware_compressed"
+down_revision = "0008_firmware_patch"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.add_column("firmware", sa.Column("compressed_path", sa.String(length=500), nullable=True))
+    op.add_column("firmware", sa.Column("compressed_size", sa.Integer(), nullable=True))
+    op.add_column("firmware", sa.Column("compressed_hash", sa.String(length=64), nullable=True))
+    op.add_column("firmware", sa.Column("compression", sa.String(length=20), nullable=True))
+
+
+def downgrade() -> None:
+    op.drop_column("firmware", "compression")
+    op.drop_column("firmware", "compressed_hash")
+    op.drop_column("firmware", "compressed_size")
+    op.drop_column("firmware", "compressed_path")
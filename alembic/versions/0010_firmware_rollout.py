@@ -0,0 +1,28 @@
+"""Add staged rollout controls to firmware
+
+Revision ID: 0010_firmware_rollout
+Revises: 0009_firmware_compressed
+Create Date: 2026-10-14 13:00:00.000000
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+# revision identifiers, used by Alembic.
+revision = "0010_firmware_rollout"
+down_revision = "0009_firmware_compressed"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.add_column(
+        "firmware",
+        sa.Column("rollout_percent", sa.Integer(), nullable=False, server_default="100"),
+    )
+    op.add_column("firmware", sa.Column("max_concurrent_downloads", sa.Integer(), nullable=True))
+
+
+def downgrade() -> None:
+    op.drop_column("firmware", "max_concurrent_downloads")
+    op.drop_column("firmware", "rollout_percent")
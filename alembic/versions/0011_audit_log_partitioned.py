@@ -0,0 +1,89 @@
+"""Partition audit_logs by month
+
+Revision ID: 0011_audit_log_partitioned
+Revises: 0010_firmware_rollout
+Create Date: 2026-10-14 15:00:00.000000
+"""
+
+from datetime import date, datetime, timezone
+
+from alembic import op
+import sqlalchemy as sa
+from sqlalchemy.dialects import postgresql
+
+# revision identifiers, used by Alembic.
+revision = "0011_audit_log_partitioned"
+down_revision = "0010_firmware_rollout"
+branch_labels = None
+depends_on = None
+
+COLUMNS = "id, tenant_id, device_id, action, meta, created_at"
+# Months created ahead of now; the app keeps extending this (AUDIT_PARTITIONS_AHEAD)
+MONTHS_AHEAD = 2
+
+
+def _add_months(month: date, months: int) -> date:
+    index = month.year * 12 + month.month - 1 + months
+    return date(index // 12, index % 12 + 1, 1)
+
+
+def upgrade() -> None:
+    bind = op.get_bind()
+    op.rename_table("audit_logs", "audit_logs_legacy")
+    op.execute("ALTER INDEX audit_logs_pkey RENAME TO audit_logs_legacy_pkey")
+
+    op.execute(
+        """
+        CREATE TABLE audit_logs (
+            id UUID NOT NULL,
+            tenant_id UUID,
+            device_id UUID,
+            action VARCHAR(64) NOT NULL,
+            meta JSON,
+            created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+            PRIMARY KEY (id, created_at)
+        ) PARTITION BY RANGE (created_at)
+        """
+    )
+    op.create_index("ix_audit_logs_tenant_id_created_at", "audit_logs", ["tenant_id", "created_at"])
+    op.execute("CREATE TABLE audit_logs_default PARTITION OF audit_logs DEFAULT")
+
+    earliest = bind.execute(sa.text("SELECT min(created_at) FROM audit_logs_legacy")).scalar()
+    now = datetime.now(timezone.utc)
+    start = earliest.astimezone(timezone.utc) if earliest else now
+    month = date(start.year, start.month, 1)
+    last = _add_months(date(now.year, now.month, 1), MONTHS_AHEAD)
+    while month <= last:
+        following = _add_months(month, 1)
+        op.execute(
+            f"CREATE TABLE audit_logs_p{month:%Y%m} PARTITION OF audit_logs "
+            f"FOR VALUES FROM ('{month.isoformat()} 00:00:00+00') TO ('{following.isoformat()} 00:00:00+00')"
+        )
+        month = following
+
+    op.execute(f"INSERT INTO audit_logs ({COLUMNS}) SELECT {COLUMNS} FROM audit_logs_legacy")
+    op.drop_table("audit_logs_legacy")
+
+
+def downgrade() -> None:
+    op.create_table(
+        "audit_logs_flat",
+        sa.Column("id", postgresql.UUID(as_uuid=True), primary_key=True, nullable=False),
+        sa.Column("tenant_id", postgresql.UUID(as_uuid=True), nullable=True),
+        sa.Column("device_id", postgresql.UUID(as_uuid=True), nullable=True),
+        sa.Column("action", sa.String(length=64), nullable=False),
+        sa.Column("meta", sa.JSON(), nullable=True),
+        sa.Column("created_at", sa.DateTime(timezone=True), server_default=sa.func.now(), nullable=False),
+    )
+    # Rows of deleted tenants or devices cannot satisfy the restored foreign keys
+    op.execute(
+        f"INSERT INTO audit_logs_flat ({COLUMNS}) SELECT {COLUMNS} FROM audit_logs a "
+        "WHERE (a.tenant_id IS NULL OR EXISTS (SELECT 1 FROM tenants t WHERE t.id = a.tenant_id)) "
+        "AND (a.device_id IS NULL OR EXISTS (SELECT 1 FROM devices d WHERE d.id = a.device_id))"
+    )
+    op.drop_table("audit_logs")  # Drops the partitions with it
+    op.rename_table("audit_logs_flat", "audit_logs")
+    op.execute("ALTER INDEX audit_logs_flat_pkey RENAME TO audit_logs_pkey")
+    op.create_foreign_key("fk_audit_logs_tenant_id_tenants", "audit_logs", "tenants", ["tenant_id"], ["id"])
+    op.create_foreign_key("fk_audit_logs_device_id_devices", "audit_logs", "devices", ["device_id"], ["id"])
+    op.create_index(op.f("ix_audit_logs_tenant_id"), "audit_logs", ["tenant_id"], unique=False)
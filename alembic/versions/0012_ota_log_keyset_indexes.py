@@ -0,0 +1,94 @@
+"""Composite indexes for keyset listings and per-firmware rollout counts
+
+Revision ID: 0012_ota_log_keyset_indexes
+Revises: 0011_audit_log_partitioned
+Create Date: 2026-10-14 16:00:00.000000
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+# revision identifiers, used by Alembic.
+revision = "0012_ota_log_keyset_indexes"
+down_revision = "0011_audit_log_partitioned"
+branch_labels = None
+depends_on = None
+
+INDEXES = [
+    ("ix_device_ota_log_created_at_id", "device_ota_log", ["created_at", "id"]),
+    ("ix_device_ota_log_device_id_created_at", "device_ota_log", ["device_id", "created_at"]),
+    ("ix_device_ota_log_firmware_id_status", "device_ota_log", ["firmware_id", "status"]),
+    ("ix_device_ota_log_status_created_at", "device_ota_log", ["status", "created_at"]),
+    ("ix_devices_tenant_id_created_at_id", "devices", ["tenant_id", "created_at", "id"]),
+    ("ix_license_keys_tenant_id_created_at_id", "license_keys", ["tenant_id", "created_at", "id"]),
+]
+# Prefixes of the composite indexes above
+REPLACED_INDEXES = [
+    ("ix_device_ota_log_device_id", "device_ota_log", ["device_id"]),
+    ("ix_device_ota_log_firmware_id", "device_ota_log", ["firmware_id"]),
+]
+
+
+def upgrade() -> None:
+    op.create_table(
+        "firmware_rollout_stats",
+        sa.Column("firmware_id", sa.Integer(), nullable=False),
+        sa.Column("status", sa.String(length=20), nullable=False),
+        sa.Column("count", sa.BigInteger(), nullable=False, server_default="0"),
+        sa.ForeignKeyConstraint(["firmware_id"], ["firmware.id"], ondelete="CASCADE"),
+        sa.PrimaryKeyConstraint("firmware_id", "status"),
+    )
+    op.execute(
+        """
+        CREATE FUNCTION firmware_rollout_stats_apply() RETURNS trigger AS $$
+        BEGIN
+            IF TG_OP IN ('UPDATE', 'DELETE') THEN
+                UPDATE firmware_rollout_stats SET count = count - 1
+                WHERE firmware_id = OLD.firmware_id AND status = OLD.status;
+            END IF;
+            IF TG_OP IN ('INSERT', 'UPDATE') THEN
+                INSERT INTO firmware_rollout_stats (firmware_id, status, count)
+                VALUES (NEW.firmware_id, NEW.status, 1)
+                ON CONFLICT (firmware_id, status) DO UPDATE SET count = firmware_rollout_stats.count + 1;
+            END IF;
+            RETURN NULL;
+        END
+        $$ LANGUAGE plpgsql
+        """
+    )
+    # Progress flushes do not touch status, so they never fire the update trigger
+    op.execute(
+        "CREATE TRIGGER device_ota_log_stats_insert_delete AFTER INSERT OR DELETE ON device_ota_log "
+        "FOR EACH ROW EXECUTE FUNCTION firmware_rollout_stats_apply()"
+    )
+    op.execute(
+        "CREATE TRIGGER device_ota_log_stats_update AFTER UPDATE OF status, firmware_id ON device_ota_log "
+        "FOR EACH ROW WHEN (OLD.status IS DISTINCT FROM NEW.status OR OLD.firmware_id IS DISTINCT FROM NEW.firmware_id) "
+        "EXECUTE FUNCTION firmware_rollout_stats_apply()"
+    )
+    # Writers wait for the backfill, so no transition is counted twice or missed
+    op.execute("LOCK TABLE device_ota_log IN SHARE MODE")
+    op.execute(
+        "INSERT INTO firmware_rollout_stats (firmware_id, status, count) "
+        "SELECT firmware_id, status, count(*) FROM device_ota_log GROUP BY firmware_id, status"
+    )
+
+    # Large tables: build without blocking device writes
+    with op.get_context().autocommit_block():
+        for name, table, columns in INDEXES:
+            op.create_index(name, table, columns, unique=False, postgresql_concurrently=True, if_not_exists=True)
+        for name, table, _ in REPLACED_INDEXES:
+            op.drop_index(name, table_name=table, postgresql_concurrently=True, if_exists=True)
+
+
+def downgrade() -> None:
+    with op.get_context().autocommit_block():
+        for name, table, columns in REPLACED_INDEXES:
+            op.create_index(name, table, columns, unique=False, postgresql_concurrently=True, if_not_exists=True)
+        for name, table, _ in reversed(INDEXES):
+            op.drop_index(name, table_name=table, postgresql_concurrently=True, if_exists=True)
+
+    op.execute("DROP TRIGGER device_ota_log_stats_update ON device_ota_log")
+    op.execute("DROP TRIGGER device_ota_log_stats_insert_delete ON device_ota_log")
+    op.execute("DROP FUNCTION firmware_rollout_stats_apply()")
+    op.drop_table("firmware_rollout_stats")
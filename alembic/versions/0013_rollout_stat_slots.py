@@ -0,0 +1,80 @@
+"""Spread firmware_rollout_stats over slot rows
+
+Revision ID: 0013_rollout_stat_slots
+Revises: 0012_ota_log_keyset_indexes
+Create Date: 2026-10-14 18:00:00.000000
+"""
+
+from alembic import op
+import sqlalchemy as sa
+
+# revision identifiers, used by Alembic.
+revision = "0013_rollout_stat_slots"
+down_revision = "0012_ota_log_keyset_indexes"
+branch_labels = None
+depends_on = None
+
+# Concurrent status writes for one (firmware, status) land on one of this many rows
+SLOTS = 16
+
+
+def upgrade() -> None:
+    op.add_column(
+        "firmware_rollout_stats",
+        sa.Column("slot", sa.SmallInteger(), nullable=False, server_default="0"),
+    )
+    op.drop_constraint("firmware_rollout_stats_pkey", "firmware_rollout_stats", type_="primary")
+    op.create_primary_key("firmware_rollout_stats_pkey", "firmware_rollout_stats", ["firmware_id", "status", "slot"])
+    # A slot's count may go negative (decremented in another slot than it was counted in); only sums matter
+    op.execute(
+        f"""
+        CREATE OR REPLACE FUNCTION firmware_rollout_stats_apply() RETURNS trigger AS $$
+        DECLARE
+            target_slot smallint := floor(random() * {SLOTS});
+        BEGIN
+            IF TG_OP IN ('UPDATE', 'DELETE') THEN
+                INSERT INTO firmware_rollout_stats (firmware_id, status, slot, count)
+                VALUES (OLD.firmware_id, OLD.status, target_slot, -1)
+                ON CONFLICT (firmware_id, status, slot) DO UPDATE SET count = firmware_rollout_stats.count - 1;
+            END IF;
+            IF TG_OP IN ('INSERT', 'UPDATE') THEN
+                INSERT INTO firmware_rollout_stats (firmware_id, status, slot, count)
+                VALUES (NEW.firmware_id, NEW.status, target_slot, 1)
+                ON CONFLICT (firmware_id, status, slot) DO UPDATE SET count = firmware_rollout_stats.count + 1;
+            END IF;
+            RETURN NULL;
+        END
+        $$ LANGUAGE plpgsql
+        """
+    )
+
+
+def downgrade() -> None:
+    op.execute(
+        """
+        CREATE OR REPLACE FUNCTION firmware_rollout_stats_apply() RETURNS trigger AS $$
+        BEGIN
+            IF TG_OP IN ('UPDATE', 'DELETE') THEN
+                UPDATE firmware_rollout_stats SET count = count - 1
+                WHERE firmware_id = OLD.firmware_id AND status = OLD.status;
+            END IF;
+            IF TG_OP IN ('INSERT', 'UPDATE') THEN
+                INSERT INTO firmware_rollout_stats (firmware_id, status, count)
+                VALUES (NEW.firmware_id, NEW.status, 1)
+                ON CONFLICT (firmware_id, status) DO UPDATE SET count = firmware_rollout_stats.count + 1;
+            END IF;
+            RETURN NULL;
+        END
+        $$ LANGUAGE plpgsql
+        """
+    )
+    # Writers wait while the slots are folded back into one row per (firmware, status)
+    op.execute("LOCK TABLE device_ota_log IN SHARE MODE")
+    op.execute("DELETE FROM firmware_rollout_stats")
+    op.drop_constraint("firmware_rollout_stats_pkey", "firmware_rollout_stats", type_="primary")
+    op.drop_column("firmware_rollout_stats", "slot")
+    op.create_primary_key("firmware_rollout_stats_pkey", "firmware_rollout_stats", ["firmware_id", "status"])
+    op.execute(
+        "INSERT INTO firmware_rollout_stats (firmware_id, status, count) "
+        "SELECT firmware_id, status, count(*) FROM device_ota_log GROUP BY firmware_id, status"
+    )
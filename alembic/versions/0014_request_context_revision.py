@@ -0,0 +1,22 @@
+"""Sequence that announces tenant/device auth changes to every worker
+
+Revision ID: 0014_request_context_revision
+Revises: 0013_rollout_stat_slots
+Create Date: 2026-10-14 19:00:00.000000
+"""
+
+from alembic import op
+
+# revision identifiers, used by Alembic.
+revision = "0014_request_context_revision"
+down_revision = "0013_rollout_stat_slots"
+branch_labels = None
+depends_on = None
+
+
+def upgrade() -> None:
+    op.execute("CREATE SEQUENCE request_context_revision")
+
+
+def downgrade() -> None:
+    op.execute("DROP SEQUENCE request_context_revision")
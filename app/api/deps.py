@@ -2,28 +2,31 @@ from dataclasses import dataclass
 import hmac
 from fastapi import Depends, Header, HTTPException, Request
 from fastapi.security import HTTPAuthorizationCredentials, HTTPBearer
+from sqlalchemy.exc import IntegrityError
+from sqlalchemy.ext.asyncio import AsyncSession
 from sqlalchemy.orm import Session
 
 from app.config import get_settings
-from app.db import SessionLocal
-from app.models import Device, Tenant, TenantStatus
+from app.db import AsyncSessionLocal, SessionLocal
+from app.models import Device, TenantStatus
 from app.services.auth import TokenData, TokenExpired, TokenInvalid, decode_access_token
-from app.services.rate_limit import RateLimiter
+from app.services.rate_limit import RateLimiter, RedisRateLimiter, build_rate_limiter
+from app.services.request_cache import DeviceSnapshot, TenantSnapshot, context_cache, last_seen_tracker
 from app.services.subscription import evaluate_subscription
 from app.utils.time import utcnow
 
 settings = get_settings()
 
 bearer_scheme = HTTPBearer(auto_error=False)
-activate_limiter = RateLimiter(settings.rate_limit_activate_per_minute, 60)
-activate_ip_limiter = RateLimiter(settings.rate_limit_activate_ip_per_minute, 60)
-refresh_limiter = RateLimiter(settings.rate_limit_refresh_per_minute, 60)
+activate_limiter = build_rate_limiter("activate", settings.rate_limit_activate_per_minute, 60)
+activate_ip_limiter = build_rate_limiter("activate_ip", settings.rate_limit_activate_ip_per_minute, 60)
+refresh_limiter = build_rate_limiter("refresh", settings.rate_limit_refresh_per_minute, 60)
 
 
 @dataclass
 class RequestContext:
-    tenant: Tenant
-    device: Device | None
+    tenant: TenantSnapshot
+    device: DeviceSnapshot | None
     token: TokenData
     subscription_active: bool
     grace_active: bool
@@ -37,6 +40,11 @@ def get_db() -> Session:
         db.close()
 
 
+async def get_async_db() -> AsyncSession:
+    async with AsyncSessionLocal() as db:
+        yield db
+
+
 def get_client_ip(request: Request) -> str:
     forwarded = request.headers.get("x-forwarded-for")
     if forwarded:
@@ -46,7 +54,7 @@ def get_client_ip(request: Request) -> str:
     return "unknown"
 
 
-def enforce_rate_limit(limiter: RateLimiter, key: str) -> None:
+def enforce_rate_limit(limiter: RateLimiter | RedisRateLimiter, key: str) -> None:
     if not limiter.allow(key):
         raise HTTPException(status_code=429, detail="Too many requests")
 
@@ -87,7 +95,7 @@ def get_request_context(
     token_data: TokenData = Depends(get_token_data),
     db: Session = Depends(get_db),
 ) -> RequestContext:
-    tenant = db.query(Tenant).filter(Tenant.id == token_data.tenant_id).first()
+    tenant = context_cache.get_tenant(db, token_data.tenant_id)
     if not tenant:
         raise HTTPException(status_code=401, detail="Tenant not found")
 
@@ -105,19 +113,14 @@ def get_request_context(
 
     device = None
     if token_data.device_id:
-        device = (
-            db.query(Device)
-            .filter(Device.tenant_id == tenant.id, Device.device_id == token_data.device_id)
-            .first()
-        )
+        device = context_cache.get_device(db, tenant.id, token_data.device_id)
         if device and device.revoked:
             raise HTTPException(status_code=403, detail="Device revoked")
         if not device:
-            device = Device(device_id=token_data.device_id, tenant_id=tenant.id, last_seen=now)
-            db.add(device)
+            device = _register_device(db, tenant.id, token_data.device_id, now)
         else:
-            device.last_seen = now
-        db.commit()
+            # Written in bulk by the last_seen flusher
+            last_seen_tracker.mark(device.id, now)
 
     return RequestContext(
         tenant=tenant,
@@ -126,3 +129,21 @@ def get_request_context(
         subscription_active=state.subscription_active,
         grace_active=state.grace_active,
     )
+
+
+def _register_device(db: Session, tenant_id, device_id: str, now) -> DeviceSnapshot:
+    new_device = Device(device_id=device_id, tenant_id=tenant_id, last_seen=now)
+    db.add(new_device)
+    try:
+        db.commit()
+    except IntegrityError:
+        # Registered concurrently by another request
+        db.rollback()
+        new_device = (
+            db.query(Device)
+            .filter(Device.tenant_id == tenant_id, Device.device_id == device_id)
+            .one()
+        )
+        if new_device.revoked:
+            raise HTTPException(status_code=403, detail="Device revoked")
+    return context_cache.store_device(new_device)
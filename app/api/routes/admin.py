@@ -2,11 +2,11 @@ import secrets
 import uuid
 from datetime import timedelta
 
-from fastapi import APIRouter, Depends, HTTPException
+from fastapi import APIRouter, Depends, HTTPException, Query, Response
 from sqlalchemy.orm import Session
 
 from app.api.deps import get_db, require_admin
-from app.models import AuditLog, Device, LicenseKey, LicenseKeyStatus, Tenant, TenantStatus
+from app.models import Device, LicenseKey, LicenseKeyStatus, Tenant, TenantStatus
 from app.schemas import (
     DeviceRevokeRequest,
     DeviceResponse,
@@ -18,8 +18,13 @@ from app.schemas import (
     TenantResponse,
     TenantStatusUpdateRequest,
 )
+from app.services.audit import delete_tenant_audit
 from app.services.erpnext import normalize_erpnext_url
 from app.services.license import fingerprint_license_key, hash_license_key
+from app.services.license_lookup import SCAN_FALLBACKS_METRIC, count_legacy_keys
+from app.services.metrics import counters
+from app.services.pagination import MAX_PAGE_SIZE, keyset_page, uuid_id
+from app.services.request_cache import context_cache
 from app.utils.time import utcnow
 
 router = APIRouter(prefix="/admin", tags=["admin"], dependencies=[Depends(require_admin)])
@@ -46,6 +51,17 @@ def get_tenant_or_404(db: Session, company_code: str) -> Tenant:
     return tenant
 
 
+def _page_or_400(response: Response, query, model, cursor: str | None, limit: int) -> list:
+    """One keyset page on (created_at, id), newest first; X-Next-Cursor points at the next."""
+    try:
+        rows, next_cursor = keyset_page(query, model.created_at, model.id, cursor, limit, id_type=uuid_id)
+    except ValueError:
+        raise HTTPException(status_code=400, detail="Invalid cursor")
+    if next_cursor:
+        response.headers["X-Next-Cursor"] = next_cursor
+    return rows
+
+
 def serialize_tenant(tenant: Tenant) -> TenantResponse:
     return TenantResponse(
         id=tenant.id,
@@ -101,6 +117,7 @@ def update_status(
     tenant = get_tenant_or_404(db, company_code)
     tenant.status = parse_tenant_status(payload.status)
     db.commit()
+    context_cache.invalidate_tenant(tenant.id, db)
     db.refresh(tenant)
     return serialize_tenant(tenant)
 
@@ -126,6 +143,7 @@ def update_subscription(
         tenant.subscription_expires_at = base + timedelta(days=payload.add_days)
 
     db.commit()
+    context_cache.invalidate_tenant(tenant.id, db)
     db.refresh(tenant)
     return serialize_tenant(tenant)
 
@@ -133,30 +151,29 @@ def update_subscription(
 @router.delete("/tenants/{company_code}", status_code=204)
 def delete_tenant(company_code: str, db: Session = Depends(get_db)) -> None:
     tenant = get_tenant_or_404(db, company_code)
-    device_ids = [
-        row.id for row in db.query(Device.id).filter(Device.tenant_id == tenant.id).all()
-    ]
-    audit_query = db.query(AuditLog)
-    if device_ids:
-        audit_query = audit_query.filter(
-            (AuditLog.tenant_id == tenant.id) | (AuditLog.device_id.in_(device_ids))
-        )
-    else:
-        audit_query = audit_query.filter(AuditLog.tenant_id == tenant.id)
-    audit_query.delete(synchronize_session=False)
+    delete_tenant_audit(db, tenant.id)
+    tenant_id = tenant.id
     db.delete(tenant)
     db.commit()
+    context_cache.invalidate_tenant(tenant_id, db)
     return None
 
 
 @router.get("/tenants/{company_code}/licenses", response_model=list[LicenseResponse])
-def list_licenses(company_code: str, db: Session = Depends(get_db)) -> list[LicenseResponse]:
+def list_licenses(
+    company_code: str,
+    response: Response,
+    cursor: str | None = None,
+    limit: int = Query(default=100, ge=1, le=MAX_PAGE_SIZE),
+    db: Session = Depends(get_db),
+) -> list[LicenseResponse]:
     tenant = get_tenant_or_404(db, company_code)
-    licenses = (
-        db.query(LicenseKey)
-        .filter(LicenseKey.tenant_id == tenant.id)
-        .order_by(LicenseKey.created_at.desc())
-        .all()
+    licenses = _page_or_400(
+        response,
+        db.query(LicenseKey).filter(LicenseKey.tenant_id == tenant.id),
+        LicenseKey,
+        cursor,
+        limit,
     )
     return [
         LicenseResponse(id=key.id, status=key.status.value, created_at=key.created_at, license_key=None)
@@ -193,6 +210,15 @@ def create_license(payload: LicenseCreateRequest, db: Session = Depends(get_db))
     )
 
 
+@router.get("/licenses/legacy")
+def legacy_license_stats(db: Session = Depends(get_db)) -> dict:
+    """Progress of the fingerprint backfill; both numbers should reach zero."""
+    return {
+        "legacy_keys": count_legacy_keys(db),
+        "scan_fallbacks": counters.get(SCAN_FALLBACKS_METRIC),
+    }
+
+
 @router.patch("/licenses/{license_id}/status", response_model=LicenseResponse)
 def update_license_status(
     license_id: str, payload: LicenseStatusUpdateRequest, db: Session = Depends(get_db)
@@ -235,13 +261,20 @@ def delete_license(license_id: str, db: Session = Depends(get_db)) -> None:
 
 
 @router.get("/tenants/{company_code}/devices", response_model=list[DeviceResponse])
-def list_devices(company_code: str, db: Session = Depends(get_db)) -> list[DeviceResponse]:
+def list_devices(
+    company_code: str,
+    response: Response,
+    cursor: str | None = None,
+    limit: int = Query(default=100, ge=1, le=MAX_PAGE_SIZE),
+    db: Session = Depends(get_db),
+) -> list[DeviceResponse]:
     tenant = get_tenant_or_404(db, company_code)
-    devices = (
-        db.query(Device)
-        .filter(Device.tenant_id == tenant.id)
-        .order_by(Device.created_at.desc())
-        .all()
+    devices = _page_or_400(
+        response,
+        db.query(Device).filter(Device.tenant_id == tenant.id),
+        Device,
+        cursor,
+        limit,
     )
     return [
         DeviceResponse(device_id=device.device_id, revoked=device.revoked, last_seen=device.last_seen)
@@ -264,5 +297,6 @@ def update_device(
 
     device.revoked = payload.revoked
     db.commit()
+    context_cache.invalidate_device(tenant.id, device_id, db)
     db.refresh(device)
     return DeviceResponse(device_id=device.device_id, revoked=device.revoked, last_seen=device.last_seen)
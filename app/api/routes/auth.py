@@ -3,10 +3,13 @@ from sqlalchemy import func
 from sqlalchemy.orm import Session
 
 from app.api.deps import get_client_ip, get_db, get_request_context, rate_limit_activate, rate_limit_refresh
-from app.models import AuditLog, Device, LicenseKey, LicenseKeyStatus, OTAAccess, Tenant, TenantStatus
+from app.models import Device, LicenseKey, LicenseKeyStatus, OTAAccess, Tenant, TenantStatus
 from app.schemas import ActivateRequest, TokenResponse
+from app.services.audit import audit_buffer
 from app.services.auth import create_access_token
 from app.services.license import fingerprint_license_key, verify_license_key_flexible
+from app.services.license_lookup import find_license_key
+from app.services.verify_pool import VerificationPoolSaturated, get_verification_pool
 from app.utils.time import utcnow
 
 router = APIRouter(tags=["auth"])
@@ -52,7 +55,9 @@ def _activate(
         if not matched_key or matched_key.status != LicenseKeyStatus.active:
             raise HTTPException(status_code=401, detail="License key invalid")
 
-        if not verify_license_key_flexible(raw_key, matched_key.hashed_key):
+        if not get_verification_pool().run(
+            str(tenant.id), verify_license_key_flexible, raw_key, matched_key.hashed_key
+        ):
             raise HTTPException(status_code=401, detail="License key invalid")
 
         if fingerprint and not matched_key.fingerprint:
@@ -69,62 +74,11 @@ def _activate(
         if tenant.subscription_expires_at < now:
             raise HTTPException(status_code=403, detail="Subscription expired")
 
-        active_keys: list[LicenseKey] = []
-        if fingerprint:
-            active_keys = (
-                db.query(LicenseKey)
-                .filter(
-                    LicenseKey.tenant_id == tenant.id,
-                    LicenseKey.status == LicenseKeyStatus.active,
-                    LicenseKey.fingerprint == fingerprint,
-                )
-                .all()
-            )
-        if not active_keys:
-            active_keys = (
-                db.query(LicenseKey)
-                .filter(
-                    LicenseKey.tenant_id == tenant.id,
-                    LicenseKey.status == LicenseKeyStatus.active,
-                    LicenseKey.fingerprint.is_(None),
-                )
-                .all()
-            )
-        if not active_keys:
-            raise HTTPException(status_code=401, detail="License key invalid")
-
-        matched_key = next(
-            (key for key in active_keys if verify_license_key_flexible(raw_key, key.hashed_key)),
-            None,
-        )
+        matched_key = find_license_key(db, raw_key, tenant_id=tenant.id)
         if not matched_key:
             raise HTTPException(status_code=401, detail="License key invalid")
-        if fingerprint and not matched_key.fingerprint:
-            matched_key.fingerprint = fingerprint
     else:
-        active_keys: list[LicenseKey] = []
-        if fingerprint:
-            active_keys = (
-                db.query(LicenseKey)
-                .filter(
-                    LicenseKey.status == LicenseKeyStatus.active,
-                    LicenseKey.fingerprint == fingerprint,
-                )
-                .all()
-            )
-        if not active_keys:
-            active_keys = (
-                db.query(LicenseKey)
-                .filter(
-                    LicenseKey.status == LicenseKeyStatus.active,
-                    LicenseKey.fingerprint.is_(None),
-                )
-                .all()
-            )
-        matched_key = next(
-            (key for key in active_keys if verify_license_key_flexible(raw_key, key.hashed_key)),
-            None,
-        )
+        matched_key = find_license_key(db, raw_key)
         if not matched_key:
             raise HTTPException(status_code=401, detail="License key invalid")
 
@@ -134,8 +88,6 @@ def _activate(
 
         if tenant.subscription_expires_at < now:
             raise HTTPException(status_code=403, detail="Subscription expired")
-        if fingerprint and not matched_key.fingerprint:
-            matched_key.fingerprint = fingerprint
 
     device = (
         db.query(Device)
@@ -154,15 +106,8 @@ def _activate(
 
     token, token_data = create_access_token(tenant.id, device_id=payload.device_id, issued_at=now)
 
-    db.add(
-        AuditLog(
-            tenant_id=tenant.id,
-            device_id=device.id,
-            action="activate",
-            meta={"ip": get_client_ip(request)},
-        )
-    )
     db.commit()
+    audit_buffer.record("activate", tenant_id=tenant.id, device_id=device.id, meta={"ip": get_client_ip(request)})
 
     return TokenResponse(
         access_token=token,
@@ -172,14 +117,27 @@ def _activate(
     )
 
 
+def _activate_or_429(
+    payload: ActivateRequest,
+    request: Request,
+    db: Session,
+    *,
+    allow_ota_access: bool,
+) -> TokenResponse:
+    try:
+        return _activate(payload, request, db, allow_ota_access=allow_ota_access)
+    except VerificationPoolSaturated:
+        raise HTTPException(status_code=429, detail="Too many requests", headers={"Retry-After": "1"})
+
+
 @router.post("/activate", response_model=TokenResponse)
 def activate(payload: ActivateRequest, request: Request, db: Session = Depends(get_db)) -> TokenResponse:
-    return _activate(payload, request, db, allow_ota_access=True)
+    return _activate_or_429(payload, request, db, allow_ota_access=True)
 
 
 @router.post("/activate-erp", response_model=TokenResponse)
 def activate_erp(payload: ActivateRequest, request: Request, db: Session = Depends(get_db)) -> TokenResponse:
-    return _activate(payload, request, db, allow_ota_access=False)
+    return _activate_or_429(payload, request, db, allow_ota_access=False)
 
 
 @router.post("/refresh", response_model=TokenResponse)
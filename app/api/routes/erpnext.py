@@ -1,10 +1,27 @@
+import json
+import logging
+
+import httpx
 from fastapi import APIRouter, Body, Depends, HTTPException, Query, Request, Response
+from fastapi.responses import StreamingResponse
 from sqlalchemy.orm import Session
 from urllib.parse import quote
 
 from app.api.deps import get_db, get_request_context
+from app.config import get_settings
 from app.services.allowlist import Allowlist, get_allowlist, normalize_doctype, normalize_method
-from app.services.erpnext import ERPNextError, default_fields, request_erpnext
+from app.services.erp_cache import cache_key, get_response_cache
+from app.services.erp_delta import decode_watermark, fetch_delta
+from app.services.erp_export import iter_pages, ndjson_line, resume_filters
+from app.services.erpnext import (
+    ERPNextError,
+    default_fields,
+    iter_raw_body,
+    open_erpnext_stream,
+    request_erpnext,
+)
+
+logger = logging.getLogger(__name__)
 
 router = APIRouter(tags=["erpnext"])
 
@@ -41,8 +58,71 @@ def extract_params(request: Request) -> dict[str, str] | None:
     return dict(request.query_params)
 
 
+async def cached_get(context, doctype: str, path: str, params: dict | None = None) -> Response:
+    """GET through the per-tenant response cache; X-Cache reports HIT, STALE or MISS."""
+
+    async def fetch():
+        return await request_erpnext(
+            context.tenant.erpnext_url,
+            context.tenant.api_key,
+            context.tenant.api_secret,
+            "GET",
+            path,
+            params=params,
+        )
+
+    try:
+        cached, state = await get_response_cache().get_or_fetch(
+            cache_key(context.tenant.id, doctype, path, params), fetch
+        )
+    except ERPNextError as exc:
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+
+    return Response(
+        content=cached.content,
+        status_code=cached.status_code,
+        media_type=cached.media_type,
+        headers={"X-Cache": state},
+    )
+
+
+async def streamed_get(context, request: Request, path: str, params: dict | None = None) -> StreamingResponse:
+    """GET relayed chunk by chunk; the body keeps the upstream content-encoding."""
+    try:
+        upstream = await open_erpnext_stream(
+            context.tenant.erpnext_url,
+            context.tenant.api_key,
+            context.tenant.api_secret,
+            path,
+            params=params,
+            accept_encoding=request.headers.get("accept-encoding"),
+        )
+    except ERPNextError as exc:
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+
+    headers = {
+        name: upstream.headers[name]
+        for name in ("content-encoding", "content-length")
+        if name in upstream.headers
+    }
+    # Let nginx relay chunks as they come instead of spooling the whole body
+    headers["X-Accel-Buffering"] = "no"
+    headers["Vary"] = "Accept-Encoding"
+    return StreamingResponse(
+        iter_raw_body(upstream),
+        status_code=upstream.status_code,
+        media_type=upstream.headers.get("content-type"),
+        headers=headers,
+    )
+
+
+def invalidate_cached(context, doctype: str) -> None:
+    get_response_cache().invalidate(context.tenant.id, doctype)
+
+
 @router.get("/picklists")
-def get_picklists(
+async def get_picklists(
+    request: Request,
     filters: str | None = Query(default=None),
     fields: str | None = Query(default=None),
     allowlist: Allowlist = Depends(get_allowlist_dep),
@@ -58,23 +138,11 @@ def get_picklists(
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Pick List", allowlist)
 
-    try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
-            "GET",
-            "/api/resource/Pick List",
-            params=params,
-        )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    return await streamed_get(context, request, "/api/resource/Pick List", params=params)
 
 
 @router.get("/picklists/{name}")
-def get_picklist(
+async def get_picklist(
     name: str,
     allowlist: Allowlist = Depends(get_allowlist_dep),
     context=Depends(get_request_context),
@@ -83,7 +151,7 @@ def get_picklist(
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Pick List", allowlist)
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -91,13 +159,13 @@ def get_picklist(
             f"/api/resource/Pick List/{safe_name}",
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.put("/picklists/{name}")
-def update_picklist(
+async def update_picklist(
     name: str,
     payload: dict = Body(...),
     allowlist: Allowlist = Depends(get_allowlist_dep),
@@ -107,7 +175,7 @@ def update_picklist(
     ensure_method_allowed("PUT", allowlist)
     get_allowed_doctype("Pick List", allowlist)
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -116,13 +184,15 @@ def update_picklist(
             json_body=payload,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+    finally:
+        invalidate_cached(context, "Pick List")
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.get("/items/by-product-code")
-def get_items_by_product_code(
+async def get_items_by_product_code(
     filters: str = Query(...),
     fields: str | None = Query(default=None),
     allowlist: Allowlist = Depends(get_allowlist_dep),
@@ -135,7 +205,7 @@ def get_items_by_product_code(
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Item", allowlist)
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -144,13 +214,14 @@ def get_items_by_product_code(
             params=params,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.get("/items/all")
-def get_items_all(
+async def get_items_all(
+    request: Request,
     limit_start: int | None = Query(default=None, ge=0),
     limit_page_length: int | None = Query(default=None, ge=1, le=2000),
     fields: str | None = Query(default=None),
@@ -168,23 +239,81 @@ def get_items_all(
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Item", allowlist)
 
+    if limit_page_length is not None and limit_page_length >= get_settings().erp_stream_page_length:
+        # Large pages are relayed as they arrive rather than buffered for the cache
+        return await streamed_get(context, request, "/api/resource/Item", params=params)
+    return await cached_get(context, "Item", "/api/resource/Item", params=params)
+
+
+@router.get("/items/export")
+async def export_items(
+    fields: str | None = Query(default=None),
+    filters: str | None = Query(default=None),
+    cursor: str | None = Query(default=None, max_length=140),
+    page_size: int = Query(default=500, ge=1, le=2000),
+    allowlist: Allowlist = Depends(get_allowlist_dep),
+    context=Depends(get_request_context),
+):
+    """Whole item catalog as NDJSON, one item per line, ordered by name.
+
+    The last line is {"_eof": true, ...} on success or {"_error": ...} if
+    ERPNext failed mid-walk; both carry the cursor to resume from.
+    """
+    field_spec = resolve_fields(fields, ["name", "item_code", "item_name", "custom_product_code"])
+    if '"name"' not in field_spec and '"*"' not in field_spec:
+        raise HTTPException(status_code=400, detail="fields must include name")
     try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
+        filter_list = json.loads(filters) if filters else []
+    except json.JSONDecodeError as exc:
+        raise HTTPException(status_code=400, detail="filters must be a JSON list") from exc
+    if not isinstance(filter_list, list):
+        raise HTTPException(status_code=400, detail="filters must be a JSON list")
+
+    ensure_method_allowed("GET", allowlist)
+    get_allowed_doctype("Item", allowlist)
+
+    tenant = context.tenant
+    base_params = {"fields": field_spec, "order_by": "name asc"}
+
+    async def fetch_page(after: str | None, length: int) -> list[dict]:
+        response = await request_erpnext(
+            tenant.erpnext_url,
+            tenant.api_key,
+            tenant.api_secret,
             "GET",
             "/api/resource/Item",
-            params=params,
+            params={
+                **base_params,
+                "filters": json.dumps(resume_filters(filter_list, after), separators=(",", ":")),
+                "limit_page_length": length,
+            },
         )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+        if response.status_code != 200:
+            raise ERPNextError(f"ERPNext returned {response.status_code}")
+        return response.json().get("data", [])
+
+    async def body():
+        last_name, count = cursor, 0
+        try:
+            async for rows in iter_pages(fetch_page, page_size, after=cursor):
+                yield b"".join(ndjson_line(row) for row in rows)
+                last_name = rows[-1].get("name", last_name)
+                count += len(rows)
+        except (ERPNextError, ValueError) as exc:
+            logger.warning("Item export for tenant %s stopped after %s rows: %s", tenant.id, count, exc)
+            yield ndjson_line({"_error": str(exc), "cursor": last_name, "count": count})
+            return
+        yield ndjson_line({"_eof": True, "cursor": last_name, "count": count})
+
+    return StreamingResponse(
+        body(),
+        media_type="application/x-ndjson",
+        headers={"X-Accel-Buffering": "no", "Cache-Control": "no-store"},
+    )
 
 
 @router.get("/items/{item_code}")
-def get_item(
+async def get_item(
     item_code: str,
     allowlist: Allowlist = Depends(get_allowlist_dep),
     context=Depends(get_request_context),
@@ -192,22 +321,11 @@ def get_item(
     safe_code = quote(item_code, safe="")
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Item", allowlist)
-    try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
-            "GET",
-            f"/api/resource/Item/{safe_code}",
-        )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    return await cached_get(context, "Item", f"/api/resource/Item/{safe_code}")
 
 
 @router.get("/bin")
-def get_bin(
+async def get_bin(
     filters: str = Query(...),
     fields: str | None = Query(default=None),
     allowlist: Allowlist = Depends(get_allowlist_dep),
@@ -229,7 +347,7 @@ def get_bin(
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Bin", allowlist)
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -238,13 +356,14 @@ def get_bin(
             params=params,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.get("/purchase-orders")
-def get_purchase_orders(
+async def get_purchase_orders(
+    request: Request,
     allowlist: Allowlist = Depends(get_allowlist_dep),
     context=Depends(get_request_context),
 ):
@@ -254,23 +373,11 @@ def get_purchase_orders(
     }
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Purchase Order", allowlist)
-    try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
-            "GET",
-            "/api/resource/Purchase Order",
-            params=params,
-        )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    return await streamed_get(context, request, "/api/resource/Purchase Order", params=params)
 
 
 @router.post("/picklists")
-def create_picklist(
+async def create_picklist(
     payload: dict = Body(...),
     allowlist: Allowlist = Depends(get_allowlist_dep),
     context=Depends(get_request_context),
@@ -278,7 +385,7 @@ def create_picklist(
     ensure_method_allowed("POST", allowlist)
     get_allowed_doctype("Pick List", allowlist)
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -287,13 +394,15 @@ def create_picklist(
             json_body=payload,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+    finally:
+        invalidate_cached(context, "Pick List")
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.get("/stock-settings")
-def get_stock_settings(
+async def get_stock_settings(
     fields: str | None = Query(default=None),
     allowlist: Allowlist = Depends(get_allowlist_dep),
     context=Depends(get_request_context),
@@ -301,23 +410,11 @@ def get_stock_settings(
     params = {"fields": resolve_fields(fields, ["default_warehouse"])}
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Stock Settings", allowlist)
-    try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
-            "GET",
-            "/api/resource/Stock Settings/Stock Settings",
-            params=params,
-        )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    return await cached_get(context, "Stock Settings", "/api/resource/Stock Settings/Stock Settings", params=params)
 
 
 @router.get("/warehouses")
-def get_warehouses(
+async def get_warehouses(
     limit_page_length: int | None = Query(default=None, ge=1, le=2000),
     fields: str | None = Query(default=None),
     allowlist: Allowlist = Depends(get_allowlist_dep),
@@ -328,23 +425,11 @@ def get_warehouses(
         params["limit_page_length"] = limit_page_length
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Warehouse", allowlist)
-    try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
-            "GET",
-            "/api/resource/Warehouse",
-            params=params,
-        )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
-
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    return await cached_get(context, "Warehouse", "/api/resource/Warehouse", params=params)
 
 
 @router.get("/customers")
-def get_customers(
+async def get_customers(
     limit_start: int | None = Query(default=None, ge=0),
     limit_page_length: int | None = Query(default=None, ge=1, le=2000),
     fields: str | None = Query(default=None),
@@ -358,23 +443,76 @@ def get_customers(
         params["limit_page_length"] = limit_page_length
     ensure_method_allowed("GET", allowlist)
     get_allowed_doctype("Customer", allowlist)
+    return await cached_get(context, "Customer", "/api/resource/Customer", params=params)
+
+
+@router.get("/sync/{doctype}")
+async def sync_doctype(
+    doctype: str,
+    since: str | None = Query(default=None, max_length=512),
+    fields: str | None = Query(default=None),
+    limit: int = Query(default=500, ge=1, le=2000),
+    allowlist: Allowlist = Depends(get_allowlist_dep),
+    context=Depends(get_request_context),
+):
+    """Rows of an allowlisted doctype changed or deleted after the `since` watermark.
+
+    Returns {"upserts", "deletes", "watermark", "has_more"}; call again with
+    the returned watermark until has_more is false. Without `since` the
+    response is a full listing, served from the per-tenant cache when fresh.
+    Deletions are read from ERPNext's Deleted Document, which the tenant's
+    API key must be able to list.
+    """
+    ensure_method_allowed("GET", allowlist)
+    allowed_doctype = get_allowed_doctype(doctype, allowlist)
     try:
-        response = request_erpnext(
-            context.tenant.erpnext_url,
-            context.tenant.api_key,
-            context.tenant.api_secret,
+        mark = decode_watermark(since)
+        field_list = json.loads(fields) if fields else ["name", "modified"]
+    except ValueError as exc:
+        raise HTTPException(status_code=400, detail="Invalid watermark or fields") from exc
+    if not isinstance(field_list, list):
+        raise HTTPException(status_code=400, detail="fields must be a JSON list")
+    if "*" not in field_list:
+        field_list += [name for name in ("name", "modified") if name not in field_list]
+
+    tenant = context.tenant
+
+    async def fetch(target_doctype: str, params: dict) -> list[dict]:
+        response = await request_erpnext(
+            tenant.erpnext_url,
+            tenant.api_key,
+            tenant.api_secret,
             "GET",
-            "/api/resource/Customer",
+            f"/api/resource/{quote(target_doctype, safe='')}",
             params=params,
         )
-    except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        if response.status_code != 200:
+            raise ERPNextError(f"ERPNext returned {response.status_code} for {target_doctype}")
+        return response.json().get("data", [])
+
+    async def compute() -> httpx.Response:
+        delta = await fetch_delta(fetch, allowed_doctype, field_list, mark, limit)
+        return httpx.Response(
+            200,
+            content=json.dumps(delta, separators=(",", ":")).encode("utf-8"),
+            headers={"content-type": "application/json"},
+        )
 
-    return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
+    try:
+        if since:
+            response = await compute()
+            return Response(content=response.content, media_type="application/json")
+        key = cache_key(tenant.id, allowed_doctype, "/sync", {"fields": field_list, "limit": limit})
+        cached, state = await get_response_cache().get_or_fetch(key, compute)
+    except ERPNextError as exc:
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+    except ValueError as exc:
+        raise HTTPException(status_code=502, detail="Invalid ERPNext response") from exc
+    return Response(content=cached.content, media_type=cached.media_type, headers={"X-Cache": state})
 
 
 @router.api_route("/resource/{doctype}", methods=["GET", "POST"])
-def proxy_resource_collection(
+async def proxy_resource_collection(
     doctype: str,
     request: Request,
     payload: dict | None = Body(default=None),
@@ -385,9 +523,11 @@ def proxy_resource_collection(
     allowed_doctype = get_allowed_doctype(doctype, allowlist)
     safe_doctype = quote(allowed_doctype, safe="")
     params = extract_params(request)
+    if method == "GET":
+        return await streamed_get(context, request, f"/api/resource/{safe_doctype}", params=params)
     json_body = payload if method in {"POST", "PUT", "PATCH"} else None
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -397,13 +537,15 @@ def proxy_resource_collection(
             json_body=json_body,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+    finally:
+        invalidate_cached(context, allowed_doctype)
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
 
 
 @router.api_route("/resource/{doctype}/{name}", methods=["GET", "PUT", "PATCH", "DELETE"])
-def proxy_resource_item(
+async def proxy_resource_item(
     doctype: str,
     name: str,
     request: Request,
@@ -416,9 +558,11 @@ def proxy_resource_item(
     safe_doctype = quote(allowed_doctype, safe="")
     safe_name = quote(name, safe="")
     params = extract_params(request)
+    if method == "GET":
+        return await streamed_get(context, request, f"/api/resource/{safe_doctype}/{safe_name}", params=params)
     json_body = payload if method in {"POST", "PUT", "PATCH"} else None
     try:
-        response = request_erpnext(
+        response = await request_erpnext(
             context.tenant.erpnext_url,
             context.tenant.api_key,
             context.tenant.api_secret,
@@ -428,6 +572,8 @@ def proxy_resource_item(
             json_body=json_body,
         )
     except ERPNextError as exc:
-        raise HTTPException(status_code=502, detail=str(exc)) from exc
+        raise HTTPException(status_code=exc.status_code, detail=str(exc)) from exc
+    finally:
+        invalidate_cached(context, allowed_doctype)
 
     return Response(content=response.content, status_code=response.status_code, media_type=response.headers.get("content-type"))
@@ -2,27 +2,40 @@
 import hashlib
 import hmac
 import logging
+import random
 import time
+from urllib.parse import quote
 
-from fastapi import APIRouter, Depends, HTTPException, status, File, UploadFile
-from fastapi.responses import FileResponse
+from fastapi import APIRouter, BackgroundTasks, Depends, Header, HTTPException, Query, status, File, UploadFile
+from fastapi.responses import FileResponse, Response, StreamingResponse
+from sqlalchemy.ext.asyncio import AsyncSession
 from sqlalchemy.orm import Session
 
 from app.config import get_settings
-from app.api.deps import get_db, get_request_context, require_admin, RequestContext
-from app.models.firmware import Firmware
+from app.api.deps import get_async_db, get_db, get_request_context, require_admin, RequestContext
+from app.models.firmware import DeviceOTALog, Firmware, FirmwarePatch
 from app.schemas.ota import (
     FirmwareCreate,
     FirmwareResponse,
     FirmwareDetailResponse,
+    FirmwareRolloutStatsResponse,
     FirmwareUpdate,
     OTACheckRequest,
     OTACheckResponse,
+    OTAStatusBatch,
+    OTAStatusEvent,
     OTAStatusUpdate,
     OTALogResponse,
 )
+from app.services.firmware_store import app_desc_metadata, lock_objects, object_hash
+from app.services.metrics import firmware_bytes_served
 from app.services.ota import OTAService
 from app.services.ota_binary import parse_esp_app_desc_version
+from app.services.ota_compress import compress_firmware_task
+from app.services.ota_delta import generate_patches_task
+from app.services.ota_index import firmware_index
+from app.services.ota_progress import progress_buffer
+from app.services.pagination import MAX_PAGE_SIZE, keyset_page, page_from
 
 router = APIRouter(prefix="/ota", tags=["ota"])
 ota_service = OTAService(firmware_base_path="firmware")
@@ -30,6 +43,9 @@ settings = get_settings()
 
 logger = logging.getLogger(__name__)
 
+# Store objects never change under their path (see app.services.firmware_store)
+IMMUTABLE_CACHE_CONTROL = "public, max-age=31536000, immutable"
+
 
 # ============================================================================
 # Device-facing OTA endpoints (device JWT required; download protected via signed URL)
@@ -39,12 +55,18 @@ logger = logging.getLogger(__name__)
 @router.post("/check", response_model=OTACheckResponse)
 async def check_firmware_update(
     request: OTACheckRequest,
+    http_response: Response,
+    if_none_match: str | None = Header(default=None, alias="If-None-Match"),
     context: RequestContext = Depends(get_request_context),
     db: Session = Depends(get_db),
-) -> OTACheckResponse:
+):
     """Check if firmware update is available for a device.
     
     This endpoint is called by ESP32 devices to check for available updates.
+    A device that got "no update" may send the returned ETag back in
+    If-None-Match and gets an empty 304 while nothing changed. Both replies
+    carry X-Next-Check-After, the jittered delay before the next check; it is
+    shorter when a staged rollout has no free download slot for the device.
     """
     try:
         if not context.token.device_id:
@@ -58,9 +80,36 @@ async def check_firmware_update(
                 detail="Device mismatch",
             )
         response = ota_service.check_update_available(db, request)
+        etag = ota_service.check_etag(db, request)
+        # Throttled devices come back soon, when download slots may have freed up
+        next_check_after = _next_check_after(
+            settings.ota_rollout_retry_seconds if response.throttled else None
+        )
+        headers = {
+            "ETag": etag,
+            "X-Next-Check-After": str(next_check_after),
+            "Cache-Control": "no-cache",
+        }
+        # Only "no update" answers are cacheable: update answers carry
+        # freshly signed, expiring download URLs.
+        if not response.update_available and _etag_matches(if_none_match, etag):
+            return Response(status_code=status.HTTP_304_NOT_MODIFIED, headers=headers)
+
+        http_response.headers.update(headers)
+        response.next_check_after = next_check_after
         if response.update_available and response.firmware_id:
             response.download_url = _build_download_url(request.device_id, response.firmware_id)
+            if response.patch_from_firmware_id:
+                response.patch_url = _build_download_url(
+                    request.device_id, response.firmware_id, response.patch_from_firmware_id
+                )
+            if response.compressed_url:
+                response.compressed_url = _build_download_url(
+                    request.device_id, response.firmware_id, compressed=True
+                )
         return response
+    except HTTPException:
+        raise
     except Exception as e:
         logger.error(f"Error checking firmware update: {e}")
         raise HTTPException(
@@ -75,70 +124,134 @@ async def download_firmware(
     device_id: int | None = None,
     expires: int | None = None,
     sig: str | None = None,
+    range_header: str | None = Header(default=None, alias="Range"),
+    if_range: str | None = Header(default=None, alias="If-Range"),
     context: RequestContext = Depends(get_request_context),
     db: Session = Depends(get_db),
-) -> FileResponse:
+) -> Response:
     """Download firmware binary.
     
     Device downloads the binary file for flashing.
-    Returns the .bin file with proper headers for OTA.
+    Returns the .bin file with proper headers for OTA. When
+    OTA_ACCEL_REDIRECT_PREFIX is set, only the checks run here and nginx
+    serves the file from its internal location.
+
+    Supports a single `Range: bytes=start-[end]` so devices can resume an
+    interrupted download; `If-Range` is compared against the ETag (file_hash).
     """
-    if not context.token.device_id:
-        raise HTTPException(
-            status_code=status.HTTP_403_FORBIDDEN,
-            detail="Device token required",
-        )
-    if device_id is not None and str(device_id) != str(context.token.device_id):
+    _verify_download_request(context, firmware_id, device_id, expires, sig)
+
+    firmware = ota_service.get_firmware_for_download(db, firmware_id)
+    if not firmware:
         raise HTTPException(
-            status_code=status.HTTP_403_FORBIDDEN,
-            detail="Device mismatch",
+            status_code=status.HTTP_404_NOT_FOUND,
+            detail="Firmware not found or inactive",
         )
 
-    if settings.ota_download_secret:
-        if device_id is None or expires is None or sig is None:
-            raise HTTPException(
-                status_code=status.HTTP_403_FORBIDDEN,
-                detail="Missing download signature",
-            )
-        now = int(time.time())
-        if expires < now:
-            raise HTTPException(
-                status_code=status.HTTP_403_FORBIDDEN,
-                detail="Download link expired",
-            )
-        expected_sig = _download_signature(device_id, firmware_id, expires)
-        if not hmac.compare_digest(expected_sig, sig):
-            raise HTTPException(
-                status_code=status.HTTP_403_FORBIDDEN,
-                detail="Invalid download signature",
-            )
+    return _serve_firmware_file(
+        firmware.binary_path,
+        firmware.filename,
+        firmware.file_hash,
+        _firmware_headers(firmware),
+        range_header,
+        if_range,
+        "full",
+    )
+
+
+@router.get("/download/{firmware_id}/compressed")
+async def download_firmware_compressed(
+    firmware_id: int,
+    device_id: int | None = None,
+    expires: int | None = None,
+    sig: str | None = None,
+    range_header: str | None = Header(default=None, alias="Range"),
+    if_range: str | None = Header(default=None, alias="If-Range"),
+    context: RequestContext = Depends(get_request_context),
+    db: Session = Depends(get_db),
+) -> Response:
+    """Download the compressed variant of a firmware binary.
+
+    The device inflates it while writing the inactive partition and checks
+    the result against file_hash. Signed with the same URL signature as the
+    full image, since both carry the same firmware.
+    """
+    _verify_download_request(context, firmware_id, device_id, expires, sig)
 
     firmware = ota_service.get_firmware_for_download(db, firmware_id)
-    if not firmware:
+    if not firmware or not firmware.compressed_path:
         raise HTTPException(
             status_code=status.HTTP_404_NOT_FOUND,
-            detail="Firmware not found or inactive",
+            detail="Compressed firmware not found",
         )
 
-    binary_path = ota_service.get_firmware_binary_path(firmware)
-    if not binary_path.exists():
-        logger.error(f"Firmware file not found: {binary_path}")
+    filename = f"{firmware.filename}.hs"
+    headers = _firmware_headers(firmware)
+    headers["Content-Disposition"] = f"attachment; filename={filename}"
+    headers["ETag"] = f'"{firmware.compressed_hash}"'
+    headers["X-Compressed-Hash"] = firmware.compressed_hash
+    headers["X-Firmware-Compression"] = firmware.compression
+    return _serve_firmware_file(
+        firmware.compressed_path,
+        filename,
+        firmware.compressed_hash,
+        headers,
+        range_header,
+        if_range,
+        "compressed",
+    )
+
+
+@router.get("/download/{firmware_id}/patch/{source_firmware_id}")
+async def download_firmware_patch(
+    firmware_id: int,
+    source_firmware_id: int,
+    device_id: int | None = None,
+    expires: int | None = None,
+    sig: str | None = None,
+    range_header: str | None = Header(default=None, alias="Range"),
+    if_range: str | None = Header(default=None, alias="If-Range"),
+    context: RequestContext = Depends(get_request_context),
+    db: Session = Depends(get_db),
+) -> Response:
+    """Download a delta patch from source_firmware_id to firmware_id.
+
+    The device applies it against its running partition while writing the
+    inactive one. Same auth, signature and Range handling as the full image.
+    """
+    _verify_download_request(context, firmware_id, device_id, expires, sig, source_firmware_id)
+
+    firmware = ota_service.get_firmware_for_download(db, firmware_id)
+    patch = (
+        db.query(FirmwarePatch)
+        .filter(
+            FirmwarePatch.firmware_id == firmware_id,
+            FirmwarePatch.source_firmware_id == source_firmware_id,
+        )
+        .first()
+        if firmware
+        else None
+    )
+    if not patch:
         raise HTTPException(
             status_code=status.HTTP_404_NOT_FOUND,
-            detail="Firmware file not found on server",
+            detail="Patch not found",
         )
 
-    return FileResponse(
-        path=binary_path,
-        filename=firmware.filename,
-        media_type="application/octet-stream",
-        headers={
-            "Content-Disposition": f"attachment; filename={firmware.filename}",
-            "X-Firmware-Version": firmware.version,
-            "X-Firmware-Build": str(firmware.build_number),
-            "X-Firmware-Hash": firmware.file_hash,
-            "Cache-Control": "public, max-age=3600",
-        },
+    filename = f"{firmware.filename}.from_{source_firmware_id}.patch"
+    headers = _firmware_headers(firmware)
+    headers["Content-Disposition"] = f"attachment; filename={filename}"
+    headers["ETag"] = f'"{patch.patch_hash}"'
+    headers["X-Patch-Hash"] = patch.patch_hash
+    headers["X-Patch-Compression"] = patch.compression
+    return _serve_firmware_file(
+        patch.patch_path,
+        filename,
+        patch.patch_hash,
+        headers,
+        range_header,
+        if_range,
+        "patch",
     )
 
 
@@ -146,7 +259,7 @@ async def download_firmware(
 async def update_ota_status(
     status_update: OTAStatusUpdate,
     context: RequestContext = Depends(get_request_context),
-    db: Session = Depends(get_db),
+    db: AsyncSession = Depends(get_async_db),
 ) -> dict:
     """Device reports OTA operation status.
     
@@ -164,31 +277,26 @@ async def update_ota_status(
                 status_code=status.HTTP_403_FORBIDDEN,
                 detail="Device mismatch",
             )
-        # Find existing log or create new one
-        from app.models.firmware import DeviceOTALog
-
-        log = (
-            db.query(DeviceOTALog)
-            .filter(
-                DeviceOTALog.device_id == status_update.device_id,
-                DeviceOTALog.firmware_id == status_update.firmware_id,
-            )
-            .order_by(DeviceOTALog.created_at.desc())
-            .first()
+        log_ids = await ota_service.record_status_events_async(
+            db,
+            status_update.device_id,
+            [
+                OTAStatusEvent(
+                    firmware_id=status_update.firmware_id,
+                    status=status_update.status,
+                    bytes_downloaded=status_update.bytes_downloaded,
+                    error_message=status_update.error_message,
+                )
+            ],
         )
 
-        if not log:
-            log = ota_service.create_ota_log(
-                db, status_update.device_id, status_update.firmware_id
-            )
-
-        ota_service.update_ota_status(db, log.id, status_update)
-
         return {
             "success": True,
-            "log_id": log.id,
+            "log_id": log_ids[status_update.firmware_id],
             "status": status_update.status,
         }
+    except HTTPException:
+        raise
     except Exception as e:
         logger.error(f"Error updating OTA status: {e}")
         raise HTTPException(
@@ -197,6 +305,49 @@ async def update_ota_status(
         )
 
 
+@router.post("/status/batch")
+async def update_ota_status_batch(
+    batch: OTAStatusBatch,
+    context: RequestContext = Depends(get_request_context),
+    db: AsyncSession = Depends(get_async_db),
+) -> dict:
+    """Device reports several OTA status events in one request.
+
+    Lets the device coalesce intermediate "downloading" progress and send it
+    together with the next state change over one connection.
+    """
+    try:
+        if not context.token.device_id:
+            raise HTTPException(
+                status_code=status.HTTP_403_FORBIDDEN,
+                detail="Device token required",
+            )
+        if str(batch.device_id) != str(context.token.device_id):
+            raise HTTPException(
+                status_code=status.HTTP_403_FORBIDDEN,
+                detail="Device mismatch",
+            )
+        log_ids = await ota_service.record_status_events_async(db, batch.device_id, batch.events)
+        last_status = {event.firmware_id: event.status for event in batch.events}
+
+        return {
+            "success": True,
+            "accepted": len(batch.events),
+            "logs": [
+                {"firmware_id": firmware_id, "log_id": log_id, "status": last_status[firmware_id]}
+                for firmware_id, log_id in log_ids.items()
+            ],
+        }
+    except HTTPException:
+        raise
+    except Exception as e:
+        logger.error(f"Error updating OTA status batch: {e}")
+        raise HTTPException(
+            status_code=status.HTTP_500_INTERNAL_SERVER_ERROR,
+            detail="Error updating status",
+        )
+
+
 # ============================================================================
 # Admin endpoints for managing firmware (require authentication)
 # ============================================================================
@@ -209,14 +360,18 @@ async def update_ota_status(
 )
 async def create_firmware(
     firmware_create: FirmwareCreate,
+    background_tasks: BackgroundTasks,
     db: Session = Depends(get_db),
 ) -> FirmwareDetailResponse:
     """Create a new firmware record (admin only).
     
     This registers a new firmware version in the database.
     The binary file should be uploaded separately or pre-placed on disk.
+    Delta patches from the most common installed builds and a compressed
+    variant of the image are generated in the background.
     """
-    # Verify binary file exists
+    # Verify binary file exists; the object lock keeps it until the row is committed
+    lock_objects(db, [firmware_create.binary_path])
     binary_path = ota_service.firmware_path / firmware_create.binary_path.lstrip("/")
     if not binary_path.exists():
         raise HTTPException(
@@ -259,8 +414,17 @@ async def create_firmware(
             detail="Firmware version already exists",
         )
 
-    # Verify file hash
-    calculated_hash = ota_service.calculate_file_hash(binary_path)
+    # Verify file hash; store objects were hashed at ingest
+    calculated_hash = ota_service.store.verified_hash(firmware_create.binary_path)
+    if calculated_hash is None:
+        try:
+            calculated_hash = ota_service.calculate_file_hash(binary_path)
+        except FileNotFoundError:
+            # Paths outside the object store are not covered by the lock
+            raise HTTPException(
+                status_code=status.HTTP_400_BAD_REQUEST,
+                detail="Binary file not found on server",
+            )
     if calculated_hash.lower() != firmware_create.file_hash.lower():
         raise HTTPException(
             status_code=status.HTTP_400_BAD_REQUEST,
@@ -284,11 +448,15 @@ async def create_firmware(
     db.add(firmware)
     db.commit()
     db.refresh(firmware)
+    firmware_index.invalidate()
 
     logger.info(
         f"Created firmware {firmware.device_type} v{firmware.version} "
         f"(build {firmware.build_number})"
     )
+    background_tasks.add_task(generate_patches_task, firmware.id, str(ota_service.firmware_path))
+    if settings.ota_compress_firmware:
+        background_tasks.add_task(compress_firmware_task, firmware.id, str(ota_service.firmware_path))
 
     return FirmwareDetailResponse.from_orm(firmware)
 
@@ -302,22 +470,19 @@ async def upload_firmware_binary(
 ) -> dict:
     """Upload a firmware binary file.
     
-    Stores the binary file on disk and returns path and hash.
+    Streams the binary to disk in chunks (hashing on the fly) and returns path and hash.
     Must be called before creating firmware record.
     """
-    try:
-        if not device_type:
-            raise HTTPException(
-                status_code=status.HTTP_400_BAD_REQUEST,
-                detail="device_type is required",
-            )
-
-        # Create device-specific directory
-        device_dir = ota_service.firmware_path / device_type
-        device_dir.mkdir(parents=True, exist_ok=True)
+    if not device_type:
+        raise HTTPException(
+            status_code=status.HTTP_400_BAD_REQUEST,
+            detail="device_type is required",
+        )
 
-        content = await file.read()
-        parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(content)
+    staged = None
+    try:
+        staged = await ota_service.stage_upload(file)
+        parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(staged.header)
         if parsed_version:
             if version and version != parsed_version:
                 raise HTTPException(
@@ -331,39 +496,36 @@ async def upload_firmware_binary(
                 detail="Unable to parse version from firmware and no version provided",
             )
 
-        # Save file
-        if parsed_build:
-            file_path = device_dir / f"v{version}_b{parsed_build}.bin"
-        else:
-            file_path = device_dir / f"v{version}.bin"
-
-        with open(file_path, "wb") as f:
-            f.write(content)
-
-        # Calculate hash
-        file_hash = ota_service.calculate_file_hash(file_path)
+        # Stored by content hash; identical binaries share one object
+        binary_path = ota_service.commit_upload(
+            staged, app_desc_metadata(parsed_version, parsed_build, raw_version)
+        )
 
         response = {
             "success": True,
             "filename": file.filename,
             "device_type": device_type,
             "version": version,
-            "binary_path": f"{device_type}/v{version}.bin",
-            "file_size": len(content),
-            "file_hash": file_hash,
+            "binary_path": binary_path,
+            "file_size": staged.file_size,
+            "file_hash": staged.file_hash,
         }
         if parsed_build:
             response["build_number"] = parsed_build
-            response["binary_path"] = f"{device_type}/v{version}_b{parsed_build}.bin"
         if raw_version:
             response["raw_version"] = raw_version
         return response
+    except HTTPException:
+        raise
     except Exception as e:
         logger.error(f"Error uploading firmware: {e}")
         raise HTTPException(
             status_code=status.HTTP_500_INTERNAL_SERVER_ERROR,
             detail="Error uploading firmware",
         )
+    finally:
+        if staged is not None:
+            ota_service.discard_upload(staged)
 
 
 @router.get(
@@ -434,6 +596,7 @@ async def update_firmware(
 
     db.commit()
     db.refresh(firmware)
+    firmware_index.invalidate()
 
     return FirmwareDetailResponse.from_orm(firmware)
 
@@ -453,26 +616,52 @@ async def delete_firmware(
 
     firmware.is_active = False
     db.commit()
+    firmware_index.invalidate()
 
     return {"success": True, "message": "Firmware deactivated"}
 
 
+@router.get(
+    "/admin/firmware/{firmware_id}/stats",
+    response_model=FirmwareRolloutStatsResponse,
+    dependencies=[Depends(require_admin)],
+)
+async def get_firmware_stats(
+    firmware_id: int,
+    db: Session = Depends(get_db),
+) -> FirmwareRolloutStatsResponse:
+    """OTA log counts per status for a firmware (rollout progress)."""
+    if not db.query(Firmware.id).filter(Firmware.id == firmware_id).first():
+        raise HTTPException(
+            status_code=status.HTTP_404_NOT_FOUND,
+            detail="Firmware not found",
+        )
+    counts = ota_service.get_rollout_stats(db, [firmware_id]).get(firmware_id, {})
+    return FirmwareRolloutStatsResponse(firmware_id=firmware_id, counts=counts, total=sum(counts.values()))
+
+
 @router.get(
     "/admin/logs",
     response_model=list[OTALogResponse],
     dependencies=[Depends(require_admin)],
 )
 async def get_ota_logs(
+    http_response: Response,
     device_id: int = None,
     firmware_id: int = None,
     status: str = None,
+    cursor: str | None = None,
     skip: int = 0,
-    limit: int = 100,
+    limit: int = Query(default=100, ge=1, le=MAX_PAGE_SIZE),
     db: Session = Depends(get_db),
 ) -> list[OTALogResponse]:
-    """Get OTA operation logs."""
-    from app.models.firmware import DeviceOTALog
+    """Get OTA operation logs, newest first.
 
+    Paginate with `cursor`: pass the X-Next-Cursor header of the previous
+    page; it is absent on the last page. Each page is one index range scan
+    on (created_at, id). `skip` is kept for old clients and costs more the
+    deeper the page.
+    """
     query = db.query(DeviceOTALog)
 
     if device_id:
@@ -482,21 +671,236 @@ async def get_ota_logs(
     if status:
         query = query.filter(DeviceOTALog.status == status)
 
-    logs = query.order_by(DeviceOTALog.created_at.desc()).offset(skip).limit(limit).all()
+    if skip and not cursor:
+        rows = (
+            query.order_by(DeviceOTALog.created_at.desc(), DeviceOTALog.id.desc())
+            .offset(skip)
+            .limit(limit + 1)
+            .all()
+        )
+        logs, next_cursor = page_from(rows, limit, lambda log: (log.created_at, log.id))
+    else:
+        try:
+            logs, next_cursor = keyset_page(query, DeviceOTALog.created_at, DeviceOTALog.id, cursor, limit)
+        except ValueError:
+            raise HTTPException(status_code=400, detail="Invalid cursor")
+    if next_cursor:
+        http_response.headers["X-Next-Cursor"] = next_cursor
+
+    responses = []
+    for log in logs:
+        response = OTALogResponse.from_orm(log)
+        live_bytes = progress_buffer.live_bytes(log.id)
+        if live_bytes is not None:
+            response.bytes_downloaded = live_bytes
+        responses.append(response)
+    return responses
+def _firmware_headers(firmware: Firmware) -> dict[str, str]:
+    return {
+        "Content-Disposition": f"attachment; filename={firmware.filename}",
+        "X-Firmware-Version": firmware.version,
+        "X-Firmware-Build": str(firmware.build_number),
+        "X-Firmware-Hash": firmware.file_hash,
+        "ETag": f'"{firmware.file_hash}"',
+        "Accept-Ranges": "bytes",
+        "Cache-Control": "public, max-age=3600",
+    }
+
+
+def _verify_download_request(
+    context: RequestContext,
+    firmware_id: int,
+    device_id: int | None,
+    expires: int | None,
+    sig: str | None,
+    source_firmware_id: int | None = None,
+) -> None:
+    if not context.token.device_id:
+        raise HTTPException(
+            status_code=status.HTTP_403_FORBIDDEN,
+            detail="Device token required",
+        )
+    if device_id is not None and str(device_id) != str(context.token.device_id):
+        raise HTTPException(
+            status_code=status.HTTP_403_FORBIDDEN,
+            detail="Device mismatch",
+        )
+
+    if settings.ota_download_secret:
+        if device_id is None or expires is None or sig is None:
+            raise HTTPException(
+                status_code=status.HTTP_403_FORBIDDEN,
+                detail="Missing download signature",
+            )
+        now = int(time.time())
+        if expires < now:
+            raise HTTPException(
+                status_code=status.HTTP_403_FORBIDDEN,
+                detail="Download link expired",
+            )
+        expected_sig = _download_signature(device_id, firmware_id, expires, source_firmware_id)
+        if not hmac.compare_digest(expected_sig, sig):
+            raise HTTPException(
+                status_code=status.HTTP_403_FORBIDDEN,
+                detail="Invalid download signature",
+            )
+
+
+def _serve_firmware_file(
+    relative_path: str,
+    filename: str,
+    etag_hash: str,
+    headers: dict[str, str],
+    range_header: str | None,
+    if_range: str | None,
+    kind: str,
+) -> Response:
+    file_path = ota_service.firmware_path / relative_path.lstrip("/")
+    if not file_path.exists():
+        logger.error(f"Firmware file not found: {file_path}")
+        raise HTTPException(
+            status_code=status.HTTP_404_NOT_FOUND,
+            detail="Firmware file not found on server",
+        )
+    if object_hash(relative_path) == etag_hash.lower():
+        # The path names these exact bytes, so caches may keep them for good
+        headers["Cache-Control"] = IMMUTABLE_CACHE_CONTROL
+
+    file_size = file_path.stat().st_size
+    byte_range = None
+    if range_header and _if_range_matches(if_range, etag_hash):
+        byte_range = _parse_byte_range(range_header, file_size)
+
+    if settings.ota_accel_redirect_prefix:
+        # Hand the transfer to nginx (sendfile) instead of streaming through the worker;
+        # nginx honours the same Range, so count only the bytes it will send
+        prefix = settings.ota_accel_redirect_prefix.rstrip("/")
+        headers["X-Accel-Redirect"] = f"{prefix}/{quote(relative_path.lstrip('/'))}"
+        served = byte_range[1] - byte_range[0] + 1 if byte_range else file_size
+        firmware_bytes_served.inc(kind, amount=served)
+        return Response(status_code=status.HTTP_200_OK, media_type="application/octet-stream", headers=headers)
+
+    if byte_range:
+        start, end = byte_range
+        headers["Content-Range"] = f"bytes {start}-{end}/{file_size}"
+        headers["Content-Length"] = str(end - start + 1)
+        firmware_bytes_served.inc(kind, amount=end - start + 1)
+        return StreamingResponse(
+            _iter_file_range(file_path, start, end),
+            status_code=status.HTTP_206_PARTIAL_CONTENT,
+            media_type="application/octet-stream",
+            headers=headers,
+        )
+
+    firmware_bytes_served.inc(kind, amount=file_size)
+    return FileResponse(
+        path=file_path,
+        filename=filename,
+        media_type="application/octet-stream",
+        headers=headers,
+    )
+
+
+def _etag_matches(if_none_match: str | None, etag: str) -> bool:
+    if not if_none_match:
+        return False
+    candidates = [tag.strip() for tag in if_none_match.split(",")]
+    return etag in candidates or f"W/{etag}" in candidates
+
+
+def _next_check_after(interval: int | None = None) -> int:
+    """Poll interval with random jitter, so the fleet does not wake in sync."""
+    interval = interval or settings.ota_check_interval_seconds
+    jitter = interval * settings.ota_check_jitter_ratio
+    return max(60, int(interval + random.uniform(-jitter, jitter)))
+
+
+def _if_range_matches(if_range: str | None, file_hash: str) -> bool:
+    """Range applies only if If-Range is absent or names the current ETag."""
+    if not if_range:
+        return True
+    tag = if_range.strip()
+    if tag.startswith("W/"):
+        return False
+    return tag.strip('"').lower() == file_hash.lower()
+
+
+def _parse_byte_range(range_header: str, file_size: int) -> tuple[int, int] | None:
+    """Parse a single byte range into inclusive (start, end).
+
+    Returns None when the header should be ignored (not bytes, multiple ranges,
+    malformed) so the full file is served; raises 416 when unsatisfiable.
+    """
+    unit, _, spec = range_header.partition("=")
+    if unit.strip().lower() != "bytes" or "," in spec:
+        return None
+    start_raw, sep, end_raw = spec.strip().partition("-")
+    if not sep:
+        return None
+    try:
+        if start_raw:
+            start = int(start_raw)
+            end = int(end_raw) if end_raw else file_size - 1
+        else:
+            suffix = int(end_raw)
+            if suffix <= 0:
+                return None
+            start = max(file_size - suffix, 0)
+            end = file_size - 1
+    except ValueError:
+        return None
+    if start < 0 or end < start:
+        return None
+    if start >= file_size:
+        raise HTTPException(
+            status_code=status.HTTP_416_REQUESTED_RANGE_NOT_SATISFIABLE,
+            detail="Range not satisfiable",
+            headers={"Content-Range": f"bytes */{file_size}"},
+        )
+    return start, min(end, file_size - 1)
+
+
+def _iter_file_range(path, start: int, end: int, chunk_size: int = 64 * 1024):
+    with open(path, "rb") as f:
+        f.seek(start)
+        remaining = end - start + 1
+        while remaining > 0:
+            chunk = f.read(min(chunk_size, remaining))
+            if not chunk:
+                break
+            remaining -= len(chunk)
+            yield chunk
+
 
-    return [OTALogResponse.from_orm(log) for log in logs]
 # Signed download URL helpers
-def _download_signature(device_id: int, firmware_id: int, expires: int) -> str:
+def _download_signature(
+    device_id: int,
+    firmware_id: int,
+    expires: int,
+    source_firmware_id: int | None = None,
+) -> str:
     secret = settings.ota_download_secret
     if not secret:
         return ""
-    payload = f"{firmware_id}:{device_id}:{expires}".encode("utf-8")
-    return hmac.new(secret.encode("utf-8"), payload, hashlib.sha256).hexdigest()
+    payload = f"{firmware_id}:{device_id}:{expires}"
+    if source_firmware_id is not None:
+        payload = f"patch:{source_firmware_id}:{payload}"
+    return hmac.new(secret.encode("utf-8"), payload.encode("utf-8"), hashlib.sha256).hexdigest()
 
 
-def _build_download_url(device_id: int, firmware_id: int) -> str:
+def _build_download_url(
+    device_id: int,
+    firmware_id: int,
+    source_firmware_id: int | None = None,
+    compressed: bool = False,
+) -> str:
+    path = f"/api/ota/download/{firmware_id}"
+    if source_firmware_id is not None:
+        path = f"{path}/patch/{source_firmware_id}"
+    elif compressed:
+        path = f"{path}/compressed"
     if not settings.ota_download_secret:
-        return f"/api/ota/download/{firmware_id}"
+        return path
     expires = int(time.time()) + settings.ota_download_ttl_seconds
-    sig = _download_signature(device_id, firmware_id, expires)
-    return f"/api/ota/download/{firmware_id}?device_id={device_id}&expires={expires}&sig={sig}"
+    sig = _download_signature(device_id, firmware_id, expires, source_firmware_id)
+    return f"{path}?device_id={device_id}&expires={expires}&sig={sig}"
@@ -40,8 +40,27 @@ class Settings(BaseSettings):
 
     app_name: str = Field(default="KadimaSoft License Server", alias="APP_NAME")
     database_url: str = Field(alias="DATABASE_URL")
-    jwt_secret: str = Field(alias="JWT_SECRET")
+    # Defaults to DATABASE_URL with the asyncpg driver
+    database_async_url: str | None = Field(default=None, alias="DATABASE_ASYNC_URL")
+    db_pool_size: int = Field(default=10, alias="DB_POOL_SIZE")
+    db_max_overflow: int = Field(default=20, alias="DB_MAX_OVERFLOW")
+    # Pool of the asyncpg engine, on top of the sync pool above
+    db_async_pool_size: int = Field(default=5, alias="DB_ASYNC_POOL_SIZE")
+    db_async_max_overflow: int = Field(default=5, alias="DB_ASYNC_MAX_OVERFLOW")
+    db_pool_timeout_seconds: float = Field(default=10.0, alias="DB_POOL_TIMEOUT_SECONDS")
+    db_pool_recycle_seconds: int = Field(default=30 * 60, alias="DB_POOL_RECYCLE_SECONDS")
+    db_pool_pre_ping: bool = Field(default=True, alias="DB_POOL_PRE_PING")
+    db_pgbouncer: bool = Field(default=False, alias="DB_PGBOUNCER")
+    # Optional on verify-only nodes that hold just public keys in JWT_KEYS
+    jwt_secret: str | None = Field(default=None, alias="JWT_SECRET")
     jwt_algorithm: str = Field(default="HS256", alias="JWT_ALGORITHM")
+    # JSON object kid -> {"algorithm", "secret"} or {"algorithm", "private_key_file", "public_key_file"}
+    jwt_keys: str = Field(default="", alias="JWT_KEYS")
+    # Signing key from JWT_KEYS; unset signs with JWT_SECRET and no kid
+    jwt_active_kid: str | None = Field(default=None, alias="JWT_ACTIVE_KID")
+    jwt_token_cache_size: int = Field(default=10000, alias="JWT_TOKEN_CACHE_SIZE")
+    # Verify kid-less tokens against JWT_SECRET; turn off once they have all expired
+    jwt_accept_legacy_tokens: bool = Field(default=True, alias="JWT_ACCEPT_LEGACY_TOKENS")
     token_ttl_days: int = Field(default=7, alias="TOKEN_TTL_DAYS")
     grace_days: int = Field(default=7, alias="GRACE_DAYS")
     allow_insecure_http: bool = Field(default=False, alias="ALLOW_INSECURE_HTTP")
@@ -52,8 +71,32 @@ class Settings(BaseSettings):
     )
     rate_limit_refresh_per_minute: int = Field(default=10, alias="RATE_LIMIT_REFRESH_PER_MINUTE")
     rate_limit_login_per_minute: int = Field(default=10, alias="RATE_LIMIT_LOGIN_PER_MINUTE")
+    rate_limit_backend: str = Field(default="memory", alias="RATE_LIMIT_BACKEND")  # memory | redis
+    rate_limit_redis_url: str | None = Field(default=None, alias="RATE_LIMIT_REDIS_URL")
+    license_legacy_scan_limit: int = Field(default=50, alias="LICENSE_LEGACY_SCAN_LIMIT")
+    license_legacy_scan_max_keys: int = Field(default=500, alias="LICENSE_LEGACY_SCAN_MAX_KEYS")
+    license_legacy_miss_ttl_seconds: int = Field(default=10 * 60, alias="LICENSE_LEGACY_MISS_TTL_SECONDS")
+    license_legacy_verify_batch: int = Field(default=5, alias="LICENSE_LEGACY_VERIFY_BATCH")
+    license_legacy_max_scans: int = Field(default=1, alias="LICENSE_LEGACY_MAX_SCANS")
+    # Keep workers + queue size well below the request threadpool (40 threads)
+    license_verify_workers: int = Field(default=2, alias="LICENSE_VERIFY_WORKERS")
+    license_verify_queue_size: int = Field(default=16, alias="LICENSE_VERIFY_QUEUE_SIZE")
+    license_verify_queue_per_tenant: int = Field(default=4, alias="LICENSE_VERIFY_QUEUE_PER_TENANT")
     erp_timeout_seconds: int = Field(default=10, alias="ERP_TIMEOUT_SECONDS")
+    erp_pool_timeout_seconds: float = Field(default=2.0, alias="ERP_POOL_TIMEOUT_SECONDS")
+    erp_max_connections_per_tenant: int = Field(default=10, alias="ERP_MAX_CONNECTIONS_PER_TENANT")
+    erp_circuit_failure_threshold: int = Field(default=5, alias="ERP_CIRCUIT_FAILURE_THRESHOLD")
+    erp_circuit_reset_seconds: float = Field(default=30.0, alias="ERP_CIRCUIT_RESET_SECONDS")
+    erp_cache_ttl_seconds: float = Field(default=60.0, alias="ERP_CACHE_TTL_SECONDS")
+    erp_cache_stale_seconds: float = Field(default=300.0, alias="ERP_CACHE_STALE_SECONDS")
+    erp_cache_max_entries: int = Field(default=5000, alias="ERP_CACHE_MAX_ENTRIES")
+    erp_cache_max_bytes: int = Field(default=64 * 1024 * 1024, alias="ERP_CACHE_MAX_BYTES")
+    erp_cache_max_entry_bytes: int = Field(default=1024 * 1024, alias="ERP_CACHE_MAX_ENTRY_BYTES")
+    erp_stream_chunk_bytes: int = Field(default=16384, alias="ERP_STREAM_CHUNK_BYTES")
+    erp_stream_page_length: int = Field(default=500, alias="ERP_STREAM_PAGE_LENGTH")
+    erp_allowlist_refresh_seconds: float = Field(default=5.0, alias="ERP_ALLOWLIST_REFRESH_SECONDS")
     log_level: str = Field(default="INFO", alias="LOG_LEVEL")
+    metrics_token: str | None = Field(default=None, alias="METRICS_TOKEN")
     admin_token: str | None = Field(default=None, alias="ADMIN_TOKEN")
     session_secret: str | None = Field(default=None, alias="SESSION_SECRET")
     admin_session_max_age_seconds: int = Field(default=8 * 60 * 60, alias="ADMIN_SESSION_MAX_AGE_SECONDS")
@@ -61,6 +104,29 @@ class Settings(BaseSettings):
     admin_session_same_site: str = Field(default="lax", alias="ADMIN_SESSION_SAMESITE")
     ota_download_secret: str | None = Field(default=None, alias="OTA_DOWNLOAD_SECRET")
     ota_download_ttl_seconds: int = Field(default=10 * 60, alias="OTA_DOWNLOAD_TTL_SECONDS")
+    ota_accel_redirect_prefix: str | None = Field(default=None, alias="OTA_ACCEL_REDIRECT_PREFIX")
+    ota_delta_sources: int = Field(default=3, alias="OTA_DELTA_SOURCES")
+    ota_compress_firmware: bool = Field(default=True, alias="OTA_COMPRESS_FIRMWARE")
+    ota_store_verify_on_startup: bool = Field(default=True, alias="OTA_STORE_VERIFY_ON_STARTUP")
+    # Unreferenced store objects younger than this are kept (upload not yet registered)
+    ota_object_grace_seconds: int = Field(default=24 * 60 * 60, alias="OTA_OBJECT_GRACE_SECONDS")
+    ota_rollout_max_concurrent: int = Field(default=0, alias="OTA_ROLLOUT_MAX_CONCURRENT")
+    ota_rollout_retry_seconds: int = Field(default=15 * 60, alias="OTA_ROLLOUT_RETRY_SECONDS")
+    ota_rollout_inflight_refresh_seconds: float = Field(default=5.0, alias="OTA_ROLLOUT_INFLIGHT_REFRESH_SECONDS")
+    ota_rollout_inflight_stale_seconds: int = Field(default=30 * 60, alias="OTA_ROLLOUT_INFLIGHT_STALE_SECONDS")
+    ota_index_refresh_seconds: float = Field(default=5.0, alias="OTA_INDEX_REFRESH_SECONDS")
+    ota_check_interval_seconds: int = Field(default=24 * 60 * 60, alias="OTA_CHECK_INTERVAL_SECONDS")
+    ota_check_jitter_ratio: float = Field(default=0.25, alias="OTA_CHECK_JITTER_RATIO")
+    ota_progress_flush_seconds: float = Field(default=5.0, alias="OTA_PROGRESS_FLUSH_SECONDS")
+    request_context_cache_seconds: float = Field(default=30.0, alias="REQUEST_CONTEXT_CACHE_SECONDS")
+    # How often each worker checks for tenant/device changes made through other workers
+    request_context_revalidate_seconds: float = Field(default=2.0, alias="REQUEST_CONTEXT_REVALIDATE_SECONDS")
+    last_seen_flush_seconds: float = Field(default=30.0, alias="LAST_SEEN_FLUSH_SECONDS")
+    audit_flush_seconds: float = Field(default=2.0, alias="AUDIT_FLUSH_SECONDS")
+    audit_buffer_max_rows: int = Field(default=50000, alias="AUDIT_BUFFER_MAX_ROWS")
+    audit_retention_months: int = Field(default=12, alias="AUDIT_RETENTION_MONTHS")  # 0: keep forever
+    audit_partitions_ahead: int = Field(default=2, alias="AUDIT_PARTITIONS_AHEAD")
+    audit_maintenance_seconds: float = Field(default=3600.0, alias="AUDIT_MAINTENANCE_SECONDS")
     erp_allowed_doctypes: list[str] = Field(
         default_factory=lambda: [
             "Pick List",
@@ -98,6 +164,11 @@ class Settings(BaseSettings):
     def trusted_proxy_net_list(self) -> list[str]:
         return parse_proxy_net_list(self.trusted_proxy_nets)
 
+    @property
+    def jwt_key_map(self) -> dict[str, dict]:
+        text = self.jwt_keys.strip()
+        return json.loads(text) if text else {}
+
 
 @lru_cache
 def get_settings() -> Settings:
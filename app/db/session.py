@@ -1,9 +1,75 @@
-from sqlalchemy import create_engine
+import time
+
+from sqlalchemy import create_engine, event
+from sqlalchemy.engine import make_url
+from sqlalchemy.ext.asyncio import AsyncSession, async_sessionmaker, create_async_engine
 from sqlalchemy.orm import sessionmaker
+from sqlalchemy.pool import NullPool
 
 from app.config import get_settings
+from app.services.metrics import current_route, db_query_seconds
 
 settings = get_settings()
 
-engine = create_engine(settings.database_url, pool_pre_ping=True)
+
+def _pool_options(pool_size: int, max_overflow: int) -> dict:
+    """Pool settings for one engine.
+
+    Each worker process holds a sync and an async engine, so it can open up to
+    DB_POOL_SIZE + DB_MAX_OVERFLOW + DB_ASYNC_POOL_SIZE + DB_ASYNC_MAX_OVERFLOW
+    connections; that times the worker count must stay below Postgres
+    max_connections minus superuser_reserved_connections.
+    """
+    if settings.db_pgbouncer:
+        # PgBouncer owns the pool; hold no idle connections of our own
+        return {"poolclass": NullPool}
+    return {
+        "pool_size": pool_size,
+        "max_overflow": max_overflow,
+        "pool_timeout": settings.db_pool_timeout_seconds,
+        "pool_recycle": settings.db_pool_recycle_seconds,
+        "pool_pre_ping": settings.db_pool_pre_ping,
+        "pool_use_lifo": True,
+    }
+
+
+def _instrument(sync_engine) -> None:
+    """Time every statement, labelled with the route that issued it."""
+
+    @event.listens_for(sync_engine, "before_cursor_execute")
+    def _start(conn, cursor, statement, parameters, context, executemany):
+        conn.info.setdefault("query_started", []).append(time.perf_counter())
+
+    @event.listens_for(sync_engine, "after_cursor_execute")
+    def _stop(conn, cursor, statement, parameters, context, executemany):
+        started = conn.info["query_started"].pop()
+        db_query_seconds.observe(time.perf_counter() - started, current_route.get())
+
+    @event.listens_for(sync_engine, "handle_error")
+    def _failed(exception_context):
+        # A failed statement never reaches after_cursor_execute
+        conn = exception_context.connection
+        if conn is not None and conn.info.get("query_started"):
+            conn.info["query_started"].pop()
+
+
+def async_database_url() -> str:
+    if settings.database_async_url:
+        return settings.database_async_url
+    return make_url(settings.database_url).set(drivername="postgresql+asyncpg").render_as_string(hide_password=False)
+
+
+engine = create_engine(settings.database_url, **_pool_options(settings.db_pool_size, settings.db_max_overflow))
 SessionLocal = sessionmaker(bind=engine, autocommit=False, autoflush=False)
+
+# Used by the high-QPS device routes so they wait on Postgres without holding a threadpool thread
+async_engine = create_async_engine(
+    async_database_url(),
+    # Transaction-mode PgBouncer cannot keep asyncpg's prepared statements
+    connect_args={"statement_cache_size": 0, "prepared_statement_cache_size": 0} if settings.db_pgbouncer else {},
+    **_pool_options(settings.db_async_pool_size, settings.db_async_max_overflow),
+)
+_instrument(engine)
+_instrument(async_engine.sync_engine)
+
+AsyncSessionLocal = async_sessionmaker(bind=async_engine, autoflush=False, expire_on_commit=False, class_=AsyncSession)
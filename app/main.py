@@ -1,12 +1,24 @@
+import asyncio
+import hmac
 import ipaddress
 import logging
+import time
+from contextlib import asynccontextmanager, suppress
 
-from fastapi import FastAPI, Request
-from fastapi.responses import JSONResponse
+from fastapi import Depends, FastAPI, Request
+from fastapi.responses import JSONResponse, PlainTextResponse, Response
 from starlette.middleware.sessions import SessionMiddleware
 
 from app.api.routes import admin_router, auth_router, erpnext_router, ota_router, status_router
 from app.config import get_settings
+from app.db import async_engine
+from app.services.audit import flush_audit, maintain_audit_partitions
+from app.services.background import run_periodic
+from app.services.erpnext import close_clients as close_erpnext_clients
+from app.services.firmware_store import verify_store_task
+from app.services.metrics import current_route, http_request_seconds, render_metrics
+from app.services.ota_progress import flush_progress
+from app.services.request_cache import flush_last_seen
 from app.web.routes import router as web_router
 
 settings = get_settings()
@@ -14,8 +26,64 @@ settings = get_settings()
 logging.basicConfig(level=settings.log_level)
 logger = logging.getLogger(__name__)
 
-app = FastAPI(title=settings.app_name)
+
+async def verify_firmware_store() -> None:
+    try:
+        await asyncio.to_thread(
+            verify_store_task, "firmware", grace_seconds=settings.ota_object_grace_seconds
+        )
+    except Exception as e:
+        logger.error("Firmware store scan failed: %s", e)
+
+
+@asynccontextmanager
+async def lifespan(app: FastAPI):
+    # Write-behind buffers: flushed periodically and once more on shutdown
+    flushers = [
+        ("ota_progress", settings.ota_progress_flush_seconds, flush_progress),
+        ("last_seen", settings.last_seen_flush_seconds, flush_last_seen),
+        ("audit", settings.audit_flush_seconds, flush_audit),
+    ]
+    try:
+        await asyncio.to_thread(maintain_audit_partitions)
+    except Exception as e:
+        logger.error("Audit partition maintenance failed: %s", e)
+    tasks = [asyncio.create_task(run_periodic(interval, job, name)) for name, interval, job in flushers]
+    tasks.append(
+        asyncio.create_task(
+            run_periodic(settings.audit_maintenance_seconds, maintain_audit_partitions, "audit_partitions")
+        )
+    )
+    if settings.ota_store_verify_on_startup:
+        # Incremental, so usually a stat per object; runs in the background either way
+        tasks.append(asyncio.create_task(verify_firmware_store()))
+    try:
+        yield
+    finally:
+        for task in tasks:
+            task.cancel()
+        for task in tasks:
+            with suppress(asyncio.CancelledError):
+                await task
+        for name, _, job in flushers:
+            try:
+                await asyncio.to_thread(job)
+            except Exception as e:
+                logger.error("Final %s flush failed: %s", name, e)
+        await close_erpnext_clients()
+        await async_engine.dispose()
+
+
+async def label_route(request: Request) -> None:
+    """Expose the matched route template to code running inside the request (DB timing)."""
+    route = request.scope.get("route")
+    current_route.set(getattr(route, "path", "unmatched"))
+
+
+app = FastAPI(title=settings.app_name, lifespan=lifespan, dependencies=[Depends(label_route)])
 session_secret = settings.session_secret or settings.jwt_secret
+if not session_secret:
+    raise RuntimeError("SESSION_SECRET is required when JWT_SECRET is not set")
 trusted_proxy_nets: list[ipaddress.IPv4Network | ipaddress.IPv6Network] = []
 for raw in settings.trusted_proxy_net_list:
     try:
@@ -31,9 +99,29 @@ app.add_middleware(
 )
 
 
+@app.middleware("http")
+async def record_request_metrics(request: Request, call_next):
+    started = time.perf_counter()
+    status_code = 500
+    try:
+        response = await call_next(request)
+        status_code = response.status_code
+        return response
+    finally:
+        # Route templates keep the label set small; unmatched paths share one label
+        route = request.scope.get("route")
+        http_request_seconds.observe(
+            time.perf_counter() - started,
+            getattr(route, "path", "unmatched"),
+            request.method,
+            str(status_code),
+        )
+
+
 @app.middleware("http")
 async def enforce_https(request: Request, call_next):
-    if not settings.allow_insecure_http:
+    # Prometheus scrapes /metrics over plain HTTP on the internal network; it is token-gated
+    if not settings.allow_insecure_http and request.url.path != "/metrics":
         scheme = request.url.scheme
         forwarded_proto = request.headers.get("x-forwarded-proto")
         if forwarded_proto and request.client and trusted_proxy_nets:
@@ -61,3 +149,14 @@ app.include_router(web_router)
 @app.get("/health")
 def health() -> dict:
     return {"status": "ok"}
+
+
+@app.get("/metrics", include_in_schema=False)
+def metrics(request: Request) -> Response:
+    # Disabled until METRICS_TOKEN is set; there is no anonymous access
+    if not settings.metrics_token:
+        return JSONResponse(status_code=404, content={"detail": "Not Found"})
+    authorization = request.headers.get("authorization", "")
+    if not hmac.compare_digest(authorization, f"Bearer {settings.metrics_token}"):
+        return JSONResponse(status_code=401, content={"detail": "Metrics token required"})
+    return PlainTextResponse(render_metrics(), media_type="text/plain; version=0.0.4")
@@ -1,7 +1,7 @@
 from app.models.audit_log import AuditLog
 from app.models.device import Device
 from app.models.erp_allowlist import ERPAllowlistEntry, ERPAllowlistType
-from app.models.firmware import Firmware, DeviceOTALog
+from app.models.firmware import Firmware, FirmwarePatch, FirmwareRolloutStat, DeviceOTALog
 from app.models.license_key import LicenseKey, LicenseKeyStatus
 from app.models.ota_access import OTAAccess
 from app.models.tenant import Tenant, TenantStatus
@@ -13,6 +13,8 @@ __all__ = [
     "ERPAllowlistEntry",
     "ERPAllowlistType",
     "Firmware",
+    "FirmwarePatch",
+    "FirmwareRolloutStat",
     "LicenseKey",
     "LicenseKeyStatus",
     "OTAAccess",
@@ -1,7 +1,7 @@
 import uuid
 from datetime import datetime
 
-from sqlalchemy import Boolean, DateTime, ForeignKey, String, UniqueConstraint, func
+from sqlalchemy import Boolean, DateTime, ForeignKey, Index, String, UniqueConstraint, func
 from sqlalchemy.dialects.postgresql import UUID
 from sqlalchemy.orm import Mapped, mapped_column, relationship
 
@@ -10,7 +10,10 @@ from app.db.base import Base
 
 class Device(Base):
     __tablename__ = "devices"
-    __table_args__ = (UniqueConstraint("tenant_id", "device_id", name="uq_device_tenant"),)
+    __table_args__ = (
+        UniqueConstraint("tenant_id", "device_id", name="uq_device_tenant"),
+        Index("ix_devices_tenant_id_created_at_id", "tenant_id", "created_at", "id"),
+    )
 
     id: Mapped[uuid.UUID] = mapped_column(UUID(as_uuid=True), primary_key=True, default=uuid.uuid4)
     device_id: Mapped[str] = mapped_column(String(128), nullable=False)
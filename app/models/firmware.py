@@ -1,6 +1,9 @@
 """OTA Firmware model for device updates."""
 from datetime import datetime
-from sqlalchemy import Column, Integer, String, LargeBinary, DateTime, Boolean, Text, ForeignKey
+from sqlalchemy import (
+    BigInteger, Column, Integer, SmallInteger, String, LargeBinary, DateTime, Boolean, Text, ForeignKey, Index,
+    UniqueConstraint
+)
 from sqlalchemy.orm import relationship
 from app.db.base import Base
 
@@ -22,7 +25,13 @@ class Firmware(Base):
     
     # Binary data - stored as file path reference
     # For large files, better to store path and serve from disk
-    binary_path = Column(String(500), nullable=False)  # /firmware/scales_bridge/v1.0.0.bin
+    binary_path = Column(String(500), nullable=False)  # objects/ab/ab12...: store object named by file_hash
+
+    # Compressed variant of the same image, generated in the background
+    compressed_path = Column(String(500), nullable=True)  # Store object; shared by identical images
+    compressed_size = Column(Integer, nullable=True)  # Bytes
+    compressed_hash = Column(String(64), nullable=True)  # SHA256 of the compressed file
+    compression = Column(String(20), nullable=True)  # e.g., "heatshrink"
     
     # Metadata
     description = Column(Text, nullable=True)
@@ -32,6 +41,8 @@ class Firmware(Base):
     is_stable = Column(Boolean, default=False)  # Is this a stable release
     is_active = Column(Boolean, default=True)   # Can devices download this version
     min_current_version = Column(String(20), nullable=True)  # Minimum version required to OTA from
+    rollout_percent = Column(Integer, nullable=False, default=100, server_default="100")  # Share of devices offered it
+    max_concurrent_downloads = Column(Integer, nullable=True)  # None: OTA_ROLLOUT_MAX_CONCURRENT
     
     # Timestamps
     created_at = Column(DateTime, default=datetime.utcnow, nullable=False)
@@ -40,19 +51,61 @@ class Firmware(Base):
     
     # Relations
     device_ota_logs = relationship("DeviceOTALog", back_populates="firmware", cascade="all, delete-orphan")
+    patches = relationship(
+        "FirmwarePatch",
+        back_populates="firmware",
+        foreign_keys="FirmwarePatch.firmware_id",
+        cascade="all, delete-orphan",
+    )
 
     def __repr__(self) -> str:
         return f"<Firmware {self.device_type} v{self.version} (build {self.build_number})>"
 
 
+class FirmwarePatch(Base):
+    """Precomputed binary delta from an older firmware build to a newer one."""
+
+    __tablename__ = "firmware_patch"
+    __table_args__ = (
+        UniqueConstraint("firmware_id", "source_firmware_id", name="uq_firmware_patch_source"),
+    )
+
+    id = Column(Integer, primary_key=True, index=True)
+    firmware_id = Column(Integer, ForeignKey("firmware.id", ondelete="CASCADE"), nullable=False, index=True)  # Target
+    source_firmware_id = Column(Integer, ForeignKey("firmware.id", ondelete="CASCADE"), nullable=False)  # Installed build
+
+    # File info
+    patch_path = Column(String(500), nullable=False)  # Store object named by patch_hash
+    patch_size = Column(Integer, nullable=False)  # Bytes
+    patch_hash = Column(String(64), nullable=False)  # SHA256 of the patch file
+    compression = Column(String(20), nullable=False)  # detools compression (e.g., "heatshrink")
+
+    created_at = Column(DateTime, default=datetime.utcnow, nullable=False)
+
+    # Relations
+    firmware = relationship("Firmware", back_populates="patches", foreign_keys=[firmware_id])
+    source_firmware = relationship("Firmware", foreign_keys=[source_firmware_id])
+
+    def __repr__(self) -> str:
+        return f"<FirmwarePatch {self.source_firmware_id} -> {self.firmware_id}>"
+
+
 class DeviceOTALog(Base):
     """Log of OTA attempts and updates for devices."""
 
     __tablename__ = "device_ota_log"
+    # Match the admin filters and keyset order; updated_at stays unindexed so
+    # progress flushes remain HOT updates.
+    __table_args__ = (
+        Index("ix_device_ota_log_created_at_id", "created_at", "id"),
+        Index("ix_device_ota_log_device_id_created_at", "device_id", "created_at"),
+        Index("ix_device_ota_log_firmware_id_status", "firmware_id", "status"),
+        Index("ix_device_ota_log_status_created_at", "status", "created_at"),
+    )
 
     id = Column(Integer, primary_key=True, index=True)
-    device_id = Column(Integer, nullable=False, index=True)  # Reference to Device model
-    firmware_id = Column(Integer, ForeignKey("firmware.id"), nullable=False, index=True)  # Which firmware version
+    device_id = Column(Integer, nullable=False)  # Reference to Device model
+    firmware_id = Column(Integer, ForeignKey("firmware.id"), nullable=False)  # Which firmware version
     
     # Status tracking
     status = Column(String(20), nullable=False)  # pending, downloading, installing, success, failed
@@ -75,3 +128,18 @@ class DeviceOTALog(Base):
 
     def __repr__(self) -> str:
         return f"<DeviceOTALog device_id={self.device_id} firmware_id={self.firmware_id} status={self.status}>"
+
+
+class FirmwareRolloutStat(Base):
+    """OTA log count per firmware and status, kept current by a trigger on device_ota_log.
+
+    Each (firmware, status) is spread over slot rows so concurrent status
+    writes do not queue on one row lock; the count is the sum over slots.
+    """
+
+    __tablename__ = "firmware_rollout_stats"
+
+    firmware_id = Column(Integer, ForeignKey("firmware.id", ondelete="CASCADE"), primary_key=True)
+    status = Column(String(20), primary_key=True)
+    slot = Column(SmallInteger, primary_key=True, default=0)
+    count = Column(BigInteger, nullable=False, default=0)
@@ -2,7 +2,7 @@ import enum
 import uuid
 from datetime import datetime
 
-from sqlalchemy import DateTime, Enum, ForeignKey, String, func
+from sqlalchemy import DateTime, Enum, ForeignKey, Index, String, func
 from sqlalchemy.dialects.postgresql import UUID
 from sqlalchemy.orm import Mapped, mapped_column, relationship
 
@@ -16,6 +16,7 @@ class LicenseKeyStatus(str, enum.Enum):
 
 class LicenseKey(Base):
     __tablename__ = "license_keys"
+    __table_args__ = (Index("ix_license_keys_tenant_id_created_at_id", "tenant_id", "created_at", "id"),)
 
     id: Mapped[uuid.UUID] = mapped_column(UUID(as_uuid=True), primary_key=True, default=uuid.uuid4)
     hashed_key: Mapped[str] = mapped_column(String(255), unique=True, nullable=False)
@@ -33,6 +33,8 @@ class FirmwareUpdate(BaseModel):
     is_stable: Optional[bool] = None
     is_active: Optional[bool] = None
     min_current_version: Optional[str] = None
+    rollout_percent: Optional[int] = Field(default=None, ge=0, le=100)
+    max_concurrent_downloads: Optional[int] = Field(default=None, ge=0)
 
 
 class FirmwareResponse(FirmwareBase):
@@ -46,6 +48,10 @@ class FirmwareResponse(FirmwareBase):
     created_at: datetime
     updated_at: datetime
     released_at: Optional[datetime] = None
+    compression: Optional[str] = None
+    compressed_size: Optional[int] = None
+    rollout_percent: int = 100
+    max_concurrent_downloads: Optional[int] = None
 
     class Config:
         from_attributes = True
@@ -78,6 +84,21 @@ class OTACheckResponse(BaseModel):
     download_url: Optional[str] = None  # Signed download URL (may include query params)
     file_hash: Optional[str] = None  # For device to verify integrity
     file_size: Optional[int] = None  # Size in bytes
+    # Delta update from the device's current build, when one was precomputed
+    patch_from_firmware_id: Optional[int] = None
+    patch_url: Optional[str] = None  # Signed patch URL (may include query params)
+    patch_hash: Optional[str] = None  # SHA256 of the patch file
+    patch_size: Optional[int] = None  # Patch size in bytes
+    patch_compression: Optional[str] = None
+    # Compressed full image; file_hash still covers the decompressed image
+    compression: Optional[str] = None
+    compressed_url: Optional[str] = None  # Signed URL (may include query params)
+    compressed_hash: Optional[str] = None  # SHA256 of the compressed file
+    compressed_size: Optional[int] = None  # Compressed size in bytes
+    # Seconds until the device should check again (server-chosen, jittered)
+    next_check_after: Optional[int] = None
+    # Set when the release exists but its download slots are full
+    throttled: Optional[bool] = None
 
 
 # OTA Download request/response
@@ -102,6 +123,22 @@ class OTAStatusUpdate(BaseModel):
     error_message: Optional[str] = None
 
 
+class OTAStatusEvent(BaseModel):
+    """Single progress event inside a batched status report."""
+
+    firmware_id: int
+    status: str = Field(..., description="pending, downloading, installing, success, failed")
+    bytes_downloaded: Optional[int] = None
+    error_message: Optional[str] = None
+
+
+class OTAStatusBatch(BaseModel):
+    """Device reports several OTA status events at once, oldest first."""
+
+    device_id: int
+    events: list[OTAStatusEvent] = Field(..., min_length=1, max_length=100)
+
+
 class OTALogResponse(BaseModel):
     """OTA log entry response."""
 
@@ -119,3 +156,11 @@ class OTALogResponse(BaseModel):
 
     class Config:
         from_attributes = True
+
+
+class FirmwareRolloutStatsResponse(BaseModel):
+    """OTA log counts per status for one firmware."""
+
+    firmware_id: int
+    counts: dict[str, int]
+    total: int
@@ -1,5 +1,10 @@
+import threading
+import time
 from dataclasses import dataclass
+from types import MappingProxyType
+from typing import Mapping
 
+from sqlalchemy import func, select
 from sqlalchemy.exc import IntegrityError
 from sqlalchemy.orm import Session
 
@@ -9,8 +14,15 @@ from app.models import ERPAllowlistEntry, ERPAllowlistType
 
 @dataclass(frozen=True)
 class Allowlist:
-    doctypes: dict[str, str]
-    methods: set[str]
+    doctypes: Mapping[str, str]
+    methods: frozenset[str]
+
+    @classmethod
+    def compile(cls, doctypes: list[str], methods: list[str]) -> "Allowlist":
+        return cls(
+            MappingProxyType(build_doctype_map(doctypes)),
+            frozenset(normalize_method(value) for value in methods if value),
+        )
 
 
 def normalize_doctype(value: str) -> str:
@@ -53,17 +65,73 @@ def seed_allowlist_from_settings(db: Session) -> None:
         db.rollback()
 
 
-def get_allowlist(db: Session) -> Allowlist:
+def load_allowlist(db: Session) -> Allowlist:
     entries = db.query(ERPAllowlistEntry).all()
     if not entries:
         settings = get_settings()
-        doctypes = [normalize_doctype(item) for item in settings.erp_allowed_doctypes if item]
-        methods = [normalize_method(item) for item in settings.erp_allowed_methods if item]
-        return Allowlist(build_doctype_map(doctypes), set(methods))
+        return Allowlist.compile(settings.erp_allowed_doctypes, settings.erp_allowed_methods)
 
     doctypes = [entry.value for entry in entries if entry.entry_type == ERPAllowlistType.doctype]
     methods = [entry.value for entry in entries if entry.entry_type == ERPAllowlistType.method]
-    return Allowlist(build_doctype_map(doctypes), {normalize_method(value) for value in methods})
+    return Allowlist.compile(doctypes, methods)
+
+
+class AllowlistCache:
+    """Worker-local compiled allowlist, revalidated against a table stamp.
+
+    Every ERP_ALLOWLIST_REFRESH_SECONDS one aggregate query checks the row
+    count and newest created_at; only a changed stamp reloads the table.
+    Admin edits call invalidate() so this worker sees them immediately.
+    """
+
+    def __init__(self, refresh_interval_seconds: float | None = None) -> None:
+        self._refresh_interval_seconds = refresh_interval_seconds
+        self._lock = threading.Lock()
+        self._allowlist: Allowlist | None = None
+        self._stamp: tuple | None = None
+        self._checked_at: float | None = None
+
+    @property
+    def refresh_interval_seconds(self) -> float:
+        if self._refresh_interval_seconds is None:
+            self._refresh_interval_seconds = get_settings().erp_allowlist_refresh_seconds
+        return self._refresh_interval_seconds
+
+    def invalidate(self) -> None:
+        with self._lock:
+            self._stamp = None
+            self._checked_at = None
+
+    def get(self, db: Session) -> Allowlist:
+        allowlist = self._allowlist
+        if allowlist is not None and self._is_fresh(time.monotonic()):
+            return allowlist
+        with self._lock:
+            now = time.monotonic()
+            if self._allowlist is None or not self._is_fresh(now):
+                stamp = self._load_stamp(db)
+                if self._allowlist is None or stamp != self._stamp:
+                    self._allowlist = load_allowlist(db)
+                    self._stamp = stamp
+                self._checked_at = now
+            return self._allowlist
+
+    def _is_fresh(self, now: float) -> bool:
+        return self._checked_at is not None and now - self._checked_at < self.refresh_interval_seconds
+
+    @staticmethod
+    def _load_stamp(db: Session) -> tuple:
+        row = db.execute(
+            select(func.count(ERPAllowlistEntry.id), func.max(ERPAllowlistEntry.created_at))
+        ).one()
+        return tuple(row)
+
+
+allowlist_cache = AllowlistCache()
+
+
+def get_allowlist(db: Session) -> Allowlist:
+    return allowlist_cache.get(db)
 
 
 def build_doctype_map(values: list[str]) -> dict[str, str]:
@@ -0,0 +1,254 @@
+"""Write-behind audit log and partition maintenance for `audit_logs`.
+
+Request handlers only append to an in-memory buffer; it is written every
+AUDIT_FLUSH_SECONDS as multi-row INSERTs, so an activation costs no audit
+write in its own transaction. Rows get their id and created_at when recorded,
+not when flushed. Rows of tenants deleted in the meantime are dropped at flush.
+
+`audit_logs` is range-partitioned by created_at, one partition per calendar
+month (UTC). Partitions are created AUDIT_PARTITIONS_AHEAD months ahead, and
+retention drops whole partitions older than AUDIT_RETENTION_MONTHS instead of
+deleting rows. A default partition catches anything outside the created
+ranges; rows stranded there for a month about to get its partition are moved
+into it (a plain CREATE PARTITION would fail on them), and a non-empty default
+partition is logged as a warning.
+"""
+import logging
+import re
+import threading
+import uuid
+from collections import deque
+from datetime import date, datetime, timezone
+from typing import Any, Iterable, Optional
+
+from sqlalchemy import insert, select, text
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models import AuditLog, Tenant
+from app.services.metrics import counters
+from app.utils.time import utcnow
+
+logger = logging.getLogger(__name__)
+
+FLUSH_BATCH_SIZE = 500
+PARENT_TABLE = "audit_logs"
+DEFAULT_PARTITION = f"{PARENT_TABLE}_default"
+_PARTITION_RE = re.compile(r"^audit_logs_p(\d{4})(\d{2})$")
+# Serializes partition DDL between workers
+_MAINTENANCE_LOCK_KEY = 0x41554454
+
+
+def month_start(moment: datetime) -> date:
+    moment = moment.astimezone(timezone.utc) if moment.tzinfo else moment
+    return date(moment.year, moment.month, 1)
+
+
+def add_months(month: date, months: int) -> date:
+    index = month.year * 12 + month.month - 1 + months
+    return date(index // 12, index % 12 + 1, 1)
+
+
+def partition_name(month: date) -> str:
+    return f"{PARENT_TABLE}_p{month:%Y%m}"
+
+
+def month_bounds(month: date) -> tuple[datetime, datetime]:
+    start, end = month, add_months(month, 1)
+    return (
+        datetime(start.year, start.month, 1, tzinfo=timezone.utc),
+        datetime(end.year, end.month, 1, tzinfo=timezone.utc),
+    )
+
+
+def partition_ddl(month: date) -> str:
+    return (
+        f"CREATE TABLE IF NOT EXISTS {partition_name(month)} PARTITION OF {PARENT_TABLE} "
+        f"FOR VALUES FROM ('{month.isoformat()} 00:00:00+00') TO ('{add_months(month, 1).isoformat()} 00:00:00+00')"
+    )
+
+
+def expired_partitions(names: Iterable[str], now: datetime, retention_months: int) -> list[str]:
+    """Monthly partitions whose whole range is older than the retention window."""
+    cutoff = add_months(month_start(now), -retention_months)
+    expired = []
+    for name in names:
+        match = _PARTITION_RE.match(name)
+        if match and add_months(date(int(match.group(1)), int(match.group(2)), 1), 1) <= cutoff:
+            expired.append(name)
+    return sorted(expired)
+
+
+class AuditBuffer:
+    """Worker-local queue of audit rows, flushed in bulk."""
+
+    def __init__(self, max_rows: int | None = None) -> None:
+        self._max_rows = max_rows
+        self._lock = threading.Lock()
+        # Held for a whole flush, so discard_tenant can wait out one in flight
+        self._flush_lock = threading.Lock()
+        self._rows: deque[dict[str, Any]] = deque()
+
+    @property
+    def max_rows(self) -> int:
+        if self._max_rows is None:
+            self._max_rows = get_settings().audit_buffer_max_rows
+        return self._max_rows
+
+    def record(
+        self,
+        action: str,
+        tenant_id: Optional[uuid.UUID] = None,
+        device_id: Optional[uuid.UUID] = None,
+        meta: Optional[dict] = None,
+    ) -> None:
+        row = {
+            "id": uuid.uuid4(),
+            "tenant_id": tenant_id,
+            "device_id": device_id,
+            "action": action,
+            "meta": meta,
+            "created_at": utcnow(),
+        }
+        with self._lock:
+            if len(self._rows) >= self.max_rows:
+                # The database has been unreachable for a while; keep the newest rows
+                self._rows.popleft()
+                counters.increment("audit_rows_dropped")
+            self._rows.append(row)
+
+    def discard_tenant(self, tenant_id: uuid.UUID) -> None:
+        """Drop queued rows of a tenant that is being deleted.
+
+        Waits for an in-flight flush first: its rows are then committed (and
+        deleted along with the tenant's others) or re-queued and dropped here.
+        """
+        with self._flush_lock, self._lock:
+            self._rows = deque(row for row in self._rows if row["tenant_id"] != tenant_id)
+
+    def __len__(self) -> int:
+        with self._lock:
+            return len(self._rows)
+
+    def flush(self, db: Session) -> int:
+        """Write all queued rows; returns the number written."""
+        with self._flush_lock:
+            return self._flush(db)
+
+    def _flush(self, db: Session) -> int:
+        with self._lock:
+            batch, self._rows = list(self._rows), deque()
+        if not batch:
+            return 0
+        try:
+            # Another worker may have deleted a tenant whose rows were queued here
+            tenant_ids = {row["tenant_id"] for row in batch if row["tenant_id"] is not None}
+            if tenant_ids:
+                live = set(db.execute(select(Tenant.id).where(Tenant.id.in_(list(tenant_ids)))).scalars())
+                batch = [row for row in batch if row["tenant_id"] is None or row["tenant_id"] in live]
+            for start in range(0, len(batch), FLUSH_BATCH_SIZE):
+                db.execute(insert(AuditLog).values(batch[start : start + FLUSH_BATCH_SIZE]))
+            db.commit()
+        except Exception:
+            db.rollback()
+            with self._lock:
+                # Re-queue ahead of rows recorded while the flush was failing
+                self._rows.extendleft(reversed(batch))
+                while len(self._rows) > self.max_rows:
+                    self._rows.popleft()
+                    counters.increment("audit_rows_dropped")
+            raise
+        return len(batch)
+
+
+audit_buffer = AuditBuffer()
+
+
+def delete_tenant_audit(db: Session, tenant_id: uuid.UUID) -> None:
+    """Delete a tenant's audit rows, using (tenant_id, created_at) in every partition."""
+    audit_buffer.discard_tenant(tenant_id)
+    db.query(AuditLog).filter(AuditLog.tenant_id == tenant_id).delete(synchronize_session=False)
+
+
+def flush_audit() -> None:
+    """Flush the shared buffer with its own session."""
+    from app.db import SessionLocal
+
+    db = SessionLocal()
+    try:
+        flushed = audit_buffer.flush(db)
+        if flushed:
+            logger.debug(f"Flushed {flushed} audit rows")
+    finally:
+        db.close()
+
+
+def maintain_partitions(db: Session, now: datetime, months_ahead: int, retention_months: int) -> list[str]:
+    """Create upcoming monthly partitions and drop expired ones; returns dropped names."""
+    db.execute(text("SELECT pg_advisory_xact_lock(:key)"), {"key": _MAINTENANCE_LOCK_KEY})
+    names = set(
+        db.execute(
+            text(
+                "SELECT c.relname FROM pg_inherits i JOIN pg_class c ON c.oid = i.inhrelid "
+                "WHERE i.inhparent = CAST(:parent AS regclass)"
+            ),
+            {"parent": PARENT_TABLE},
+        ).scalars()
+    )
+    current = month_start(now)
+    for offset in range(months_ahead + 1):
+        month = add_months(current, offset)
+        if partition_name(month) not in names:
+            _create_partition(db, month, has_default=DEFAULT_PARTITION in names)
+
+    dropped = expired_partitions(names, now, retention_months) if retention_months > 0 else []
+    for name in dropped:
+        db.execute(text(f"ALTER TABLE {PARENT_TABLE} DETACH PARTITION {name}"))
+        db.execute(text(f"DROP TABLE {name}"))
+
+    default_holds_rows = DEFAULT_PARTITION in names and db.execute(
+        text(f"SELECT EXISTS (SELECT 1 FROM {DEFAULT_PARTITION})")
+    ).scalar()
+    if default_holds_rows:
+        logger.warning(f"{DEFAULT_PARTITION} holds rows outside every monthly partition")
+    db.commit()
+    return dropped
+
+
+def _create_partition(db: Session, month: date, has_default: bool) -> None:
+    start, end = month_bounds(month)
+    bounds = {"start": start, "end": end}
+    in_range = "created_at >= :start AND created_at < :end"
+    stranded = has_default and db.execute(
+        text(f"SELECT EXISTS (SELECT 1 FROM {DEFAULT_PARTITION} WHERE {in_range})"), bounds
+    ).scalar()
+    if not stranded:
+        db.execute(text(partition_ddl(month)))
+        return
+
+    # CREATE PARTITION refuses while the default partition holds rows of its range
+    logger.warning(f"Moving {partition_name(month)} rows out of {DEFAULT_PARTITION}")
+    db.execute(text(f"ALTER TABLE {PARENT_TABLE} DETACH PARTITION {DEFAULT_PARTITION}"))
+    db.execute(text(partition_ddl(month)))
+    db.execute(text(f"INSERT INTO {PARENT_TABLE} SELECT * FROM {DEFAULT_PARTITION} WHERE {in_range}"), bounds)
+    db.execute(text(f"DELETE FROM {DEFAULT_PARTITION} WHERE {in_range}"), bounds)
+    db.execute(text(f"ALTER TABLE {PARENT_TABLE} ATTACH PARTITION {DEFAULT_PARTITION} DEFAULT"))
+
+
+def maintain_audit_partitions() -> None:
+    """Run partition maintenance with its own session."""
+    from app.db import SessionLocal
+
+    settings = get_settings()
+    db = SessionLocal()
+    try:
+        dropped = maintain_partitions(
+            db, utcnow(), settings.audit_partitions_ahead, settings.audit_retention_months
+        )
+        if dropped:
+            logger.info(f"Dropped expired audit partitions: {', '.join(dropped)}")
+    except Exception:
+        db.rollback()
+        raise
+    finally:
+        db.close()
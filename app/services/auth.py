@@ -1,5 +1,11 @@
+import hashlib
+import threading
+from collections import OrderedDict
 from dataclasses import dataclass
 from datetime import datetime, timedelta, timezone
+from functools import lru_cache
+from pathlib import Path
+from typing import Any
 from uuid import UUID
 
 import jwt
@@ -28,6 +34,112 @@ class TokenData:
     device_id: str | None = None
 
 
+@dataclass(frozen=True)
+class JWTKey:
+    kid: str | None
+    algorithm: str
+    # None on verify-only nodes that hold just the public key
+    signing_key: Any
+    verifying_key: Any
+
+
+@dataclass(frozen=True)
+class KeyRing:
+    """Keys accepted for verification, by kid; tokens without a kid use `legacy`.
+
+    legacy is None when kid-less tokens are not accepted; active is None on
+    verify-only nodes.
+    """
+
+    keys: dict[str, JWTKey]
+    legacy: JWTKey | None
+    active: JWTKey | None
+
+    def for_kid(self, kid: str | None) -> JWTKey | None:
+        return self.legacy if kid is None else self.keys.get(kid)
+
+
+def _read_key(spec: dict, name: str) -> str | None:
+    if spec.get(name):
+        return spec[name]
+    path = spec.get(f"{name}_file")
+    return Path(path).read_text() if path else None
+
+
+def _load_key(kid: str, spec: dict) -> JWTKey:
+    algorithm = spec.get("algorithm", "HS256")
+    if algorithm.startswith("HS"):
+        secret = _read_key(spec, "secret")
+        if not secret:
+            raise ValueError(f"JWT key {kid}: secret is required for {algorithm}")
+        return JWTKey(kid, algorithm, secret, secret)
+
+    private_key = _read_key(spec, "private_key")
+    public_key = _read_key(spec, "public_key")
+    if not public_key and private_key:
+        from cryptography.hazmat.primitives import serialization
+
+        public_key = serialization.load_pem_private_key(private_key.encode(), password=None).public_key()
+    if not public_key:
+        raise ValueError(f"JWT key {kid}: public_key or private_key is required for {algorithm}")
+    return JWTKey(kid, algorithm, private_key, public_key)
+
+
+@lru_cache
+def get_keyring() -> KeyRing:
+    settings = get_settings()
+    keys = {kid: _load_key(kid, spec) for kid, spec in settings.jwt_key_map.items()}
+    if not keys and not settings.jwt_secret:
+        raise ValueError("JWT_SECRET or JWT_KEYS is required")
+    active_kid = settings.jwt_active_kid or None
+    if active_kid and active_kid not in keys:
+        raise ValueError(f"JWT_ACTIVE_KID {active_kid} is not in JWT_KEYS")
+
+    secret_key = None
+    if settings.jwt_secret:
+        secret_key = JWTKey(None, settings.jwt_algorithm, settings.jwt_secret, settings.jwt_secret)
+    legacy = secret_key if settings.jwt_accept_legacy_tokens else None
+    if not active_kid and secret_key is not None and legacy is None:
+        raise ValueError("JWT_ACTIVE_KID is required when JWT_ACCEPT_LEGACY_TOKENS is false")
+    return KeyRing(keys=keys, legacy=legacy, active=keys[active_kid] if active_kid else secret_key)
+
+
+class VerifiedTokenCache:
+    """LRU of decoded tokens keyed by token digest.
+
+    A hit skips the signature check; expiry is still enforced from the
+    cached expires_at, so an entry never outlives its token.
+    """
+
+    def __init__(self, max_entries: int) -> None:
+        self.max_entries = max_entries
+        self._lock = threading.Lock()
+        self._entries: OrderedDict[bytes, TokenData] = OrderedDict()
+
+    def get(self, digest: bytes) -> TokenData | None:
+        with self._lock:
+            data = self._entries.get(digest)
+            if data is not None:
+                self._entries.move_to_end(digest)
+            return data
+
+    def put(self, digest: bytes, data: TokenData) -> None:
+        with self._lock:
+            self._entries[digest] = data
+            self._entries.move_to_end(digest)
+            while len(self._entries) > self.max_entries:
+                self._entries.popitem(last=False)
+
+    def discard(self, digest: bytes) -> None:
+        with self._lock:
+            self._entries.pop(digest, None)
+
+
+@lru_cache
+def get_token_cache() -> VerifiedTokenCache:
+    return VerifiedTokenCache(get_settings().jwt_token_cache_size)
+
+
 def create_access_token(
     tenant_id: UUID,
     device_id: str | None = None,
@@ -38,7 +150,7 @@ def create_access_token(
 ) -> tuple[str, TokenData]:
     settings = None
     issued_at = issued_at or utcnow()
-    if ttl_days is None or secret is None or algorithm is None:
+    if ttl_days is None or (secret is not None and algorithm is None):
         settings = get_settings()
     ttl_days = ttl_days if ttl_days is not None else settings.token_ttl_days
     expires_at = issued_at + timedelta(days=ttl_days)
@@ -52,11 +164,15 @@ def create_access_token(
         "exp": int(expires_at.timestamp()),
     }
 
-    token = jwt.encode(
-        payload,
-        secret or settings.jwt_secret,
-        algorithm=algorithm or settings.jwt_algorithm,
-    )
+    if secret is not None:
+        token = jwt.encode(payload, secret, algorithm=algorithm or settings.jwt_algorithm)
+    else:
+        key = get_keyring().active
+        if key is None or key.signing_key is None:
+            kid = key.kid if key is not None else None
+            raise RuntimeError(f"JWT key {kid} has no private key; this node cannot issue tokens")
+        headers = {"kid": key.kid} if key.kid else None
+        token = jwt.encode(payload, key.signing_key, algorithm=key.algorithm, headers=headers)
     return token, TokenData(tenant_id=tenant_id, issued_at=issued_at, expires_at=expires_at, device_id=device_id)
 
 
@@ -65,15 +181,35 @@ def decode_access_token(
     secret: str | None = None,
     algorithm: str | None = None,
 ) -> TokenData:
-    settings = None
-    if secret is None or algorithm is None:
-        settings = get_settings()
+    """Verify a token; pass secret/algorithm to bypass the keyring and cache."""
+    if secret is not None:
+        return _verify(token, secret, algorithm or get_settings().jwt_algorithm)
+
+    cache = get_token_cache()
+    digest = hashlib.sha256(token.encode()).digest()
+    cached = cache.get(digest)
+    if cached is not None:
+        if cached.expires_at <= utcnow():
+            cache.discard(digest)
+            raise TokenExpired("Token expired")
+        return cached
+
+    try:
+        kid = jwt.get_unverified_header(token).get("kid")
+    except jwt.InvalidTokenError as exc:
+        raise TokenInvalid("Token invalid") from exc
+    key = get_keyring().for_kid(kid)
+    if key is None:
+        raise TokenInvalid("Token without kid not accepted" if kid is None else "Unknown signing key")
+
+    data = _verify(token, key.verifying_key, key.algorithm)
+    cache.put(digest, data)
+    return data
+
+
+def _verify(token: str, key: Any, algorithm: str) -> TokenData:
     try:
-        payload = jwt.decode(
-            token,
-            secret or settings.jwt_secret,
-            algorithms=[algorithm or settings.jwt_algorithm],
-        )
+        payload = jwt.decode(token, key, algorithms=[algorithm])
     except jwt.ExpiredSignatureError as exc:
         raise TokenExpired("Token expired") from exc
     except jwt.InvalidTokenError as exc:
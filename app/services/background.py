@@ -0,0 +1,16 @@
+"""Periodic in-process jobs started from the app lifespan."""
+import asyncio
+import logging
+from typing import Callable
+
+logger = logging.getLogger(__name__)
+
+
+async def run_periodic(interval_seconds: float, job: Callable[[], None], name: str) -> None:
+    """Run a blocking job in a worker thread every interval_seconds."""
+    while True:
+        await asyncio.sleep(interval_seconds)
+        try:
+            await asyncio.to_thread(job)
+        except Exception as e:
+            logger.error(f"Background job {name} failed: {e}")
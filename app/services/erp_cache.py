@@ -0,0 +1,156 @@
+"""Per-tenant cache for read-mostly ERPNext GET responses.
+
+Entries are fresh for ERP_CACHE_TTL_SECONDS, then served stale for up to
+ERP_CACHE_STALE_SECONDS while a single background request refreshes them.
+Concurrent misses for the same key share one upstream call. Writes proxied
+for a doctype drop that tenant's cached entries for it; a fetch that was
+already in flight when the write happened is not stored. The cache holds at
+most ERP_CACHE_MAX_BYTES of response bodies; bodies over
+ERP_CACHE_MAX_ENTRY_BYTES are passed through without being cached.
+"""
+import asyncio
+import logging
+import time
+from collections import OrderedDict
+from dataclasses import dataclass
+from functools import lru_cache
+from typing import Any, Awaitable, Callable, Hashable
+
+import httpx
+
+from app.config import get_settings
+
+logger = logging.getLogger(__name__)
+
+
+@dataclass(frozen=True)
+class CachedResponse:
+    content: bytes
+    status_code: int
+    media_type: str | None
+    fetched_at: float
+
+
+def cache_key(tenant_key: Hashable, doctype: str, path: str, params: dict[str, Any] | None) -> tuple:
+    normalized = tuple(sorted((str(k), str(v)) for k, v in (params or {}).items()))
+    return (tenant_key, doctype.lower(), path, normalized)
+
+
+class ResponseCache:
+    def __init__(
+        self,
+        ttl_seconds: float,
+        stale_seconds: float,
+        max_entries: int,
+        max_bytes: int = 64 * 1024 * 1024,
+        max_entry_bytes: int = 1024 * 1024,
+    ) -> None:
+        self.ttl_seconds = ttl_seconds
+        self.stale_seconds = stale_seconds
+        self.max_entries = max_entries
+        self.max_bytes = max_bytes
+        self.max_entry_bytes = min(max_entry_bytes, max_bytes)
+        self.size_bytes = 0
+        self._entries: OrderedDict[tuple, CachedResponse] = OrderedDict()
+        self._inflight: dict[tuple, asyncio.Future] = {}
+        # Bumped on invalidation; fetches started under an older generation are not stored
+        self._generations: dict[tuple, int] = {}
+        self._refreshes: set[asyncio.Task] = set()
+
+    async def get_or_fetch(
+        self,
+        key: tuple,
+        fetch: Callable[[], Awaitable[httpx.Response]],
+        now: float | None = None,
+    ) -> tuple[CachedResponse, str]:
+        """Return (response, "HIT" | "STALE" | "MISS")."""
+        now = now or time.monotonic()
+        entry = self._entries.get(key)
+        if entry is not None:
+            age = now - entry.fetched_at
+            if age < self.ttl_seconds:
+                self._entries.move_to_end(key)
+                return entry, "HIT"
+            if age < self.ttl_seconds + self.stale_seconds:
+                self._entries.move_to_end(key)
+                if key not in self._inflight:
+                    task = asyncio.create_task(self._refresh(key, fetch))
+                    self._refreshes.add(task)
+                    task.add_done_callback(self._refreshes.discard)
+                return entry, "STALE"
+
+        future = self._inflight.get(key)
+        if future is None:
+            future = self._start_fetch(key, fetch)
+        return await asyncio.shield(future), "MISS"
+
+    def invalidate(self, tenant_key: Hashable, doctype: str) -> None:
+        scope = (tenant_key, doctype.lower())
+        self._generations[scope] = self._generations.get(scope, 0) + 1
+        for key in [key for key in self._entries if key[:2] == scope]:
+            self.size_bytes -= len(self._entries.pop(key).content)
+
+    def _start_fetch(self, key: tuple, fetch: Callable[[], Awaitable[httpx.Response]]) -> asyncio.Future:
+        future = asyncio.get_running_loop().create_future()
+        self._inflight[key] = future
+        generation = self._generations.get(key[:2], 0)
+
+        async def run() -> None:
+            try:
+                response = await fetch()
+                cached = CachedResponse(
+                    content=response.content,
+                    status_code=response.status_code,
+                    media_type=response.headers.get("content-type"),
+                    fetched_at=time.monotonic(),
+                )
+                if (
+                    response.status_code == 200
+                    and self.ttl_seconds > 0
+                    and len(cached.content) <= self.max_entry_bytes
+                    and self._generations.get(key[:2], 0) == generation
+                ):
+                    self._store(key, cached)
+                future.set_result(cached)
+            except asyncio.CancelledError:
+                future.cancel()
+                raise
+            except Exception as e:
+                future.set_exception(e)
+            finally:
+                self._inflight.pop(key, None)
+
+        task = asyncio.create_task(run())
+        self._refreshes.add(task)
+        task.add_done_callback(self._refreshes.discard)
+        # Nobody may await a background refresh; its errors are reported here
+        future.add_done_callback(lambda f: f.cancelled() or f.exception())
+        return future
+
+    async def _refresh(self, key: tuple, fetch: Callable[[], Awaitable[httpx.Response]]) -> None:
+        try:
+            await self._start_fetch(key, fetch)
+        except Exception as e:
+            logger.warning("ERPNext cache refresh failed for %s: %s", key[1], e)
+
+    def _store(self, key: tuple, cached: CachedResponse) -> None:
+        previous = self._entries.pop(key, None)
+        if previous is not None:
+            self.size_bytes -= len(previous.content)
+        self._entries[key] = cached
+        self.size_bytes += len(cached.content)
+        while len(self._entries) > self.max_entries or self.size_bytes > self.max_bytes:
+            _, evicted = self._entries.popitem(last=False)
+            self.size_bytes -= len(evicted.content)
+
+
+@lru_cache
+def get_response_cache() -> ResponseCache:
+    settings = get_settings()
+    return ResponseCache(
+        ttl_seconds=settings.erp_cache_ttl_seconds,
+        stale_seconds=settings.erp_cache_stale_seconds,
+        max_entries=settings.erp_cache_max_entries,
+        max_bytes=settings.erp_cache_max_bytes,
+        max_entry_bytes=settings.erp_cache_max_entry_bytes,
+    )
@@ -0,0 +1,136 @@
+"""Incremental sync of an ERPNext doctype keyed on `modified` timestamps.
+
+A watermark is an opaque, URL-safe token holding the last (`modified`, `name`)
+seen for upserts and the last (`creation`, `name`) seen in Deleted Document.
+Each call returns rows strictly after those compound marks, oldest first, up
+to a limit, so rows sharing a timestamp are neither skipped nor repeated
+however many of them there are. The first call (no watermark) is a full
+listing; its deletion mark is taken before the listing is fetched, so a
+deletion that races the listing is reported on the next call.
+"""
+import base64
+import json
+from dataclasses import dataclass
+from typing import Any, Awaitable, Callable
+
+Fetch = Callable[[str, dict[str, Any]], Awaitable[Any]]
+
+
+@dataclass(frozen=True)
+class Watermark:
+    modified: str | None = None
+    deleted: str | None = None
+    modified_name: str | None = None
+    deleted_name: str | None = None
+
+    @property
+    def is_initial(self) -> bool:
+        # deleted is "" rather than None once a first sync has run
+        return self.deleted is None
+
+
+def encode_watermark(mark: Watermark) -> str:
+    payload = {"m": mark.modified, "d": mark.deleted, "mn": mark.modified_name, "dn": mark.deleted_name}
+    raw = json.dumps(payload, separators=(",", ":")).encode("utf-8")
+    return base64.urlsafe_b64encode(raw).decode("ascii").rstrip("=")
+
+
+def decode_watermark(token: str | None) -> Watermark:
+    if not token:
+        return Watermark()
+    try:
+        data = json.loads(base64.urlsafe_b64decode(token + "=" * (-len(token) % 4)))
+        return Watermark(
+            modified=data.get("m"),
+            deleted=data.get("d"),
+            modified_name=data.get("mn"),
+            deleted_name=data.get("dn"),
+        )
+    except (ValueError, AttributeError) as exc:
+        raise ValueError("Invalid watermark") from exc
+
+
+def cursor_filters(field: str, value: str | None, name: str | None) -> tuple[list, list]:
+    """(filters, or_filters) for rows after (value, name): field > v OR (field = v AND name > n)."""
+    if not value:
+        return [], []
+    if name is None:
+        # Watermarks issued before names were tracked
+        return [[field, ">", value]], []
+    return [[field, ">=", value]], [[field, ">", value], ["name", ">", name]]
+
+
+def trim_page(
+    rows: list[dict[str, Any]],
+    field: str,
+    limit: int,
+    mark: tuple[str | None, str | None],
+) -> tuple[list, tuple[str | None, str | None], bool]:
+    """Return (rows, new (value, name) mark, has_more) for a page fetched with limit + 1 rows."""
+    has_more = len(rows) > limit
+    rows = rows[:limit]
+    if not rows:
+        return rows, mark, False
+    return rows, (rows[-1][field], rows[-1]["name"]), has_more
+
+
+def _params(fields: str, filters: list, or_filters: list, order_by: str, limit: int) -> dict[str, Any]:
+    params = {
+        "fields": fields,
+        "filters": json.dumps(filters, separators=(",", ":")),
+        "order_by": order_by,
+        "limit_page_length": limit,
+    }
+    if or_filters:
+        params["or_filters"] = json.dumps(or_filters, separators=(",", ":"))
+    return params
+
+
+async def fetch_delta(
+    fetch: Fetch,
+    doctype: str,
+    fields: list[str],
+    mark: Watermark,
+    limit: int,
+) -> dict[str, Any]:
+    deleted_filter = ["deleted_doctype", "=", doctype]
+    deletes: list[str] = []
+    deleted, more_deletes = (mark.deleted, mark.deleted_name), False
+    if mark.is_initial:
+        # First sync is a full listing: only deletions after it matter
+        latest = await fetch(
+            "Deleted Document",
+            _params('["name","creation"]', [deleted_filter], [], "creation desc, name desc", 1),
+        )
+        deleted = (latest[0]["creation"], latest[0]["name"]) if latest else ("", None)
+
+    field_spec = json.dumps(fields, separators=(",", ":"))
+    filters, or_filters = cursor_filters("modified", mark.modified, mark.modified_name)
+    upserts = await fetch(doctype, _params(field_spec, filters, or_filters, "modified asc, name asc", limit + 1))
+    modified = (mark.modified, mark.modified_name)
+    upserts, modified, more_upserts = trim_page(upserts, "modified", limit, modified)
+
+    if not mark.is_initial:
+        filters, or_filters = cursor_filters("creation", mark.deleted, mark.deleted_name)
+        rows = await fetch(
+            "Deleted Document",
+            _params(
+                '["name","deleted_name","creation"]',
+                [deleted_filter, *filters],
+                or_filters,
+                "creation asc, name asc",
+                limit + 1,
+            ),
+        )
+        rows, deleted, more_deletes = trim_page(rows, "creation", limit, deleted)
+        deletes = [row["deleted_name"] for row in rows]
+
+    next_mark = Watermark(
+        modified=modified[0], deleted=deleted[0], modified_name=modified[1], deleted_name=deleted[1]
+    )
+    return {
+        "upserts": upserts,
+        "deletes": deletes,
+        "watermark": encode_watermark(next_mark),
+        "has_more": more_upserts or more_deletes,
+    }
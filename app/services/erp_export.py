@@ -0,0 +1,47 @@
+"""Server-side walk over ERPNext list pagination for catalog exports.
+
+Pages are requested by keyset (`name > last name`, ordered by name), so each
+page is an index range scan in ERPNext however deep the walk goes. The next
+page is fetched while the current one is streamed out. A short page ends the
+walk. The resume cursor is the last exported `name`; restarting with it
+continues after that row even if rows were added in between.
+"""
+import asyncio
+import json
+from typing import Any, AsyncIterator, Awaitable, Callable
+
+# fetch_page(after_name, length) returns up to `length` rows with name > after_name
+FetchPage = Callable[[str | None, int], Awaitable[list[dict[str, Any]]]]
+
+
+async def iter_pages(
+    fetch_page: FetchPage, page_size: int, after: str | None = None
+) -> AsyncIterator[list[dict[str, Any]]]:
+    """Yield pages in name order, fetching the next page while the caller handles this one."""
+    pending: asyncio.Task | None = asyncio.create_task(fetch_page(after, page_size))
+    try:
+        while pending is not None:
+            rows = await pending
+            pending = None
+            if len(rows) >= page_size:
+                if "name" not in rows[-1]:
+                    raise ValueError("export rows must include the name field")
+                pending = asyncio.create_task(fetch_page(rows[-1]["name"], page_size))
+            if rows:
+                yield rows
+    finally:
+        if pending is not None:
+            pending.cancel()
+            # Reap the cancelled prefetch so its error is not reported as unretrieved
+            await asyncio.gather(pending, return_exceptions=True)
+
+
+def resume_filters(filters: list | None, cursor: str | None) -> list:
+    combined = list(filters or [])
+    if cursor:
+        combined.append(["name", ">", cursor])
+    return combined
+
+
+def ndjson_line(payload: dict[str, Any]) -> bytes:
+    return json.dumps(payload, separators=(",", ":"), ensure_ascii=False).encode("utf-8") + b"\n"
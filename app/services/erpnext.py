@@ -1,17 +1,26 @@
+import asyncio
 import json
 import logging
-from functools import lru_cache
-from typing import Any
+import time
+from typing import Any, AsyncIterator
+from urllib.parse import urlsplit
 
 import httpx
 
 from app.config import get_settings
+from app.services.metrics import erpnext_upstream_seconds
 
 logger = logging.getLogger(__name__)
 
 
 class ERPNextError(Exception):
-    pass
+    status_code = 502
+
+
+class ERPNextUnavailable(ERPNextError):
+    """Backend is failing (circuit open) or its connection pool is exhausted."""
+
+    status_code = 503
 
 
 def normalize_erpnext_url(raw: str) -> str:
@@ -23,7 +32,73 @@ def normalize_erpnext_url(raw: str) -> str:
     return f"https://{trimmed}".rstrip("/")
 
 
-def request_erpnext(
+class CircuitBreaker:
+    """Consecutive-failure breaker: after `threshold` failures the backend is
+    skipped for `reset_seconds`, then a single trial request decides whether
+    it closes again."""
+
+    def __init__(self, threshold: int, reset_seconds: float) -> None:
+        self.threshold = threshold
+        self.reset_seconds = reset_seconds
+        self.failures = 0
+        self.opened_at: float | None = None
+        self._trial_in_flight = False
+
+    def allow(self, now: float | None = None) -> bool:
+        if self.opened_at is None:
+            return True
+        now = now or time.monotonic()
+        if now - self.opened_at < self.reset_seconds or self._trial_in_flight:
+            return False
+        self._trial_in_flight = True
+        return True
+
+    def release(self) -> None:
+        """Give up a trial slot without a verdict."""
+        self._trial_in_flight = False
+
+    def record_success(self) -> None:
+        self.failures = 0
+        self.opened_at = None
+        self._trial_in_flight = False
+
+    def record_failure(self, now: float | None = None) -> None:
+        self.failures += 1
+        self._trial_in_flight = False
+        if self.opened_at is not None or self.failures >= self.threshold:
+            self.opened_at = now or time.monotonic()
+
+
+class _Backend:
+    def __init__(self, client: httpx.AsyncClient, breaker: CircuitBreaker) -> None:
+        self.client = client
+        self.breaker = breaker
+
+
+# One pooled HTTP/2 client and breaker per ERPNext base URL (i.e. per tenant),
+# so a slow backend only exhausts its own connections.
+_backends: dict[str, _Backend] = {}
+
+
+def _get_backend(base_url: str) -> _Backend:
+    backend = _backends.get(base_url)
+    if backend is None:
+        settings = get_settings()
+        client = httpx.AsyncClient(
+            http2=True,
+            timeout=httpx.Timeout(settings.erp_timeout_seconds, pool=settings.erp_pool_timeout_seconds),
+            limits=httpx.Limits(
+                max_connections=settings.erp_max_connections_per_tenant,
+                max_keepalive_connections=settings.erp_max_connections_per_tenant,
+                keepalive_expiry=60,
+            ),
+        )
+        breaker = CircuitBreaker(settings.erp_circuit_failure_threshold, settings.erp_circuit_reset_seconds)
+        backend = _backends[base_url] = _Backend(client, breaker)
+    return backend
+
+
+async def request_erpnext(
     base_url: str,
     api_key: str,
     api_secret: str,
@@ -31,29 +106,97 @@ def request_erpnext(
     path: str,
     params: dict[str, Any] | None = None,
     json_body: dict[str, Any] | None = None,
+) -> httpx.Response:
+    return await _send(base_url, api_key, api_secret, method, path, params=params, json_body=json_body)
+
+
+async def open_erpnext_stream(
+    base_url: str,
+    api_key: str,
+    api_secret: str,
+    path: str,
+    params: dict[str, Any] | None = None,
+    accept_encoding: str | None = None,
+) -> httpx.Response:
+    """Send a GET and return once headers arrive; the body is left unread.
+
+    The caller must relay it with iter_raw_body(), which closes the response.
+    Accept-Encoding is forwarded so the still-encoded body can be passed
+    through as-is.
+    """
+    headers = {"Accept-Encoding": accept_encoding or "identity"}
+    return await _send(base_url, api_key, api_secret, "GET", path, params=params, headers=headers, stream=True)
+
+
+async def iter_raw_body(response: httpx.Response, chunk_size: int | None = None) -> AsyncIterator[bytes]:
+    chunk_size = chunk_size or get_settings().erp_stream_chunk_bytes
+    try:
+        async for chunk in response.aiter_raw(chunk_size):
+            yield chunk
+    except httpx.RequestError as exc:
+        # Status and headers are already sent; all we can do is cut the body short
+        logger.error("ERPNext stream interrupted: %s", exc)
+    finally:
+        await response.aclose()
+
+
+async def _send(
+    base_url: str,
+    api_key: str,
+    api_secret: str,
+    method: str,
+    path: str,
+    params: dict[str, Any] | None = None,
+    json_body: dict[str, Any] | None = None,
+    headers: dict[str, str] | None = None,
+    stream: bool = False,
 ) -> httpx.Response:
     normalized = normalize_erpnext_url(base_url)
     if not normalized:
         raise ERPNextError("ERPNext URL not configured")
+    backend = _get_backend(normalized)
+    if not backend.breaker.allow():
+        raise ERPNextUnavailable("ERPNext temporarily unavailable")
+
     url = f"{normalized}{path}"
-    headers = {"Authorization": f"token {api_key}:{api_secret}"}
+    headers = {**(headers or {}), "Authorization": f"token {api_key}:{api_secret}"}
+    request = backend.client.build_request(method, url, params=params, json=json_body, headers=headers)
+    # One label per tenant ERPNext host; time to headers, so streamed bodies are not included
+    host = urlsplit(normalized).netloc
+    started = time.perf_counter()
     try:
-        client = get_client()
-        response = client.request(method, url, params=params, json=json_body, headers=headers)
-        if response.status_code >= 400:
-            logger.warning("ERPNext error %s for %s", response.status_code, url)
-        return response
+        response = await backend.client.send(request, stream=stream)
+    except httpx.PoolTimeout as exc:
+        # Our own per-tenant concurrency cap, not a backend failure
+        backend.breaker.release()
+        erpnext_upstream_seconds.observe(time.perf_counter() - started, host, method, "pool_timeout")
+        logger.warning("ERPNext connection pool exhausted for %s", normalized)
+        raise ERPNextUnavailable("ERPNext busy") from exc
     except httpx.RequestError as exc:
+        backend.breaker.record_failure()
+        erpnext_upstream_seconds.observe(time.perf_counter() - started, host, method, "error")
         logger.error("ERPNext request failed: %s", exc)
         raise ERPNextError("ERPNext request failed") from exc
+    except BaseException:
+        # Cancelled (client went away): no verdict on the backend
+        backend.breaker.release()
+        raise
+    erpnext_upstream_seconds.observe(time.perf_counter() - started, host, method, str(response.status_code))
 
+    if response.status_code >= 500:
+        backend.breaker.record_failure()
+    else:
+        backend.breaker.record_success()
+    if response.status_code >= 400:
+        logger.warning("ERPNext error %s for %s", response.status_code, url)
+    return response
 
-def default_fields(fields: list[str]) -> str:
-    return json.dumps(fields, separators=(",", ":"))
+
+async def close_clients() -> None:
+    backends = list(_backends.values())
+    _backends.clear()
+    await asyncio.gather(*(backend.client.aclose() for backend in backends), return_exceptions=True)
 
 
-@lru_cache
-def get_client() -> httpx.Client:
-    settings = get_settings()
-    timeout = httpx.Timeout(settings.erp_timeout_seconds)
-    return httpx.Client(timeout=timeout)
+def default_fields(fields: list[str]) -> str:
+    return json.dumps(fields, separators=(",", ":"))
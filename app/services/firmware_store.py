@@ -0,0 +1,328 @@
+"""Content-addressed storage for firmware files.
+
+Every file handed to devices (full image, compressed variant, delta patch) is
+stored once at objects/<first two hex digits>/<sha256> under the firmware
+directory. A path names its bytes forever, so identical uploads share one
+file, releases never overwrite each other, and responses for an object can be
+cached as immutable.
+
+Next to each object a <sha256>.json sidecar holds what was verified at ingest
+(size, hash, parsed app descriptor) and the size and mtime the object had
+then. The integrity scan only re-hashes objects whose stat no longer matches
+their sidecar.
+
+Objects are shared, so writers serialise per hash with a transaction-level
+advisory lock (lock_objects): a row that starts pointing at an object takes
+it before put() and keeps it until commit, and remove_unreferenced re-checks
+references under it. An object is never removed while a new row adopts it.
+Every put() stamps its sidecar with staged_at, and objects staged within the
+grace period are kept even when nothing references them yet: /admin/upload
+stores an object that a later create_firmware registers. The startup scan
+sweeps unreferenced objects older than that.
+"""
+import hashlib
+import json
+import logging
+import os
+import re
+import time
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Iterable
+
+from sqlalchemy import text
+from sqlalchemy.orm import Session
+
+from app.models.firmware import Firmware, FirmwarePatch
+from app.utils.time import utcnow
+
+logger = logging.getLogger(__name__)
+
+OBJECTS_DIR = "objects"
+SIDECAR_SUFFIX = ".json"
+CORRUPT_SUFFIX = ".corrupt"
+HASH_CHUNK_SIZE = 64 * 1024
+# Unreferenced objects younger than this may still be registered by create_firmware
+DEFAULT_GRACE_SECONDS = 24 * 60 * 60
+SWEEP_BATCH_SIZE = 100
+
+_OBJECT_PATH_RE = re.compile(rf"^{OBJECTS_DIR}/([0-9a-f]{{2}})/([0-9a-f]{{64}})$")
+_OBJECT_NAME_RE = re.compile(r"^[0-9a-f]{64}$")
+# First key of the two-key advisory locks taken per object hash
+_OBJECT_LOCK_NAMESPACE = 0x46574F42
+
+
+def object_relative_path(sha256: str) -> str:
+    sha256 = sha256.lower()
+    return f"{OBJECTS_DIR}/{sha256[:2]}/{sha256}"
+
+
+def object_hash(relative_path: str | None) -> str | None:
+    """The SHA-256 an object path is named after, or None for other paths."""
+    match = _OBJECT_PATH_RE.match((relative_path or "").lstrip("/"))
+    if not match or not match.group(2).startswith(match.group(1)):
+        return None
+    return match.group(2)
+
+
+def hash_file(path: Path) -> str:
+    sha256_hash = hashlib.sha256()
+    with open(path, "rb") as f:
+        for block in iter(lambda: f.read(HASH_CHUNK_SIZE), b""):
+            sha256_hash.update(block)
+    return sha256_hash.hexdigest()
+
+
+@dataclass
+class ScanResult:
+    objects: int = 0
+    rehashed: int = 0
+    corrupt: int = 0
+
+
+class FirmwareStore:
+    """Object files and sidecars under one firmware directory."""
+
+    def __init__(self, base_path: Path):
+        self.base_path = Path(base_path)
+
+    def path_for(self, relative_path: str) -> Path:
+        return self.base_path / relative_path.lstrip("/")
+
+    def put(self, tmp_path: Path, sha256: str, size: int, app_desc: dict | None = None) -> str:
+        """Move a hashed temp file into the store and return its relative path.
+
+        The caller computed sha256 while writing tmp_path. If a verified object
+        with that hash is already stored, the temp file is dropped and the
+        existing one is shared.
+        """
+        relative_path = object_relative_path(sha256)
+        dest = self.path_for(relative_path)
+        meta = self._fresh_metadata(dest)
+        if meta and meta["size"] == size:
+            tmp_path.unlink(missing_ok=True)
+            if app_desc and not meta.get("app_desc"):
+                meta["app_desc"] = app_desc
+            meta["staged_at"] = time.time()
+            self._write_sidecar(dest, meta)
+            return relative_path
+
+        dest.parent.mkdir(parents=True, exist_ok=True)
+        os.replace(tmp_path, dest)
+        self._record(dest, sha256.lower(), app_desc, staged_at=time.time())
+        return relative_path
+
+    def metadata(self, relative_path: str) -> dict | None:
+        """Sidecar of an object whose file is unchanged since it was verified."""
+        if not object_hash(relative_path):
+            return None
+        return self._fresh_metadata(self.path_for(relative_path))
+
+    def verified_hash(self, relative_path: str) -> str | None:
+        """SHA-256 of an object that needs no re-hashing, else None."""
+        meta = self.metadata(relative_path)
+        return meta["sha256"] if meta else None
+
+    def recently_staged(self, relative_path: str, grace_seconds: float, now: float | None = None) -> bool:
+        """Whether put() stored or reused the object within grace_seconds."""
+        path = self.path_for(relative_path)
+        staged_at = (self._read_sidecar(path) or {}).get("staged_at")
+        if staged_at is None:
+            try:
+                staged_at = path.stat().st_mtime
+            except FileNotFoundError:
+                return False
+        return (now or time.time()) - staged_at < grace_seconds
+
+    def object_paths(self) -> list[str]:
+        objects_path = self.base_path / OBJECTS_DIR
+        if not objects_path.is_dir():
+            return []
+        return [
+            f"{OBJECTS_DIR}/{path.parent.name}/{path.name}"
+            for path in sorted(objects_path.glob("??/*"))
+            if _OBJECT_NAME_RE.match(path.name) and path.is_file()
+        ]
+
+    def remove(self, relative_path: str) -> None:
+        path = self.path_for(relative_path)
+        path.unlink(missing_ok=True)
+        if object_hash(relative_path):
+            self._sidecar_path(path).unlink(missing_ok=True)
+
+    def scan(self, full: bool = False) -> ScanResult:
+        """Verify stored objects, re-hashing only those whose stat changed.
+
+        With full=True every object is re-hashed. Objects that no longer match
+        their name are renamed to <sha256>.corrupt, so they are not served and
+        a re-upload of the same image stores a good copy.
+        """
+        result = ScanResult()
+        objects_path = self.base_path / OBJECTS_DIR
+        if not objects_path.is_dir():
+            return result
+        for path in sorted(objects_path.glob("??/*")):
+            if not _OBJECT_NAME_RE.match(path.name) or not path.is_file():
+                continue
+            result.objects += 1
+            if not full and self._fresh_metadata(path):
+                continue
+            result.rehashed += 1
+            try:
+                digest = hash_file(path)
+            except FileNotFoundError:
+                continue  # Removed with its release while the scan ran
+            if digest == path.name:
+                previous = self._read_sidecar(path) or {}
+                self._record(path, path.name, previous.get("app_desc"), previous.get("staged_at"))
+                continue
+            result.corrupt += 1
+            logger.error(f"Firmware object {path.name} does not match its hash, quarantined")
+            os.replace(path, path.with_name(path.name + CORRUPT_SUFFIX))
+            self._sidecar_path(path).unlink(missing_ok=True)
+        return result
+
+    def _record(self, path: Path, sha256: str, app_desc: dict | None, staged_at: float | None = None) -> None:
+        stat = path.stat()
+        self._write_sidecar(
+            path,
+            {
+                "sha256": sha256,
+                "size": stat.st_size,
+                "app_desc": app_desc,
+                "mtime_ns": stat.st_mtime_ns,
+                "verified_at": utcnow().isoformat(),
+                "staged_at": staged_at,
+            },
+        )
+
+    def _fresh_metadata(self, path: Path) -> dict | None:
+        meta = self._read_sidecar(path)
+        if not meta or meta.get("sha256") != path.name:
+            return None
+        try:
+            stat = path.stat()
+        except FileNotFoundError:
+            return None
+        if stat.st_size != meta.get("size") or stat.st_mtime_ns != meta.get("mtime_ns"):
+            return None
+        return meta
+
+    @staticmethod
+    def _sidecar_path(path: Path) -> Path:
+        return path.with_name(path.name + SIDECAR_SUFFIX)
+
+    def _read_sidecar(self, path: Path) -> dict | None:
+        try:
+            with open(self._sidecar_path(path), encoding="utf-8") as f:
+                meta = json.load(f)
+        except (OSError, ValueError):
+            return None
+        return meta if isinstance(meta, dict) else None
+
+    def _write_sidecar(self, path: Path, meta: dict) -> None:
+        sidecar = self._sidecar_path(path)
+        tmp = sidecar.with_name(f".{sidecar.name}.part")
+        with open(tmp, "w", encoding="utf-8") as f:
+            json.dump(meta, f, separators=(",", ":"))
+        os.replace(tmp, sidecar)
+
+
+def app_desc_metadata(version: str | None, build: int | None, raw_version: str | None) -> dict | None:
+    """Sidecar form of parse_esp_app_desc_version's result."""
+    if not version and not raw_version:
+        return None
+    return {"version": version, "build": build, "raw": raw_version}
+
+
+def referenced_paths(db: Session, relative_paths: Iterable[str]) -> set[str]:
+    """Which of the paths some firmware or patch row still points at."""
+    paths = {path for path in relative_paths if path}
+    if not paths:
+        return set()
+    referenced: set[str] = set()
+    for binary_path, compressed_path in db.query(Firmware.binary_path, Firmware.compressed_path).filter(
+        Firmware.binary_path.in_(paths) | Firmware.compressed_path.in_(paths)
+    ):
+        referenced.update({binary_path, compressed_path})
+    referenced.update(
+        patch_path
+        for (patch_path,) in db.query(FirmwarePatch.patch_path).filter(FirmwarePatch.patch_path.in_(paths))
+    )
+    return referenced & paths
+
+
+def lock_objects(db: Session, relative_paths: Iterable[str | None]) -> None:
+    """Lock the objects behind these paths until the transaction ends.
+
+    Paths outside the object layout are not shared and need no lock.
+    """
+    for sha256 in sorted({sha256 for sha256 in map(object_hash, relative_paths) if sha256}):
+        key = int.from_bytes(bytes.fromhex(sha256[:8]), "big", signed=True)
+        db.execute(
+            text("SELECT pg_advisory_xact_lock(:namespace, :key)"),
+            {"namespace": _OBJECT_LOCK_NAMESPACE, "key": key},
+        )
+
+
+def remove_unreferenced(
+    db: Session,
+    store: FirmwareStore,
+    relative_paths: Iterable[str | None],
+    grace_seconds: float = DEFAULT_GRACE_SECONDS,
+) -> set[str]:
+    """Remove the files no firmware or patch row points at any more; returns them.
+
+    Objects staged within grace_seconds are kept: an upload may be about to
+    register them. Run after the rows that dropped their references are
+    committed. Commits its own transaction to release the object locks.
+    """
+    paths = {path for path in relative_paths if path}
+    try:
+        lock_objects(db, paths)
+        orphaned = {
+            path
+            for path in paths - referenced_paths(db, paths)
+            if not (object_hash(path) and store.recently_staged(path, grace_seconds))
+        }
+        for path in orphaned:
+            store.remove(path)
+    finally:
+        db.commit()
+    return orphaned
+
+
+def sweep_unreferenced(db: Session, store: FirmwareStore, grace_seconds: float = DEFAULT_GRACE_SECONDS) -> int:
+    """Remove objects nothing references, such as uploads never registered."""
+    paths = [path for path in store.object_paths() if not store.recently_staged(path, grace_seconds)]
+    removed = 0
+    for start in range(0, len(paths), SWEEP_BATCH_SIZE):
+        removed += len(remove_unreferenced(db, store, paths[start : start + SWEEP_BATCH_SIZE], grace_seconds))
+    return removed
+
+
+def verify_store_task(
+    firmware_base_path: str = "firmware",
+    full: bool = False,
+    grace_seconds: float = DEFAULT_GRACE_SECONDS,
+) -> ScanResult:
+    """Startup integrity scan, then a sweep of old unreferenced objects.
+
+    The scan is cheap when nothing changed since the last one.
+    """
+    from app.db import SessionLocal
+
+    store = FirmwareStore(Path(firmware_base_path))
+    result = store.scan(full=full)
+    logger.info(
+        f"Firmware store scan: {result.objects} objects, "
+        f"{result.rehashed} re-hashed, {result.corrupt} corrupt"
+    )
+    db = SessionLocal()
+    try:
+        removed = sweep_unreferenced(db, store, grace_seconds)
+    finally:
+        db.close()
+    if removed:
+        logger.info(f"Removed {removed} unreferenced firmware objects")
+    return result
@@ -2,6 +2,8 @@ import bcrypt
 import hashlib
 import re
 
+from app.services.metrics import bcrypt_seconds
+
 _UUID_HEX_RE = re.compile(r"^[0-9a-fA-F]{32}$")
 
 
@@ -29,7 +31,8 @@ def hash_license_key(license_key: str) -> str:
 
 def verify_license_key(license_key: str, hashed_key: str) -> bool:
     try:
-        return bcrypt.checkpw(license_key.encode("utf-8"), hashed_key.encode("utf-8"))
+        with bcrypt_seconds.time():
+            return bcrypt.checkpw(license_key.encode("utf-8"), hashed_key.encode("utf-8"))
     except ValueError:
         return False
 
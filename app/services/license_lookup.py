@@ -0,0 +1,204 @@
+"""License key lookup for activation.
+
+Keys are found through the unique fingerprint index (SHA-256 of the
+normalized key) and confirmed with a single bcrypt verify. Keys created before
+fingerprints existed have none; matching those needs a bcrypt scan over the
+tenant's legacy keys, loaded LICENSE_LEGACY_SCAN_LIMIT at a time and at most
+LICENSE_LEGACY_SCAN_MAX_KEYS per attempt. Only activations that name their
+tenant (company_code) scan; without one a legacy key cannot match. A scan is
+counted as a scan fallback and backfills the fingerprint on success, so each
+legacy key is scanned for once; a miss is cached per (tenant, fingerprint).
+The bcrypt checks go to the verification pool LICENSE_LEGACY_VERIFY_BATCH at a
+time, so other tenants' jobs interleave with a long scan, and each tenant may
+run at most LICENSE_LEGACY_MAX_SCANS scans at once, so garbage keys sent to
+one tenant cannot take another tenant's slot.
+"""
+import logging
+import threading
+import time
+import uuid
+
+from sqlalchemy import tuple_
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models import LicenseKey, LicenseKeyStatus
+from app.services.license import fingerprint_license_key, verify_license_key_flexible
+from app.services.metrics import counters
+from app.services.verify_pool import VerificationPoolSaturated, get_verification_pool
+
+logger = logging.getLogger(__name__)
+
+SCAN_FALLBACKS_METRIC = "license_scan_fallbacks"
+MISS_CACHE_MAX_SIZE = 10_000
+
+
+class FingerprintMissCache:
+    """Fingerprints that recently matched no legacy key, so retries skip the scan.
+
+    Entries are keyed by miss_key(tenant_id, fingerprint): a miss in one
+    tenant says nothing about another tenant's keys.
+    """
+
+    def __init__(self, max_size: int = MISS_CACHE_MAX_SIZE) -> None:
+        self.max_size = max_size
+        self._lock = threading.Lock()
+        self._expires: dict[str, float] = {}
+
+    def contains(self, fingerprint: str, now: float | None = None) -> bool:
+        now = now or time.monotonic()
+        with self._lock:
+            expires_at = self._expires.get(fingerprint)
+            if expires_at is None:
+                return False
+            if expires_at <= now:
+                del self._expires[fingerprint]
+                return False
+            return True
+
+    def add(self, fingerprint: str, ttl_seconds: float, now: float | None = None) -> None:
+        now = now or time.monotonic()
+        with self._lock:
+            if len(self._expires) >= self.max_size:
+                self._expires = {key: value for key, value in self._expires.items() if value > now}
+                if len(self._expires) >= self.max_size:
+                    self._expires.pop(next(iter(self._expires)))
+            self._expires[fingerprint] = now + ttl_seconds
+
+
+legacy_miss_cache = FingerprintMissCache()
+
+
+def miss_key(tenant_id: uuid.UUID | None, fingerprint: str) -> str:
+    return f"{tenant_id or '*'}:{fingerprint}"
+
+
+_scan_slots_lock = threading.Lock()
+_scan_slots: dict[uuid.UUID, threading.BoundedSemaphore] = {}
+
+
+def _legacy_scan_slots(tenant_id: uuid.UUID) -> threading.BoundedSemaphore:
+    with _scan_slots_lock:
+        slots = _scan_slots.get(tenant_id)
+        if slots is None:
+            slots = _scan_slots[tenant_id] = threading.BoundedSemaphore(
+                max(1, get_settings().license_legacy_max_scans)
+            )
+        return slots
+
+
+def find_license_key(db: Session, raw_key: str, tenant_id: uuid.UUID | None = None) -> LicenseKey | None:
+    """Return the active license key matching raw_key, optionally within a tenant.
+
+    bcrypt runs on the verification pool; raises VerificationPoolSaturated
+    when it is full.
+    """
+    fingerprint = fingerprint_license_key(raw_key)
+    if not fingerprint:
+        return None
+
+    key = db.query(LicenseKey).filter(LicenseKey.fingerprint == fingerprint).first()
+    if key is not None:
+        if key.status != LicenseKeyStatus.active:
+            return None
+        if tenant_id is not None and key.tenant_id != tenant_id:
+            return None
+        verified = get_verification_pool().run(
+            str(key.tenant_id), verify_license_key_flexible, raw_key, key.hashed_key
+        )
+        return key if verified else None
+
+    return _scan_legacy_keys(db, raw_key, fingerprint, tenant_id)
+
+
+def _scan_legacy_keys(
+    db: Session,
+    raw_key: str,
+    fingerprint: str,
+    tenant_id: uuid.UUID | None,
+) -> LicenseKey | None:
+    settings = get_settings()
+    max_keys = settings.license_legacy_scan_max_keys
+    page_size = min(settings.license_legacy_scan_limit, max_keys)
+    cache_key = miss_key(tenant_id, fingerprint)
+    # Without a tenant the scan would cover every tenant's keys
+    if tenant_id is None or page_size <= 0 or legacy_miss_cache.contains(cache_key):
+        return None
+
+    query = db.query(LicenseKey).filter(
+        LicenseKey.status == LicenseKeyStatus.active,
+        LicenseKey.fingerprint.is_(None),
+        LicenseKey.tenant_id == tenant_id,
+    )
+    pool_key = str(tenant_id)
+
+    # A full scan can take seconds of bcrypt; beyond the limit, fail fast (429)
+    slots = _legacy_scan_slots(tenant_id)
+    if not slots.acquire(blocking=False):
+        raise VerificationPoolSaturated(pool_key)
+    try:
+        scanned = 0
+        last = None
+        while scanned < max_keys:
+            page_query = query
+            if last is not None:
+                page_query = page_query.filter(tuple_(LicenseKey.created_at, LicenseKey.id) > last)
+            candidates = (
+                page_query.order_by(LicenseKey.created_at.asc(), LicenseKey.id.asc())
+                .limit(min(page_size, max_keys - scanned))
+                .all()
+            )
+            if not candidates:
+                break
+            if scanned == 0:
+                counters.increment(SCAN_FALLBACKS_METRIC)
+            scanned += len(candidates)
+
+            candidate = _match_candidates(pool_key, raw_key, candidates, settings.license_legacy_verify_batch)
+            if candidate is not None:
+                candidate.fingerprint = fingerprint
+                logger.info("Backfilled fingerprint for legacy license key %s", candidate.id)
+                return candidate
+            if len(candidates) < page_size:
+                break
+            last = (candidates[-1].created_at, candidates[-1].id)
+    finally:
+        slots.release()
+
+    if scanned > page_size:
+        logger.warning(
+            "Legacy license scan checked %s keys%s; run scripts/backfill_license_fingerprints.py",
+            scanned,
+            " (LICENSE_LEGACY_SCAN_MAX_KEYS reached)" if scanned >= max_keys else "",
+        )
+    if scanned:
+        legacy_miss_cache.add(cache_key, settings.license_legacy_miss_ttl_seconds)
+    return None
+
+
+def _match_candidates(pool_key: str, raw_key: str, candidates: list[LicenseKey], batch_size: int) -> LicenseKey | None:
+    """Verify in small pool jobs; each holds a worker for batch_size bcrypt checks at most."""
+    batch_size = max(1, batch_size)
+    pool = get_verification_pool()
+    for start in range(0, len(candidates), batch_size):
+        batch = candidates[start : start + batch_size]
+        index = pool.run(pool_key, _find_matching_hash, raw_key, [candidate.hashed_key for candidate in batch])
+        if index is not None:
+            return batch[index]
+    return None
+
+
+def _find_matching_hash(raw_key: str, hashed_keys: list[str]) -> int | None:
+    return next(
+        (index for index, hashed_key in enumerate(hashed_keys) if verify_license_key_flexible(raw_key, hashed_key)),
+        None,
+    )
+
+
+def count_legacy_keys(db: Session) -> int:
+    """Active keys still without a fingerprint."""
+    return (
+        db.query(LicenseKey)
+        .filter(LicenseKey.status == LicenseKeyStatus.active, LicenseKey.fingerprint.is_(None))
+        .count()
+    )
@@ -0,0 +1,164 @@
+"""Process-local counters and histograms, exposed in Prometheus text format.
+
+Metrics are plain in-memory structures guarded by one lock each, so recording
+on the hot path costs a dict lookup and a bisect. Label values must come from
+small fixed sets (route templates, status names, limiter names, ERPNext hosts),
+never from request data such as IDs or keys.
+"""
+import threading
+import time
+from bisect import bisect_left
+from contextlib import contextmanager
+from contextvars import ContextVar
+from typing import Iterator
+
+# Route template of the request being served, for labelling work done inside it
+current_route: ContextVar[str] = ContextVar("current_route", default="none")
+
+LATENCY_BUCKETS = (0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0)
+
+
+class Counters:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._values: dict[str, int] = {}
+
+    def increment(self, name: str, amount: int = 1) -> None:
+        with self._lock:
+            self._values[name] = self._values.get(name, 0) + amount
+
+    def get(self, name: str) -> int:
+        with self._lock:
+            return self._values.get(name, 0)
+
+    def snapshot(self) -> dict[str, int]:
+        with self._lock:
+            return dict(self._values)
+
+
+counters = Counters()
+
+
+def _escape(value: str) -> str:
+    return value.replace("\\", "\\\\").replace('"', '\\"').replace("\n", " ")
+
+
+def _format_labels(labelnames: tuple[str, ...], values: tuple[str, ...], le: str | None = None) -> str:
+    pairs = [f'{name}="{_escape(value)}"' for name, value in zip(labelnames, values)]
+    if le is not None:
+        pairs.append(f'le="{le}"')
+    return "{" + ",".join(pairs) + "}" if pairs else ""
+
+
+class Counter:
+    def __init__(self, name: str, documentation: str, labelnames: tuple[str, ...] = ()) -> None:
+        self.name = name
+        self.documentation = documentation
+        self.labelnames = labelnames
+        self._lock = threading.Lock()
+        self._values: dict[tuple[str, ...], float] = {}
+
+    def inc(self, *labels: str, amount: float = 1) -> None:
+        with self._lock:
+            self._values[labels] = self._values.get(labels, 0) + amount
+
+    def value(self, *labels: str) -> float:
+        with self._lock:
+            return self._values.get(labels, 0)
+
+    def render(self) -> list[str]:
+        with self._lock:
+            values = sorted(self._values.items())
+        lines = [f"# HELP {self.name} {self.documentation}", f"# TYPE {self.name} counter"]
+        lines += [f"{self.name}{_format_labels(self.labelnames, labels)} {value}" for labels, value in values]
+        return lines
+
+
+class Histogram:
+    def __init__(
+        self,
+        name: str,
+        documentation: str,
+        labelnames: tuple[str, ...] = (),
+        buckets: tuple[float, ...] = LATENCY_BUCKETS,
+    ) -> None:
+        self.name = name
+        self.documentation = documentation
+        self.labelnames = labelnames
+        self.buckets = buckets
+        self._lock = threading.Lock()
+        # labels -> (per-bucket counts with a trailing +Inf slot, sum)
+        self._values: dict[tuple[str, ...], tuple[list[int], list[float]]] = {}
+
+    def observe(self, value: float, *labels: str) -> None:
+        index = bisect_left(self.buckets, value)
+        with self._lock:
+            entry = self._values.get(labels)
+            if entry is None:
+                entry = self._values[labels] = ([0] * (len(self.buckets) + 1), [0.0])
+            entry[0][index] += 1
+            entry[1][0] += value
+
+    @contextmanager
+    def time(self, *labels: str) -> Iterator[None]:
+        started = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.observe(time.perf_counter() - started, *labels)
+
+    def count(self, *labels: str) -> int:
+        with self._lock:
+            entry = self._values.get(labels)
+            return sum(entry[0]) if entry else 0
+
+    def render(self) -> list[str]:
+        with self._lock:
+            values = sorted((labels, (list(counts), total[0])) for labels, (counts, total) in self._values.items())
+        lines = [f"# HELP {self.name} {self.documentation}", f"# TYPE {self.name} histogram"]
+        for labels, (counts, total) in values:
+            cumulative = 0
+            for bound, count in zip(self.buckets, counts):
+                cumulative += count
+                lines.append(f"{self.name}_bucket{_format_labels(self.labelnames, labels, str(bound))} {cumulative}")
+            cumulative += counts[-1]
+            lines.append(f"{self.name}_bucket{_format_labels(self.labelnames, labels, '+Inf')} {cumulative}")
+            lines.append(f"{self.name}_sum{_format_labels(self.labelnames, labels)} {total}")
+            lines.append(f"{self.name}_count{_format_labels(self.labelnames, labels)} {cumulative}")
+        return lines
+
+
+http_request_seconds = Histogram(
+    "http_request_duration_seconds", "HTTP request latency by route template", ("route", "method", "status")
+)
+db_query_seconds = Histogram("db_query_duration_seconds", "Database statement latency by route", ("route",))
+bcrypt_seconds = Histogram("bcrypt_verify_duration_seconds", "bcrypt license key verification time")
+erpnext_upstream_seconds = Histogram(
+    "erpnext_upstream_duration_seconds", "ERPNext time to response headers", ("host", "method", "status")
+)
+firmware_bytes_served = Counter("ota_firmware_bytes_served_total", "Firmware bytes sent to devices", ("kind",))
+rate_limit_rejections = Counter("rate_limit_rejections_total", "Requests refused by a rate limiter", ("limiter",))
+ota_status_transitions = Counter(
+    "ota_status_transitions_total", "OTA log status changes", ("from_status", "to_status")
+)
+
+REGISTRY = (
+    http_request_seconds,
+    db_query_seconds,
+    bcrypt_seconds,
+    erpnext_upstream_seconds,
+    firmware_bytes_served,
+    rate_limit_rejections,
+    ota_status_transitions,
+)
+
+
+def render_metrics() -> str:
+    """Prometheus text exposition (format 0.0.4) of all metrics in this process."""
+    lines: list[str] = []
+    for metric in REGISTRY:
+        lines += metric.render()
+    # Ad-hoc named counters (e.g. license_scan_fallbacks)
+    for name, value in sorted(counters.snapshot().items()):
+        lines += [f"# TYPE {name}_total counter", f"{name}_total {value}"]
+    return "\n".join(lines) + "\n"
@@ -1,17 +1,48 @@
 """OTA (Over-The-Air) update service."""
 import hashlib
 import logging
+import os
+import tempfile
+from dataclasses import dataclass
 from datetime import datetime
 from pathlib import Path
-from typing import Optional
+from typing import Iterable, Optional, Sequence
 
+from sqlalchemy import func, select
+from sqlalchemy.ext.asyncio import AsyncSession
 from sqlalchemy.orm import Session
 
-from app.models.firmware import Firmware, DeviceOTALog
-from app.schemas.ota import OTACheckRequest, OTACheckResponse, OTAStatusUpdate
+from app.models.firmware import Firmware, FirmwareRolloutStat, DeviceOTALog
+from app.schemas.ota import OTACheckRequest, OTACheckResponse, OTAStatusEvent, OTAStatusUpdate
+from app.services.firmware_store import FirmwareStore, hash_file
+from app.services.metrics import ota_status_transitions
+from app.services.ota_index import FirmwareIndexEntry, firmware_index, parse_version
+from app.services.ota_progress import progress_buffer
+from app.services.ota_rollout import THROTTLED, in_wave, rollout_scheduler
 
 logger = logging.getLogger(__name__)
 
+# Chunk size for streaming firmware uploads. The ESP app descriptor lives in the
+# first few hundred bytes, so the first chunk is always enough to parse it.
+UPLOAD_CHUNK_SIZE = 64 * 1024
+
+# Statuses are free-form device input; anything else shares one metric label
+KNOWN_STATUSES = frozenset({"pending", "downloading", "installing", "success", "failed"})
+
+
+def _status_label(value: str | None) -> str:
+    return value if value in KNOWN_STATUSES else "other"
+
+
+@dataclass
+class StagedUpload:
+    """Firmware upload written to a temp file but not yet moved into place."""
+
+    path: Path
+    file_hash: str
+    file_size: int
+    header: bytes
+
 
 class OTAService:
     """Service for managing OTA updates."""
@@ -24,6 +55,7 @@ class OTAService:
         """
         self.firmware_path = Path(firmware_base_path)
         self.firmware_path.mkdir(parents=True, exist_ok=True)
+        self.store = FirmwareStore(self.firmware_path)
 
     def check_update_available(
         self,
@@ -39,31 +71,9 @@ class OTAService:
         Returns:
             OTACheckResponse with update details if available
         """
-        # Find latest stable firmware for this device type
-        firmwares = (
-            db.query(Firmware)
-            .filter(
-                Firmware.device_type == request.device_type,
-                Firmware.is_active == True,
-                Firmware.is_stable == True,
-            )
-            .all()
-        )
-
-        latest_firmware = None
-        latest_version = None
-        for firmware in firmwares:
-            parsed = self._parse_version(firmware.version)
-            if parsed is None:
-                continue
-            if latest_firmware is None or (parsed, firmware.build_number) > (
-                latest_version,
-                latest_firmware.build_number,
-            ):
-                latest_firmware = firmware
-                latest_version = parsed
-
-        if not latest_firmware:
+        # Latest stable firmware whose rollout wave includes this device
+        latest = self._release_for(db, request)
+        if not latest:
             return OTACheckResponse(update_available=False)
 
         # Check if update is needed (version comparison)
@@ -72,37 +82,107 @@ class OTAService:
             logger.warning(f"Invalid current version format: {request.current_version}")
             return OTACheckResponse(update_available=False)
 
-        is_newer_version = latest_version > current_version
-        is_newer_build = latest_version == current_version and (
-            latest_firmware.build_number > request.current_build
-        )
+        if (latest.parsed_version, latest.build_number) <= (current_version, request.current_build):
+            return OTACheckResponse(update_available=False)
 
-        if is_newer_version or is_newer_build:
-            # Check minimum version requirement
-            if (
-                latest_firmware.min_current_version
-                and not self._is_version_gte(
-                    request.current_version, latest_firmware.min_current_version
-                )
-            ):
-                logger.warning(
-                    f"Device {request.device_id} version {request.current_version} "
-                    f"is too old. Minimum required: {latest_firmware.min_current_version}"
-                )
-                return OTACheckResponse(update_available=False)
-
-            return OTACheckResponse(
-                update_available=True,
-                firmware_id=latest_firmware.id,
-                version=latest_firmware.version,
-                build_number=latest_firmware.build_number,
-                description=latest_firmware.description,
-                download_url=f"/api/ota/download/{latest_firmware.id}",
-                file_hash=latest_firmware.file_hash,
-                file_size=latest_firmware.file_size,
+        # Check minimum version requirement
+        if not latest.allows_upgrade_from(current_version):
+            logger.warning(
+                f"Device {request.device_id} version {request.current_version} "
+                f"is too old. Minimum required: {latest.min_current_version}"
             )
+            return OTACheckResponse(update_available=False)
+
+        admission = rollout_scheduler.admit(
+            db, latest.firmware_id, request.device_id, latest.max_concurrent_downloads
+        )
+        if admission == THROTTLED:
+            return OTACheckResponse(update_available=False, throttled=True)
+
+        response = OTACheckResponse(
+            update_available=True,
+            firmware_id=latest.firmware_id,
+            version=latest.version,
+            build_number=latest.build_number,
+            description=latest.description,
+            download_url=f"/api/ota/download/{latest.firmware_id}",
+            file_hash=latest.file_hash,
+            file_size=latest.file_size,
+        )
+        patch = latest.patches.get((request.current_version, request.current_build))
+        if patch:
+            response.patch_from_firmware_id = patch.source_firmware_id
+            response.patch_url = f"/api/ota/download/{latest.firmware_id}/patch/{patch.source_firmware_id}"
+            response.patch_hash = patch.patch_hash
+            response.patch_size = patch.patch_size
+            response.patch_compression = patch.compression
+        if latest.compression:
+            response.compression = latest.compression
+            response.compressed_url = f"/api/ota/download/{latest.firmware_id}/compressed"
+            response.compressed_hash = latest.compressed_hash
+            response.compressed_size = latest.compressed_size
+        return response
+
+    def check_etag(self, db: Session, request: OTACheckRequest) -> str:
+        """ETag of the /check answer for this device.
+
+        Covers the device's current build and everything about the latest
+        release in its rollout wave that can change the answer, so a device
+        that saw "no update" can skip the full reply while the tag stays the same.
+
+        Args:
+            db: Database session
+            request: OTA check request with device info
+
+        Returns:
+            Quoted entity tag
+        """
+        latest = self._release_for(db, request)
+        parts = [request.device_type, request.current_version, str(request.current_build)]
+        if latest:
+            parts += [
+                str(latest.firmware_id),
+                latest.file_hash,
+                latest.min_current_version or "",
+                str((request.current_version, request.current_build) in latest.patches),
+            ]
+        digest = hashlib.sha256("\x1f".join(parts).encode()).hexdigest()
+        return f'"{digest[:16]}"'
+
+    @staticmethod
+    def _release_for(db: Session, request: OTACheckRequest) -> Optional[FirmwareIndexEntry]:
+        """Newest stable release whose rollout wave includes the device."""
+        for entry in firmware_index.entries_for(db, request.device_type):
+            if in_wave(entry.firmware_id, request.device_id, entry.rollout_percent):
+                return entry
+        return None
+
+    def get_rollout_stats(
+        self,
+        db: Session,
+        firmware_ids: Optional[Iterable[int]] = None,
+    ) -> dict[int, dict[str, int]]:
+        """Get OTA log counts per status for each firmware.
 
-        return OTACheckResponse(update_available=False)
+        Sums the trigger-maintained firmware_rollout_stats slots, so the cost
+        does not grow with device_ota_log.
+
+        Args:
+            db: Database session
+            firmware_ids: Restrict to these firmware IDs (all when None)
+
+        Returns:
+            firmware_id -> {status: count}, without zero counts
+        """
+        total = func.sum(FirmwareRolloutStat.count)
+        query = db.query(FirmwareRolloutStat.firmware_id, FirmwareRolloutStat.status, total)
+        if firmware_ids is not None:
+            query = query.filter(FirmwareRolloutStat.firmware_id.in_(list(firmware_ids)))
+        query = query.group_by(FirmwareRolloutStat.firmware_id, FirmwareRolloutStat.status).having(total > 0)
+        stats: dict[int, dict[str, int]] = {}
+        for firmware_id, status, count in query.all():
+            stats.setdefault(firmware_id, {})[status] = int(count)
+        return stats
 
     def get_firmware_for_download(self, db: Session, firmware_id: int) -> Optional[Firmware]:
         """Get firmware by ID for download.
@@ -142,17 +222,24 @@ class OTAService:
         """
         return self.get_firmware_binary_path(firmware).exists()
 
-    def verify_firmware_hash(self, firmware: Firmware, file_data: bytes) -> bool:
-        """Verify firmware binary against stored hash.
-        
+    def verify_firmware_hash(self, firmware: Firmware) -> bool:
+        """Verify the stored firmware binary against firmware.file_hash.
+
+        Store objects verified since their last change are trusted without
+        reading them; anything else is re-hashed in chunks.
+
         Args:
             firmware: Firmware object
-            file_data: Binary data to verify
-            
+
         Returns:
             True if hash matches
         """
-        calculated_hash = hashlib.sha256(file_data).hexdigest()
+        calculated_hash = self.store.verified_hash(firmware.binary_path)
+        if calculated_hash is None:
+            file_path = self.get_firmware_binary_path(firmware)
+            if not file_path.exists():
+                return False
+            calculated_hash = hash_file(file_path)
         return calculated_hash.lower() == firmware.file_hash.lower()
 
     def create_ota_log(
@@ -203,6 +290,147 @@ class OTAService:
         if not log:
             return None
 
+        self._apply_status(log, status_update)
+        db.commit()
+        db.refresh(log)
+        return log
+
+    def record_status_events(
+        self,
+        db: Session,
+        device_id: int,
+        events: Sequence[OTAStatusEvent],
+    ) -> dict[int, int]:
+        """Apply a device's status events in one transaction.
+
+        Progress for downloads already in "downloading" goes to the
+        write-behind progress buffer. Everything else loads the latest log
+        per firmware with a single query, creates missing ones and applies
+        the events in order, so the batch ends in the state of its last event.
+
+        Args:
+            db: Database session
+            device_id: Device ID
+            events: Status events, oldest first
+
+        Returns:
+            OTA log IDs keyed by firmware ID
+        """
+        log_ids, direct_events = self._buffer_progress_events(device_id, events)
+        if not direct_events:
+            return log_ids
+
+        latest = db.execute(self._latest_logs_query(device_id, direct_events)).scalars()
+        logs = self._apply_events(db, device_id, direct_events, latest)
+        db.flush()
+        log_ids.update({firmware_id: log.id for firmware_id, log in logs.items()})
+        final_status = {firmware_id: log.status for firmware_id, log in logs.items()}
+        db.commit()
+
+        self._track_downloads(device_id, final_status, log_ids)
+        return log_ids
+
+    async def record_status_events_async(
+        self,
+        db: AsyncSession,
+        device_id: int,
+        events: Sequence[OTAStatusEvent],
+    ) -> dict[int, int]:
+        """Same as record_status_events, on an asyncio session.
+
+        Args:
+            db: Async database session
+            device_id: Device ID
+            events: Status events, oldest first
+
+        Returns:
+            OTA log IDs keyed by firmware ID
+        """
+        log_ids, direct_events = self._buffer_progress_events(device_id, events)
+        if not direct_events:
+            return log_ids
+
+        latest = (await db.execute(self._latest_logs_query(device_id, direct_events))).scalars()
+        logs = self._apply_events(db, device_id, direct_events, latest)
+        await db.flush()
+        log_ids.update({firmware_id: log.id for firmware_id, log in logs.items()})
+        final_status = {firmware_id: log.status for firmware_id, log in logs.items()}
+        await db.commit()
+
+        self._track_downloads(device_id, final_status, log_ids)
+        return log_ids
+
+    @staticmethod
+    def _buffer_progress_events(
+        device_id: int, events: Sequence[OTAStatusEvent]
+    ) -> tuple[dict[int, int], list[OTAStatusEvent]]:
+        log_ids: dict[int, int] = {}
+        direct_events = []
+        for event in events:
+            # Progress for a download already known to be running is absorbed
+            # by the write-behind buffer, unless something earlier in this
+            # batch already needs the log row.
+            if (
+                event.status == "downloading"
+                and event.bytes_downloaded is not None
+                and not direct_events
+            ):
+                log_id = progress_buffer.record(device_id, event.firmware_id, event.bytes_downloaded)
+                if log_id is not None:
+                    log_ids[event.firmware_id] = log_id
+                    continue
+            direct_events.append(event)
+        return log_ids, direct_events
+
+    @staticmethod
+    def _latest_logs_query(device_id: int, events: Sequence[OTAStatusEvent]):
+        """Newest log per firmware in the batch; one row each (DISTINCT ON)."""
+        return (
+            select(DeviceOTALog)
+            .where(
+                DeviceOTALog.device_id == device_id,
+                DeviceOTALog.firmware_id.in_({event.firmware_id for event in events}),
+            )
+            .distinct(DeviceOTALog.firmware_id)
+            .order_by(DeviceOTALog.firmware_id, DeviceOTALog.created_at.desc(), DeviceOTALog.id.desc())
+        )
+
+    def _apply_events(
+        self,
+        db: Session | AsyncSession,
+        device_id: int,
+        events: Sequence[OTAStatusEvent],
+        latest: Iterable[DeviceOTALog],
+    ) -> dict[int, DeviceOTALog]:
+        logs: dict[int, DeviceOTALog] = {}
+        for log in latest:
+            if log.firmware_id not in logs:
+                logs[log.firmware_id] = log
+                pending = progress_buffer.take(log.id)
+                if pending:
+                    log.bytes_downloaded = pending.bytes_downloaded
+
+        for event in events:
+            log = logs.get(event.firmware_id)
+            if log is None:
+                log = DeviceOTALog(device_id=device_id, firmware_id=event.firmware_id, status="pending")
+                db.add(log)
+                logs[event.firmware_id] = log
+            self._apply_status(log, event)
+        return logs
+
+    @staticmethod
+    def _track_downloads(device_id: int, final_status: dict[int, str], log_ids: dict[int, int]) -> None:
+        for firmware_id, log_status in final_status.items():
+            if log_status == "downloading":
+                progress_buffer.track(device_id, firmware_id, log_ids[firmware_id])
+            else:
+                progress_buffer.forget(device_id, firmware_id)
+
+    @staticmethod
+    def _apply_status(log: DeviceOTALog, status_update: OTAStatusUpdate | OTAStatusEvent) -> None:
+        if log.status != status_update.status:
+            ota_status_transitions.inc(_status_label(log.status), _status_label(status_update.status))
         log.status = status_update.status
         if status_update.bytes_downloaded is not None:
             log.bytes_downloaded = status_update.bytes_downloaded
@@ -220,10 +448,6 @@ class OTAService:
         elif status_update.status == "success":
             log.installed_at = datetime.utcnow()
 
-        db.commit()
-        db.refresh(log)
-        return log
-
     @staticmethod
     def _is_newer_version(new_version: str, current_version: str) -> bool:
         """Compare semantic versions. Returns True if new_version > current_version.
@@ -253,13 +477,7 @@ class OTAService:
         Returns:
             Tuple of ints or None if invalid
         """
-        try:
-            parts = tuple(map(int, version.split(".")))
-            if len(parts) != 3:
-                return None
-            return parts
-        except (ValueError, AttributeError):
-            return None
+        return parse_version(version)
 
     @staticmethod
     def _is_version_gte(version: str, min_version: str) -> bool:
@@ -294,3 +512,65 @@ class OTAService:
             for byte_block in iter(lambda: f.read(4096), b""):
                 sha256_hash.update(byte_block)
         return sha256_hash.hexdigest()
+
+    async def stage_upload(self, upload, chunk_size: int = UPLOAD_CHUNK_SIZE) -> StagedUpload:
+        """Stream an uploaded file to a temp file under the firmware directory.
+
+        The SHA256 hash is updated as each chunk arrives and the first chunk is
+        kept as the header for app descriptor parsing, so the image is never
+        held in memory or read back from disk.
+
+        Args:
+            upload: Uploaded file exposing an async read(size) method
+            chunk_size: Bytes to read per chunk
+
+        Returns:
+            StagedUpload pointing at the temp file
+        """
+        sha256_hash = hashlib.sha256()
+        header = b""
+        file_size = 0
+        fd, tmp_name = tempfile.mkstemp(dir=self.firmware_path, prefix=".upload-", suffix=".part")
+        tmp_path = Path(tmp_name)
+        try:
+            with os.fdopen(fd, "wb") as f:
+                while True:
+                    chunk = await upload.read(chunk_size)
+                    if not chunk:
+                        break
+                    if len(header) < chunk_size:
+                        header += chunk[: chunk_size - len(header)]
+                    sha256_hash.update(chunk)
+                    f.write(chunk)
+                    file_size += len(chunk)
+                f.flush()
+                os.fsync(f.fileno())
+        except BaseException:
+            tmp_path.unlink(missing_ok=True)
+            raise
+        return StagedUpload(
+            path=tmp_path,
+            file_hash=sha256_hash.hexdigest(),
+            file_size=file_size,
+            header=header,
+        )
+
+    def commit_upload(self, staged: StagedUpload, app_desc: dict | None = None) -> str:
+        """Atomically move a staged upload into the content-addressed store.
+
+        An identical binary already stored (for any device type) is reused
+        and the staged file is dropped.
+
+        Args:
+            staged: Staged upload from stage_upload
+            app_desc: Parsed app descriptor to keep in the object metadata
+
+        Returns:
+            Object path relative to the firmware directory
+        """
+        return self.store.put(staged.path, staged.file_hash, staged.file_size, app_desc)
+
+    @staticmethod
+    def discard_upload(staged: StagedUpload) -> None:
+        """Remove a staged upload that will not be committed."""
+        staged.path.unlink(missing_ok=True)
@@ -0,0 +1,117 @@
+"""Compressed variants of full firmware images.
+
+ESP-IDF images shrink by roughly a third under heatshrink. Its decoder keeps a
+fixed 2^window_sz2-byte window on the device and no heap, so the ESP32 client
+can inflate straight into esp_ota_write. The parameters match the ones detools
+uses for patches, so one decoder build serves both.
+"""
+import hashlib
+import logging
+import os
+import tempfile
+from pathlib import Path
+
+import heatshrink2
+from sqlalchemy.orm import Session
+
+from app.models.firmware import Firmware
+from app.services.firmware_store import FirmwareStore, lock_objects, object_relative_path
+
+logger = logging.getLogger(__name__)
+
+COMPRESSION = "heatshrink"
+WINDOW_SZ2 = 8
+LOOKAHEAD_SZ2 = 7
+# Not worth a second download path unless it saves at least a tenth
+MAX_COMPRESSED_RATIO = 0.9
+
+
+def compress_file(src_path: Path, dest_dir: Path, chunk_size: int = 64 * 1024) -> tuple[Path, str, int]:
+    """Write a heatshrink-compressed copy to a temp file in dest_dir.
+
+    Returns (temp path, sha256, size) of the compressed file.
+    """
+    dest_dir.mkdir(parents=True, exist_ok=True)
+    fd, tmp_name = tempfile.mkstemp(dir=dest_dir, prefix=".compress-", suffix=".part")
+    os.close(fd)
+    tmp_path = Path(tmp_name)
+    try:
+        with open(src_path, "rb") as src, heatshrink2.open(
+            tmp_path, "wb", window_sz2=WINDOW_SZ2, lookahead_sz2=LOOKAHEAD_SZ2
+        ) as dest:
+            for block in iter(lambda: src.read(chunk_size), b""):
+                dest.write(block)
+        sha256_hash = hashlib.sha256()
+        with open(tmp_path, "rb") as f:
+            for block in iter(lambda: f.read(chunk_size), b""):
+                sha256_hash.update(block)
+        size = tmp_path.stat().st_size
+    except BaseException:
+        tmp_path.unlink(missing_ok=True)
+        raise
+    return tmp_path, sha256_hash.hexdigest(), size
+
+
+def generate_compressed(db: Session, firmware_base_path: Path, firmware: Firmware) -> bool:
+    """Store a compressed variant for firmware if it is small enough to be worth it."""
+    twin = (
+        db.query(Firmware)
+        .filter(
+            Firmware.file_hash == firmware.file_hash,
+            Firmware.id != firmware.id,
+            Firmware.compressed_path.isnot(None),
+        )
+        .first()
+    )
+    if twin:
+        lock_objects(db, [twin.compressed_path])
+    if twin and (firmware_base_path / twin.compressed_path.lstrip("/")).exists():
+        # Same image under another device type: its variant is ours too
+        firmware.compressed_path = twin.compressed_path
+        firmware.compressed_hash = twin.compressed_hash
+        firmware.compressed_size = twin.compressed_size
+        firmware.compression = twin.compression
+        db.commit()
+        return True
+
+    src_path = firmware_base_path / firmware.binary_path.lstrip("/")
+    if not src_path.exists():
+        logger.warning(f"Skipping compression for firmware {firmware.id}: binary missing")
+        return False
+
+    tmp_path, compressed_hash, compressed_size = compress_file(src_path, firmware_base_path)
+    if compressed_size >= firmware.file_size * MAX_COMPRESSED_RATIO:
+        logger.info(
+            f"Discarding compressed firmware {firmware.id}: "
+            f"{compressed_size} bytes vs {firmware.file_size} raw"
+        )
+        tmp_path.unlink(missing_ok=True)
+        return False
+
+    lock_objects(db, [object_relative_path(compressed_hash)])
+    relative_path = FirmwareStore(firmware_base_path).put(tmp_path, compressed_hash, compressed_size)
+    firmware.compressed_path = relative_path
+    firmware.compressed_hash = compressed_hash
+    firmware.compressed_size = compressed_size
+    firmware.compression = COMPRESSION
+    db.commit()
+    logger.info(
+        f"Compressed firmware v{firmware.version} (build {firmware.build_number}): "
+        f"{firmware.file_size} -> {compressed_size} bytes"
+    )
+    return True
+
+
+def compress_firmware_task(firmware_id: int, firmware_base_path: str = "firmware") -> None:
+    """Background task entry point; runs with its own session."""
+    from app.db import SessionLocal
+
+    db = SessionLocal()
+    try:
+        firmware = db.query(Firmware).filter(Firmware.id == firmware_id).first()
+        if firmware and not firmware.compressed_path:
+            generate_compressed(db, Path(firmware_base_path), firmware)
+    except Exception as e:
+        logger.error(f"Compression for firmware {firmware_id} failed: {e}")
+    finally:
+        db.close()
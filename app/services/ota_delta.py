@@ -0,0 +1,149 @@
+"""Binary delta (patch) generation between firmware builds.
+
+Patches are sequential detools patches, which the ESP32 client applies while
+streaming into the inactive OTA partition, reading the old image from the
+running partition.
+"""
+import hashlib
+import logging
+import os
+import tempfile
+from pathlib import Path
+
+import detools
+from sqlalchemy import func
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models.firmware import DeviceOTALog, Firmware, FirmwarePatch
+from app.services.firmware_store import FirmwareStore, lock_objects, object_relative_path
+
+logger = logging.getLogger(__name__)
+
+# heatshrink keeps the on-device decoder within a few hundred bytes of RAM
+PATCH_COMPRESSION = "heatshrink"
+# A patch larger than this fraction of the full image is not worth applying
+MAX_PATCH_RATIO = 0.5
+
+
+def select_patch_sources(db: Session, target: Firmware, limit: int) -> list[Firmware]:
+    """Pick the builds most devices are running, to diff from.
+
+    Installed builds are counted from successful OTA logs; when there are not
+    enough of those, the newest other releases of the device type fill in.
+    """
+    if limit <= 0:
+        return []
+
+    installed = (
+        db.query(Firmware)
+        .join(DeviceOTALog, DeviceOTALog.firmware_id == Firmware.id)
+        .filter(
+            Firmware.device_type == target.device_type,
+            Firmware.id != target.id,
+            DeviceOTALog.status == "success",
+        )
+        .group_by(Firmware.id)
+        .order_by(func.count(DeviceOTALog.id).desc())
+        .limit(limit)
+        .all()
+    )
+    sources = list(installed)
+    if len(sources) < limit:
+        seen = {firmware.id for firmware in sources}
+        seen.add(target.id)
+        recent = (
+            db.query(Firmware)
+            .filter(Firmware.device_type == target.device_type, Firmware.id.notin_(seen))
+            .order_by(Firmware.created_at.desc())
+            .limit(limit - len(sources))
+            .all()
+        )
+        sources.extend(recent)
+    return sources
+
+
+def create_patch_file(from_path: Path, to_path: Path, dest_dir: Path) -> tuple[Path, str, int]:
+    """Write a sequential detools patch to a temp file in dest_dir.
+
+    Returns (temp path, sha256, size) of the patch.
+    """
+    dest_dir.mkdir(parents=True, exist_ok=True)
+    fd, tmp_name = tempfile.mkstemp(dir=dest_dir, prefix=".patch-", suffix=".part")
+    tmp_path = Path(tmp_name)
+    try:
+        with open(from_path, "rb") as ffrom, open(to_path, "rb") as fto, os.fdopen(fd, "wb") as fpatch:
+            detools.create_patch(ffrom, fto, fpatch, compression=PATCH_COMPRESSION)
+        sha256_hash = hashlib.sha256()
+        with open(tmp_path, "rb") as f:
+            for byte_block in iter(lambda: f.read(64 * 1024), b""):
+                sha256_hash.update(byte_block)
+        size = tmp_path.stat().st_size
+    except BaseException:
+        tmp_path.unlink(missing_ok=True)
+        raise
+    return tmp_path, sha256_hash.hexdigest(), size
+
+
+def generate_patches(db: Session, firmware_base_path: Path, target: Firmware) -> list[FirmwarePatch]:
+    """Precompute patches to target from the most common installed builds."""
+    settings = get_settings()
+    to_path = firmware_base_path / target.binary_path.lstrip("/")
+    if not to_path.exists():
+        logger.warning(f"Skipping patches for firmware {target.id}: binary missing")
+        return []
+
+    store = FirmwareStore(firmware_base_path)
+    existing = {
+        patch.source_firmware_id
+        for patch in db.query(FirmwarePatch).filter(FirmwarePatch.firmware_id == target.id).all()
+    }
+    created: list[FirmwarePatch] = []
+    for source in select_patch_sources(db, target, settings.ota_delta_sources):
+        if source.id in existing:
+            continue
+        from_path = firmware_base_path / source.binary_path.lstrip("/")
+        if not from_path.exists():
+            continue
+        try:
+            tmp_path, patch_hash, patch_size = create_patch_file(from_path, to_path, firmware_base_path)
+        except Exception as e:
+            logger.error(f"Failed to create patch {source.id} -> {target.id}: {e}")
+            continue
+        if patch_size >= target.file_size * MAX_PATCH_RATIO:
+            logger.info(
+                f"Discarding patch {source.id} -> {target.id}: "
+                f"{patch_size} bytes vs {target.file_size} full"
+            )
+            tmp_path.unlink(missing_ok=True)
+            continue
+        lock_objects(db, [object_relative_path(patch_hash)])
+        patch = FirmwarePatch(
+            firmware_id=target.id,
+            source_firmware_id=source.id,
+            patch_path=store.put(tmp_path, patch_hash, patch_size),
+            patch_size=patch_size,
+            patch_hash=patch_hash,
+            compression=PATCH_COMPRESSION,
+        )
+        db.add(patch)
+        db.commit()
+        created.append(patch)
+        logger.info(f"Created patch v{source.version} -> v{target.version} ({patch_size} bytes)")
+    return created
+
+
+def generate_patches_task(firmware_id: int, firmware_base_path: str = "firmware") -> None:
+    """Background task entry point; runs with its own session."""
+    from app.db import SessionLocal
+
+    db = SessionLocal()
+    try:
+        target = db.query(Firmware).filter(Firmware.id == firmware_id).first()
+        if target:
+            generate_patches(db, Path(firmware_base_path), target)
+    except Exception as e:
+        logger.error(f"Patch generation for firmware {firmware_id} failed: {e}")
+    finally:
+        db.close()
+
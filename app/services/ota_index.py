@@ -0,0 +1,204 @@
+"""In-process index of releasable firmware per device type.
+
+/api/ota/check is the highest-QPS endpoint, so it answers from a prebuilt
+index instead of querying and re-parsing every firmware row. Each worker
+keeps its own copy and revalidates it against a cheap catalog stamp
+(row counts + last firmware update) at most every OTA_INDEX_REFRESH_SECONDS;
+admin routes invalidate the local copy immediately.
+"""
+import threading
+import time
+from dataclasses import dataclass, field
+from typing import Iterable, Optional
+
+from sqlalchemy import func, select
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models.firmware import Firmware, FirmwarePatch
+
+
+def parse_version(version: str | None) -> Optional[tuple[int, int, int]]:
+    """Parse a semantic version "1.2.3" to a tuple, or None if invalid."""
+    try:
+        parts = tuple(map(int, version.split(".")))
+    except (ValueError, AttributeError):
+        return None
+    if len(parts) != 3:
+        return None
+    return parts
+
+
+@dataclass(frozen=True)
+class PatchEntry:
+    source_firmware_id: int
+    patch_hash: str
+    patch_size: int
+    compression: str
+
+
+@dataclass(frozen=True)
+class FirmwareIndexEntry:
+    parsed_version: tuple[int, int, int]
+    build_number: int
+    firmware_id: int
+    version: str
+    file_hash: str
+    file_size: int
+    description: Optional[str]
+    min_current_version: Optional[str]
+    # Parsed min_current_version; None with min_current_version set means it is
+    # malformed, which blocks the update like the old per-request check did.
+    parsed_min_version: Optional[tuple[int, ...]]
+    # Keyed by the device's (current_version, current_build)
+    patches: dict[tuple[str, int], PatchEntry] = field(default_factory=dict)
+    compression: Optional[str] = None
+    compressed_hash: Optional[str] = None
+    compressed_size: Optional[int] = None
+    rollout_percent: int = 100
+    max_concurrent_downloads: Optional[int] = None
+
+    def allows_upgrade_from(self, current: tuple[int, ...]) -> bool:
+        if not self.min_current_version:
+            return True
+        return self.parsed_min_version is not None and current >= self.parsed_min_version
+
+
+def _parse_min_version(value: str | None) -> Optional[tuple[int, ...]]:
+    if not value:
+        return None
+    try:
+        return tuple(map(int, value.split(".")))
+    except ValueError:
+        return None
+
+
+def build_index(
+    firmwares: Iterable[Firmware],
+    patches: Iterable[tuple[FirmwarePatch, str, int]] = (),
+) -> dict[str, tuple[FirmwareIndexEntry, ...]]:
+    """Build the device_type -> entries map, newest (version, build) first.
+
+    Args:
+        firmwares: Active, stable firmware rows
+        patches: (patch, source version, source build) rows
+    """
+    patches_by_target: dict[int, dict[tuple[str, int], PatchEntry]] = {}
+    for patch, source_version, source_build in patches:
+        patches_by_target.setdefault(patch.firmware_id, {})[(source_version, source_build)] = PatchEntry(
+            source_firmware_id=patch.source_firmware_id,
+            patch_hash=patch.patch_hash,
+            patch_size=patch.patch_size,
+            compression=patch.compression,
+        )
+
+    grouped: dict[str, list[FirmwareIndexEntry]] = {}
+    for firmware in firmwares:
+        parsed = parse_version(firmware.version)
+        if parsed is None:
+            continue
+        grouped.setdefault(firmware.device_type, []).append(
+            FirmwareIndexEntry(
+                parsed_version=parsed,
+                build_number=firmware.build_number,
+                firmware_id=firmware.id,
+                version=firmware.version,
+                file_hash=firmware.file_hash,
+                file_size=firmware.file_size,
+                description=firmware.description,
+                min_current_version=firmware.min_current_version,
+                parsed_min_version=_parse_min_version(firmware.min_current_version),
+                patches=patches_by_target.get(firmware.id, {}),
+                compression=firmware.compression if firmware.compressed_path else None,
+                compressed_hash=firmware.compressed_hash if firmware.compressed_path else None,
+                compressed_size=firmware.compressed_size if firmware.compressed_path else None,
+                rollout_percent=firmware.rollout_percent if firmware.rollout_percent is not None else 100,
+                max_concurrent_downloads=firmware.max_concurrent_downloads,
+            )
+        )
+
+    return {
+        device_type: tuple(
+            sorted(entries, key=lambda entry: (entry.parsed_version, entry.build_number), reverse=True)
+        )
+        for device_type, entries in grouped.items()
+    }
+
+
+class FirmwareIndex:
+    """Worker-local firmware index with stamp-based revalidation."""
+
+    def __init__(self, refresh_interval_seconds: float | None = None) -> None:
+        self._refresh_interval_seconds = refresh_interval_seconds
+        self._lock = threading.Lock()
+        self._entries: dict[str, tuple[FirmwareIndexEntry, ...]] = {}
+        self._stamp: tuple | None = None
+        self._checked_at: float | None = None
+
+    @property
+    def refresh_interval_seconds(self) -> float:
+        if self._refresh_interval_seconds is None:
+            self._refresh_interval_seconds = get_settings().ota_index_refresh_seconds
+        return self._refresh_interval_seconds
+
+    @property
+    def stamp(self) -> tuple | None:
+        return self._stamp
+
+    def invalidate(self) -> None:
+        """Force a rebuild on the next lookup."""
+        with self._lock:
+            self._stamp = None
+            self._checked_at = None
+
+    def entries_for(self, db: Session, device_type: str) -> tuple[FirmwareIndexEntry, ...]:
+        self._revalidate(db)
+        return self._entries.get(device_type, ())
+
+    def latest(self, db: Session, device_type: str) -> Optional[FirmwareIndexEntry]:
+        entries = self.entries_for(db, device_type)
+        return entries[0] if entries else None
+
+    def _is_fresh(self, now: float) -> bool:
+        return self._checked_at is not None and now - self._checked_at < self.refresh_interval_seconds
+
+    def _revalidate(self, db: Session) -> None:
+        if self._is_fresh(time.monotonic()):
+            return
+        with self._lock:
+            now = time.monotonic()
+            if self._is_fresh(now):
+                return
+            stamp = self._load_stamp(db)
+            if stamp != self._stamp:
+                self._entries = self._load_entries(db)
+                self._stamp = stamp
+            self._checked_at = now
+
+    @staticmethod
+    def _load_stamp(db: Session) -> tuple:
+        row = db.execute(
+            select(
+                select(func.count(Firmware.id)).scalar_subquery(),
+                select(func.max(Firmware.updated_at)).scalar_subquery(),
+                select(func.count(FirmwarePatch.id)).scalar_subquery(),
+            )
+        ).one()
+        return tuple(row)
+
+    @staticmethod
+    def _load_entries(db: Session) -> dict[str, tuple[FirmwareIndexEntry, ...]]:
+        firmwares = (
+            db.query(Firmware)
+            .filter(Firmware.is_active == True, Firmware.is_stable == True)
+            .all()
+        )
+        patches = (
+            db.query(FirmwarePatch, Firmware.version, Firmware.build_number)
+            .join(Firmware, Firmware.id == FirmwarePatch.source_firmware_id)
+            .all()
+        )
+        return build_index(firmwares, patches)
+
+
+firmware_index = FirmwareIndex()
@@ -0,0 +1,135 @@
+"""Write-behind buffer for OTA download progress.
+
+Intermediate "downloading" pings only move bytes_downloaded forward, so they
+are kept in memory and written in bulk every OTA_PROGRESS_FLUSH_SECONDS as one
+UPDATE ... FROM (VALUES ...) per batch. State changes (installing, success,
+failed, ...) still go through the normal per-request transaction.
+"""
+import logging
+import threading
+import time
+from dataclasses import dataclass
+from datetime import datetime
+from typing import Optional
+
+from sqlalchemy import DateTime, Integer, column, update, values
+from sqlalchemy.orm import Session
+
+from app.models.firmware import DeviceOTALog
+
+logger = logging.getLogger(__name__)
+
+FLUSH_BATCH_SIZE = 500
+# Downloads with no progress for this long stop being tracked
+TRACK_IDLE_SECONDS = 60 * 60
+
+
+@dataclass
+class PendingProgress:
+    bytes_downloaded: int
+    reported_at: datetime
+
+
+class ProgressBuffer:
+    """Worker-local progress aggregator keyed by OTA log ID."""
+
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        # (device_id, firmware_id) -> (log_id, last activity) for logs in "downloading"
+        self._tracked: dict[tuple[int, int], tuple[int, float]] = {}
+        self._pending: dict[int, PendingProgress] = {}
+
+    def track(self, device_id: int, firmware_id: int, log_id: int) -> None:
+        """Route further progress for this download into the buffer."""
+        with self._lock:
+            self._tracked[(device_id, firmware_id)] = (log_id, time.monotonic())
+
+    def forget(self, device_id: int, firmware_id: int) -> None:
+        with self._lock:
+            tracked = self._tracked.pop((device_id, firmware_id), None)
+            if tracked:
+                self._pending.pop(tracked[0], None)
+
+    def record(self, device_id: int, firmware_id: int, bytes_downloaded: int) -> Optional[int]:
+        """Buffer a progress update; returns the log ID, or None if not tracked."""
+        key = (device_id, firmware_id)
+        with self._lock:
+            tracked = self._tracked.get(key)
+            if tracked is None:
+                return None
+            log_id = tracked[0]
+            self._tracked[key] = (log_id, time.monotonic())
+            self._pending[log_id] = PendingProgress(bytes_downloaded, datetime.utcnow())
+            return log_id
+
+    def take(self, log_id: int) -> Optional[PendingProgress]:
+        """Remove and return unflushed progress, before writing the log directly."""
+        with self._lock:
+            return self._pending.pop(log_id, None)
+
+    def live_bytes(self, log_id: int) -> Optional[int]:
+        """Latest reported progress not yet flushed to the database."""
+        with self._lock:
+            pending = self._pending.get(log_id)
+            return pending.bytes_downloaded if pending else None
+
+    def flush(self, db: Session) -> int:
+        """Write all buffered progress; returns the number of logs flushed."""
+        with self._lock:
+            batch, self._pending = self._pending, {}
+            cutoff = time.monotonic() - TRACK_IDLE_SECONDS
+            self._tracked = {key: value for key, value in self._tracked.items() if value[1] >= cutoff}
+        if not batch:
+            return 0
+
+        rows = [(log_id, p.bytes_downloaded, p.reported_at) for log_id, p in batch.items()]
+        try:
+            for start in range(0, len(rows), FLUSH_BATCH_SIZE):
+                db.execute(_bulk_progress_update(rows[start : start + FLUSH_BATCH_SIZE]))
+            db.commit()
+        except Exception:
+            db.rollback()
+            with self._lock:
+                # Keep anything reported while the flush was failing
+                for log_id, pending in batch.items():
+                    self._pending.setdefault(log_id, pending)
+            raise
+        return len(rows)
+
+
+def _bulk_progress_update(rows: list[tuple[int, int, datetime]]):
+    progress = values(
+        column("id", Integer),
+        column("bytes_downloaded", Integer),
+        column("updated_at", DateTime),
+        name="progress",
+    ).data(rows)
+    # Status and timestamp guards keep a late flush from overwriting a
+    # terminal state or newer progress written by another worker.
+    return (
+        update(DeviceOTALog)
+        .where(
+            DeviceOTALog.id == progress.c.id,
+            DeviceOTALog.status == "downloading",
+            DeviceOTALog.updated_at < progress.c.updated_at,
+        )
+        .values(bytes_downloaded=progress.c.bytes_downloaded, updated_at=progress.c.updated_at)
+        .execution_options(synchronize_session=False)
+    )
+
+
+progress_buffer = ProgressBuffer()
+
+
+def flush_progress() -> None:
+    """Flush the shared buffer with its own session."""
+    from app.db import SessionLocal
+
+    db = SessionLocal()
+    try:
+        flushed = progress_buffer.flush(db)
+        if flushed:
+            logger.debug(f"Flushed OTA progress for {flushed} logs")
+    finally:
+        db.close()
+
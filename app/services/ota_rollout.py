@@ -0,0 +1,146 @@
+"""Staged rollout admission for OTA releases.
+
+A release reaches the share of devices set by Firmware.rollout_percent. A
+device's cohort is a stable hash of (firmware_id, device_id), so raising the
+percentage only adds devices and the answer does not flip between polls;
+devices outside the wave keep getting the newest release they are in.
+
+Separately, max_concurrent_downloads (or OTA_ROLLOUT_MAX_CONCURRENT) caps how
+many devices download a release at once, counted from DeviceOTALog rows in
+"downloading". Devices over the cap are told to check back after
+OTA_ROLLOUT_RETRY_SECONDS. Each worker reloads the counts at most every
+OTA_ROLLOUT_INFLIGHT_REFRESH_SECONDS and adds the devices it admitted since,
+so a burst overshoots the cap by at most what other workers admit in one
+refresh window.
+"""
+import hashlib
+import threading
+import time
+from datetime import datetime, timedelta
+from typing import Optional
+
+from sqlalchemy import func
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models.firmware import DeviceOTALog
+
+ADMITTED = "admitted"
+THROTTLED = "throttled"
+
+
+def cohort_bucket(firmware_id: int, device_id: int) -> int:
+    """Stable 0-99 bucket of a device for one release."""
+    digest = hashlib.sha256(f"{firmware_id}:{device_id}".encode()).digest()
+    return int.from_bytes(digest[:8], "big") % 100
+
+
+def in_wave(firmware_id: int, device_id: int, rollout_percent: int) -> bool:
+    return cohort_bucket(firmware_id, device_id) < rollout_percent
+
+
+class RolloutScheduler:
+    """Worker-local concurrency gate for release downloads."""
+
+    def __init__(
+        self,
+        refresh_interval_seconds: float | None = None,
+        stale_seconds: float | None = None,
+        default_cap: int | None = None,
+    ) -> None:
+        self._refresh_interval_seconds = refresh_interval_seconds
+        self._stale_seconds = stale_seconds
+        self._default_cap = default_cap
+        self._lock = threading.Lock()
+        self._counts: dict[int, int] = {}
+        # Devices admitted by this worker since the counts were loaded
+        self._admitted: dict[int, set[int]] = {}
+        self._checked_at: float | None = None
+
+    @property
+    def refresh_interval_seconds(self) -> float:
+        if self._refresh_interval_seconds is None:
+            self._refresh_interval_seconds = get_settings().ota_rollout_inflight_refresh_seconds
+        return self._refresh_interval_seconds
+
+    @property
+    def stale_seconds(self) -> float:
+        if self._stale_seconds is None:
+            self._stale_seconds = get_settings().ota_rollout_inflight_stale_seconds
+        return self._stale_seconds
+
+    @property
+    def default_cap(self) -> int:
+        if self._default_cap is None:
+            self._default_cap = get_settings().ota_rollout_max_concurrent
+        return self._default_cap
+
+    def admit(self, db: Session, firmware_id: int, device_id: int, cap: Optional[int]) -> str:
+        """ADMITTED or THROTTLED for a device about to be offered firmware_id."""
+        cap = cap if cap is not None else self.default_cap
+        if not cap:
+            return ADMITTED
+        with self._lock:
+            self._refresh(db)
+            admitted = self._admitted.setdefault(firmware_id, set())
+            if device_id in admitted:
+                return ADMITTED
+            if self._counts.get(firmware_id, 0) + len(admitted) < cap:
+                admitted.add(device_id)
+                return ADMITTED
+        # A device that is already downloading keeps its slot, e.g. to resume
+        if self._is_downloading(db, firmware_id, device_id, self._cutoff()):
+            return ADMITTED
+        return THROTTLED
+
+    def inflight(self, db: Session) -> dict[int, int]:
+        """In-flight downloads per firmware, as last seen by this worker."""
+        with self._lock:
+            self._refresh(db)
+            return {
+                firmware_id: self._counts.get(firmware_id, 0) + len(self._admitted.get(firmware_id, ()))
+                for firmware_id in self._counts.keys() | self._admitted.keys()
+            }
+
+    def invalidate(self) -> None:
+        with self._lock:
+            self._checked_at = None
+
+    def _cutoff(self) -> datetime:
+        # Devices that stopped reporting mid-download must not hold a slot forever
+        return datetime.utcnow() - timedelta(seconds=self.stale_seconds)
+
+    def _refresh(self, db: Session) -> None:
+        now = time.monotonic()
+        if self._checked_at is not None and now - self._checked_at < self.refresh_interval_seconds:
+            return
+        self._counts = self._load_counts(db, self._cutoff())
+        self._admitted = {}
+        self._checked_at = now
+
+    @staticmethod
+    def _load_counts(db: Session, cutoff: datetime) -> dict[int, int]:
+        rows = (
+            db.query(DeviceOTALog.firmware_id, func.count(func.distinct(DeviceOTALog.device_id)))
+            .filter(DeviceOTALog.status == "downloading", DeviceOTALog.updated_at >= cutoff)
+            .group_by(DeviceOTALog.firmware_id)
+            .all()
+        )
+        return {firmware_id: count for firmware_id, count in rows}
+
+    @staticmethod
+    def _is_downloading(db: Session, firmware_id: int, device_id: int, cutoff: datetime) -> bool:
+        return (
+            db.query(DeviceOTALog.id)
+            .filter(
+                DeviceOTALog.device_id == device_id,
+                DeviceOTALog.firmware_id == firmware_id,
+                DeviceOTALog.status == "downloading",
+                DeviceOTALog.updated_at >= cutoff,
+            )
+            .first()
+            is not None
+        )
+
+
+rollout_scheduler = RolloutScheduler()
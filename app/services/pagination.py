@@ -0,0 +1,61 @@
+"""Keyset pagination over (timestamp, id), newest first.
+
+A cursor is an opaque, URL-safe token holding the sort key of the last row
+returned. The next page is the rows strictly before it in (timestamp, id)
+order, so a page costs one index range scan however deep it is, and rows
+inserted meanwhile do not shift later pages.
+"""
+import base64
+import json
+import uuid
+from datetime import datetime
+from typing import Any, Callable, Sequence
+
+from sqlalchemy import tuple_
+from sqlalchemy.orm import Query
+
+MAX_PAGE_SIZE = 1000
+
+
+def encode_cursor(timestamp: datetime, row_id: Any) -> str:
+    raw = json.dumps([timestamp.isoformat(), str(row_id)], separators=(",", ":")).encode("utf-8")
+    return base64.urlsafe_b64encode(raw).decode("ascii").rstrip("=")
+
+
+def decode_cursor(token: str, id_type: Callable[[str], Any] = int) -> tuple[datetime, Any]:
+    try:
+        timestamp, row_id = json.loads(base64.urlsafe_b64decode(token + "=" * (-len(token) % 4)))
+        return datetime.fromisoformat(timestamp), id_type(row_id)
+    except (ValueError, TypeError) as exc:
+        raise ValueError("Invalid cursor") from exc
+
+
+def uuid_id(value: str) -> uuid.UUID:
+    return uuid.UUID(value)
+
+
+def keyset_page(
+    query: Query,
+    timestamp_column,
+    id_column,
+    cursor: str | None,
+    limit: int,
+    id_type: Callable[[str], Any] = int,
+) -> tuple[Sequence[Any], str | None]:
+    """Return (rows, next cursor or None) for one page of `query`.
+
+    Raises ValueError for a malformed cursor.
+    """
+    if cursor:
+        timestamp, row_id = decode_cursor(cursor, id_type)
+        query = query.filter(tuple_(timestamp_column, id_column) < tuple_(timestamp, row_id))
+    rows = query.order_by(timestamp_column.desc(), id_column.desc()).limit(limit + 1).all()
+    return page_from(rows, limit, lambda row: (getattr(row, timestamp_column.key), getattr(row, id_column.key)))
+
+
+def page_from(rows: Sequence[Any], limit: int, sort_key: Callable[[Any], tuple[datetime, Any]]) -> tuple[list, str | None]:
+    """Trim rows fetched with limit + 1 and build the cursor for the next page."""
+    if len(rows) <= limit:
+        return list(rows), None
+    page = list(rows[:limit])
+    return page, encode_cursor(*sort_key(page[-1]))
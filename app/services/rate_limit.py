@@ -1,22 +1,143 @@
+"""Request rate limiters.
+
+Limits use GCRA (a token bucket expressed as one "theoretical arrival time"
+per key): max_requests may arrive in a burst, then one more every
+window_seconds / max_requests. The in-memory backend keeps one float per key
+in sharded OrderedDicts in least-recently-used order. Inserting a key drops
+idle keys (full bucket again) from the old end, and a shard over
+max_keys_per_shard evicts its oldest key, so memory is bounded under key
+spraying at O(1) amortised cost per request. The Redis backend runs the same algorithm in
+a Lua script so limits hold across workers and replicas.
+"""
+import logging
 import threading
 import time
-from collections import deque
+import zlib
+from collections import OrderedDict
+
+from app.config import get_settings
+from app.services.metrics import rate_limit_rejections
+
+logger = logging.getLogger(__name__)
+
+DEFAULT_SHARDS = 16
+# Hard cap per shard; past it the least recently used key is forgotten
+MAX_KEYS_PER_SHARD = 8192
 
 
 class RateLimiter:
-    def __init__(self, max_requests: int, window_seconds: int) -> None:
+    """In-process GCRA limiter with sharded locks and idle-key eviction."""
+
+    def __init__(
+        self,
+        max_requests: int,
+        window_seconds: int,
+        shards: int = DEFAULT_SHARDS,
+        name: str = "default",
+        max_keys_per_shard: int = MAX_KEYS_PER_SHARD,
+    ) -> None:
+        self.name = name
         self.max_requests = max_requests
         self.window_seconds = window_seconds
-        self._lock = threading.Lock()
-        self._requests: dict[str, deque[float]] = {}
+        self.emission_interval = window_seconds / max(1, max_requests)
+        self.burst_tolerance = window_seconds - self.emission_interval
+        self.max_keys_per_shard = max(1, max_keys_per_shard)
+        self._shards = [(threading.Lock(), OrderedDict()) for _ in range(max(1, shards))]
 
     def allow(self, key: str, now: float | None = None) -> bool:
         now = now or time.time()
-        with self._lock:
-            bucket = self._requests.setdefault(key, deque())
-            while bucket and bucket[0] <= now - self.window_seconds:
-                bucket.popleft()
-            if len(bucket) >= self.max_requests:
+        lock, arrivals = self._shard(key)
+        with lock:
+            tat = max(arrivals.get(key, now), now)
+            if tat - now > self.burst_tolerance:
+                rate_limit_rejections.inc(self.name)
                 return False
-            bucket.append(now)
+            if key in arrivals:
+                arrivals.move_to_end(key)
+            else:
+                self._evict(arrivals, now)
+            arrivals[key] = tat + self.emission_interval
             return True
+
+    def __len__(self) -> int:
+        return sum(len(arrivals) for _, arrivals in self._shards)
+
+    def _shard(self, key: str) -> tuple[threading.Lock, OrderedDict[str, float]]:
+        return self._shards[zlib.crc32(key.encode("utf-8")) % len(self._shards)]
+
+    def _evict(self, arrivals: OrderedDict[str, float], now: float) -> None:
+        # A key whose arrival time has passed has a full bucket: same as absent.
+        # Each key is popped at most once per insert, so this is O(1) amortised.
+        while arrivals and next(iter(arrivals.values())) <= now:
+            arrivals.popitem(last=False)
+        while len(arrivals) >= self.max_keys_per_shard:
+            arrivals.popitem(last=False)
+
+
+_GCRA_SCRIPT = """
+local now_parts = redis.call('TIME')
+local now = tonumber(now_parts[1]) * 1000 + math.floor(tonumber(now_parts[2]) / 1000)
+local interval = tonumber(ARGV[1])
+local tolerance = tonumber(ARGV[2])
+local tat = tonumber(redis.call('GET', KEYS[1]) or now)
+if tat < now then
+  tat = now
+end
+if tat - now > tolerance then
+  return 0
+end
+local new_tat = tat + interval
+redis.call('SET', KEYS[1], new_tat, 'PX', math.ceil(new_tat - now))
+return 1
+"""
+
+
+class RedisRateLimiter:
+    """GCRA limiter shared through Redis; falls back to a local limiter if Redis fails."""
+
+    def __init__(self, client, name: str, max_requests: int, window_seconds: int) -> None:
+        self.name = name
+        self.max_requests = max_requests
+        self.window_seconds = window_seconds
+        self.prefix = f"ratelimit:{name}:"
+        self.emission_interval_ms = int(window_seconds * 1000 / max(1, max_requests))
+        self.burst_tolerance_ms = int(window_seconds * 1000) - self.emission_interval_ms
+        self._script = client.register_script(_GCRA_SCRIPT)
+        self._fallback = RateLimiter(max_requests, window_seconds, name=name)
+
+    def allow(self, key: str, now: float | None = None) -> bool:
+        try:
+            allowed = self._script(
+                keys=[self.prefix + key],
+                args=[self.emission_interval_ms, self.burst_tolerance_ms],
+            )
+        except Exception as e:
+            logger.warning("Redis rate limiter unavailable, using local limit: %s", e)
+            return self._fallback.allow(key, now)
+        if not allowed:
+            rate_limit_rejections.inc(self.name)
+        return bool(allowed)
+
+
+_redis_client = None
+
+
+def _get_redis_client(url: str):
+    global _redis_client
+    if _redis_client is None:
+        import redis
+
+        _redis_client = redis.Redis.from_url(url, socket_timeout=0.5, socket_connect_timeout=0.5)
+    return _redis_client
+
+
+def build_rate_limiter(name: str, max_requests: int, window_seconds: int):
+    """Limiter for the configured RATE_LIMIT_BACKEND ("memory" or "redis")."""
+    settings = get_settings()
+    if settings.rate_limit_backend == "redis":
+        if not settings.rate_limit_redis_url:
+            raise RuntimeError("RATE_LIMIT_REDIS_URL is required for the redis rate limit backend")
+        return RedisRateLimiter(
+            _get_redis_client(settings.rate_limit_redis_url), name, max_requests, window_seconds
+        )
+    return RateLimiter(max_requests, window_seconds, name=name)
@@ -0,0 +1,242 @@
+"""Short-lived tenant/device cache and write-behind last_seen for request auth.
+
+get_request_context runs on every authenticated call. Tenants and devices are
+cached as immutable snapshots for REQUEST_CONTEXT_CACHE_SECONDS, devices in a
+bounded LRU. Admin changes to a tenant or a device's revocation evict the
+entry in this worker and advance the request_context_revision sequence; every
+worker reads the sequence at most every REQUEST_CONTEXT_REVALIDATE_SECONDS
+and drops its whole cache when it moved, so revocations reach all workers
+within that interval. last_seen is recorded in
+memory and written in one bulk UPDATE per flush, so read-only device traffic
+costs no write transactions.
+"""
+import threading
+import time
+import uuid
+from collections import OrderedDict
+from dataclasses import dataclass
+from datetime import datetime
+from typing import Optional
+
+from sqlalchemy import DateTime, column, or_, text, update, values
+from sqlalchemy.dialects.postgresql import UUID
+from sqlalchemy.orm import Session
+
+from app.config import get_settings
+from app.models import Device, Tenant, TenantStatus
+
+FLUSH_BATCH_SIZE = 500
+MAX_CACHED_DEVICES = 50_000
+REVISION_SEQUENCE = "request_context_revision"
+
+
+@dataclass(frozen=True)
+class TenantSnapshot:
+    id: uuid.UUID
+    company_code: str
+    status: TenantStatus
+    subscription_expires_at: datetime
+    erpnext_url: str
+    api_key: str
+    api_secret: str
+
+    @classmethod
+    def from_model(cls, tenant: Tenant) -> "TenantSnapshot":
+        return cls(
+            id=tenant.id,
+            company_code=tenant.company_code,
+            status=tenant.status,
+            subscription_expires_at=tenant.subscription_expires_at,
+            erpnext_url=tenant.erpnext_url,
+            api_key=tenant.api_key,
+            api_secret=tenant.api_secret,
+        )
+
+
+@dataclass(frozen=True)
+class DeviceSnapshot:
+    id: uuid.UUID
+    tenant_id: uuid.UUID
+    device_id: str
+    revoked: bool
+
+    @classmethod
+    def from_model(cls, device: Device) -> "DeviceSnapshot":
+        return cls(id=device.id, tenant_id=device.tenant_id, device_id=device.device_id, revoked=device.revoked)
+
+
+class RequestContextCache:
+    def __init__(
+        self,
+        ttl_seconds: float | None = None,
+        revalidate_seconds: float | None = None,
+        max_devices: int = MAX_CACHED_DEVICES,
+    ) -> None:
+        self._ttl_seconds = ttl_seconds
+        self._revalidate_seconds = revalidate_seconds
+        self.max_devices = max_devices
+        self._lock = threading.Lock()
+        self._tenants: dict[uuid.UUID, tuple[TenantSnapshot, float]] = {}
+        self._devices: OrderedDict[tuple[uuid.UUID, str], tuple[DeviceSnapshot, float]] = OrderedDict()
+        self._revision: int | None = None
+        self._checked_at: float | None = None
+
+    @property
+    def ttl_seconds(self) -> float:
+        if self._ttl_seconds is None:
+            self._ttl_seconds = get_settings().request_context_cache_seconds
+        return self._ttl_seconds
+
+    @property
+    def revalidate_seconds(self) -> float:
+        if self._revalidate_seconds is None:
+            self._revalidate_seconds = get_settings().request_context_revalidate_seconds
+        return self._revalidate_seconds
+
+    def get_tenant(self, db: Session, tenant_id: uuid.UUID) -> Optional[TenantSnapshot]:
+        now = time.monotonic()
+        self._revalidate(db, now)
+        with self._lock:
+            cached = self._tenants.get(tenant_id)
+        if cached and cached[1] > now:
+            return cached[0]
+        tenant = db.query(Tenant).filter(Tenant.id == tenant_id).first()
+        if not tenant:
+            return None
+        snapshot = TenantSnapshot.from_model(tenant)
+        with self._lock:
+            self._tenants[tenant_id] = (snapshot, now + self.ttl_seconds)
+        return snapshot
+
+    def get_device(self, db: Session, tenant_id: uuid.UUID, device_id: str) -> Optional[DeviceSnapshot]:
+        now = time.monotonic()
+        key = (tenant_id, device_id)
+        self._revalidate(db, now)
+        with self._lock:
+            cached = self._devices.get(key)
+            if cached:
+                self._devices.move_to_end(key)
+        if cached and cached[1] > now:
+            return cached[0]
+        device = (
+            db.query(Device)
+            .filter(Device.tenant_id == tenant_id, Device.device_id == device_id)
+            .first()
+        )
+        if not device:
+            return None
+        return self.store_device(device, now)
+
+    def store_device(self, device: Device, now: float | None = None) -> DeviceSnapshot:
+        snapshot = DeviceSnapshot.from_model(device)
+        expires_at = (now or time.monotonic()) + self.ttl_seconds
+        key = (snapshot.tenant_id, snapshot.device_id)
+        with self._lock:
+            self._devices[key] = (snapshot, expires_at)
+            self._devices.move_to_end(key)
+            while len(self._devices) > self.max_devices:
+                self._devices.popitem(last=False)
+        return snapshot
+
+    def invalidate_tenant(self, tenant_id: uuid.UUID, db: Session | None = None) -> None:
+        """Evict a tenant and its devices, after status, subscription or deletion changes.
+
+        With db, other workers are told through the revision sequence too.
+        """
+        with self._lock:
+            self._tenants.pop(tenant_id, None)
+            for key in [key for key in self._devices if key[0] == tenant_id]:
+                del self._devices[key]
+        if db is not None:
+            publish_revision(db)
+
+    def invalidate_device(self, tenant_id: uuid.UUID, device_id: str, db: Session | None = None) -> None:
+        with self._lock:
+            self._devices.pop((tenant_id, device_id), None)
+        if db is not None:
+            publish_revision(db)
+
+    def prune(self) -> None:
+        now = time.monotonic()
+        with self._lock:
+            self._tenants = {key: value for key, value in self._tenants.items() if value[1] > now}
+            self._devices = OrderedDict((key, value) for key, value in self._devices.items() if value[1] > now)
+
+    def _revalidate(self, db: Session | None, now: float) -> None:
+        """Drop everything once another worker published a change."""
+        checked_at = self._checked_at
+        if db is None or (checked_at is not None and now - checked_at < self.revalidate_seconds):
+            return
+        revision = db.execute(text(f"SELECT last_value FROM {REVISION_SEQUENCE}")).scalar()
+        with self._lock:
+            if self._revision is not None and revision != self._revision:
+                self._tenants.clear()
+                self._devices.clear()
+            self._revision = revision
+            self._checked_at = now
+
+
+def publish_revision(db: Session) -> None:
+    """Advance the revision every worker revalidates against (not rolled back)."""
+    db.execute(text(f"SELECT nextval('{REVISION_SEQUENCE}')"))
+
+
+class LastSeenTracker:
+    """Latest activity per device, flushed in bulk."""
+
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._dirty: dict[uuid.UUID, datetime] = {}
+
+    def mark(self, device_pk: uuid.UUID, seen_at: datetime) -> None:
+        with self._lock:
+            self._dirty[device_pk] = seen_at
+
+    def flush(self, db: Session) -> int:
+        with self._lock:
+            batch, self._dirty = self._dirty, {}
+        if not batch:
+            return 0
+
+        rows = list(batch.items())
+        try:
+            for start in range(0, len(rows), FLUSH_BATCH_SIZE):
+                db.execute(_bulk_last_seen_update(rows[start : start + FLUSH_BATCH_SIZE]))
+            db.commit()
+        except Exception:
+            db.rollback()
+            with self._lock:
+                for device_pk, seen_at in batch.items():
+                    self._dirty.setdefault(device_pk, seen_at)
+            raise
+        return len(rows)
+
+
+def _bulk_last_seen_update(rows: list[tuple[uuid.UUID, datetime]]):
+    seen = values(
+        column("id", UUID(as_uuid=True)),
+        column("last_seen", DateTime(timezone=True)),
+        name="seen",
+    ).data(rows)
+    return (
+        update(Device)
+        .where(Device.id == seen.c.id, or_(Device.last_seen.is_(None), Device.last_seen < seen.c.last_seen))
+        .values(last_seen=seen.c.last_seen)
+        .execution_options(synchronize_session=False)
+    )
+
+
+context_cache = RequestContextCache()
+last_seen_tracker = LastSeenTracker()
+
+
+def flush_last_seen() -> None:
+    """Flush pending last_seen updates with their own session."""
+    from app.db import SessionLocal
+
+    db = SessionLocal()
+    try:
+        last_seen_tracker.flush(db)
+        context_cache.prune()
+    finally:
+        db.close()
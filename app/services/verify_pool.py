@@ -0,0 +1,91 @@
+"""Dedicated worker pool for bcrypt license verification.
+
+bcrypt releases the GIL, so a few native threads keep activation storms off
+the shared request threadpool. Jobs queue per tenant and workers take them
+round-robin across tenants, so one tenant's burst cannot delay everyone
+else's activations. When the queue is full, submit() fails immediately and
+the route answers 429 instead of piling up blocked request threads.
+"""
+import threading
+from collections import OrderedDict, deque
+from concurrent.futures import Future
+from functools import lru_cache
+from typing import Any, Callable
+
+from app.config import get_settings
+
+
+class VerificationPoolSaturated(Exception):
+    pass
+
+
+class VerificationPool:
+    def __init__(self, workers: int, max_queued: int, max_queued_per_key: int, autostart: bool = True) -> None:
+        self.workers = max(1, workers)
+        self.max_queued = max_queued
+        self.max_queued_per_key = max_queued_per_key
+        self._autostart = autostart
+        self._cond = threading.Condition()
+        # Insertion order is the round-robin order
+        self._queues: OrderedDict[str, deque[tuple[Future, Callable[..., Any], tuple]]] = OrderedDict()
+        self._queued = 0
+        self._threads: list[threading.Thread] = []
+
+    def submit(self, key: str, fn: Callable[..., Any], *args: Any) -> Future:
+        with self._cond:
+            queue = self._queues.get(key)
+            if self._queued >= self.max_queued or (queue is not None and len(queue) >= self.max_queued_per_key):
+                raise VerificationPoolSaturated(key)
+            if self._autostart and not self._threads:
+                self._start()
+            future: Future = Future()
+            if queue is None:
+                queue = self._queues[key] = deque()
+            queue.append((future, fn, args))
+            self._queued += 1
+            self._cond.notify()
+        return future
+
+    def run(self, key: str, fn: Callable[..., Any], *args: Any) -> Any:
+        """Submit and wait for the result."""
+        return self.submit(key, fn, *args).result()
+
+    def _start(self) -> None:
+        for index in range(self.workers):
+            thread = threading.Thread(target=self._worker, name=f"license-verify-{index}", daemon=True)
+            thread.start()
+            self._threads.append(thread)
+
+    def _take(self) -> tuple[Future, Callable[..., Any], tuple]:
+        """Pop the next job, rotating to the next tenant. Caller holds the lock."""
+        key, queue = next(iter(self._queues.items()))
+        job = queue.popleft()
+        self._queued -= 1
+        if queue:
+            self._queues.move_to_end(key)
+        else:
+            del self._queues[key]
+        return job
+
+    def _worker(self) -> None:
+        while True:
+            with self._cond:
+                while not self._queues:
+                    self._cond.wait()
+                future, fn, args = self._take()
+            if not future.set_running_or_notify_cancel():
+                continue
+            try:
+                future.set_result(fn(*args))
+            except BaseException as e:
+                future.set_exception(e)
+
+
+@lru_cache
+def get_verification_pool() -> VerificationPool:
+    settings = get_settings()
+    return VerificationPool(
+        workers=settings.license_verify_workers,
+        max_queued=settings.license_verify_queue_size,
+        max_queued_per_key=settings.license_verify_queue_per_tenant,
+    )
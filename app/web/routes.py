@@ -3,17 +3,16 @@ import secrets
 import uuid
 from datetime import date, datetime, time, timedelta, timezone
 
-from fastapi import APIRouter, Depends, Request
+from fastapi import APIRouter, BackgroundTasks, Depends, Request
 from fastapi.responses import RedirectResponse, JSONResponse
 from fastapi.templating import Jinja2Templates
+from sqlalchemy import select
 from sqlalchemy.exc import IntegrityError
-from sqlalchemy.orm import Session
+from sqlalchemy.orm import Session, joinedload
 
 from app.api.deps import get_client_ip, get_db
 from app.config import get_settings
 from app.models import (
-    AuditLog,
-    Device,
     ERPAllowlistEntry,
     ERPAllowlistType,
     LicenseKey,
@@ -22,25 +21,42 @@ from app.models import (
     Tenant,
     TenantStatus,
 )
-from app.models.firmware import DeviceOTALog, Firmware
+from app.models.firmware import DeviceOTALog, Firmware, FirmwarePatch
 from app.services.allowlist import (
+    allowlist_cache,
     has_allowlist_entries,
     normalize_doctype,
     normalize_method,
     seed_allowlist_from_settings,
 )
-from app.services.rate_limit import RateLimiter
+from app.services.audit import delete_tenant_audit
+from app.services.rate_limit import build_rate_limiter
 from app.services.erpnext import normalize_erpnext_url
+from app.services.firmware_store import (
+    app_desc_metadata,
+    lock_objects,
+    object_relative_path,
+    remove_unreferenced,
+)
 from app.services.license import fingerprint_license_key, hash_license_key
-from app.services.ota import OTAService
+from app.services.ota import UPLOAD_CHUNK_SIZE, OTAService, StagedUpload
 from app.services.ota_binary import parse_esp_app_desc_version
+from app.services.ota_compress import compress_firmware_task
+from app.services.ota_delta import generate_patches_task
+from app.services.ota_index import firmware_index
+from app.services.ota_progress import progress_buffer
+from app.services.ota_rollout import rollout_scheduler
+from app.services.pagination import keyset_page, uuid_id
+from app.services.request_cache import context_cache
 from app.utils.time import utcnow
 
 router = APIRouter(prefix="/admin-ui", tags=["admin-ui"])
 templates = Jinja2Templates(directory="app/templates")
 settings = get_settings()
-login_limiter = RateLimiter(settings.rate_limit_login_per_minute, 60)
+login_limiter = build_rate_limiter("login", settings.rate_limit_login_per_minute, 60)
 ota_service = OTAService(firmware_base_path="firmware")
+# Rows per page on keyset-paginated admin lists
+PAGE_SIZE = 50
 
 
 def parse_datetime_input(value: str) -> datetime:
@@ -339,7 +355,9 @@ async def create_tenant(request: Request, db: Session = Depends(get_db)):
 
 
 @router.get("/tenants/{company_code}")
-def tenant_detail(request: Request, company_code: str, db: Session = Depends(get_db)):
+def tenant_detail(
+    request: Request, company_code: str, db: Session = Depends(get_db), cursor: str | None = None
+):
     redirect_response = require_admin_or_redirect(request)
     if redirect_response:
         return redirect_response
@@ -349,12 +367,17 @@ def tenant_detail(request: Request, company_code: str, db: Session = Depends(get
         set_flash(request, error="Tenant not found")
         return redirect_to("/admin-ui/tenants")
 
-    licenses = (
-        db.query(LicenseKey)
-        .filter(LicenseKey.tenant_id == tenant.id)
-        .order_by(LicenseKey.created_at.desc())
-        .all()
-    )
+    try:
+        licenses, next_cursor = keyset_page(
+            db.query(LicenseKey).filter(LicenseKey.tenant_id == tenant.id),
+            LicenseKey.created_at,
+            LicenseKey.id,
+            cursor,
+            PAGE_SIZE,
+            id_type=uuid_id,
+        )
+    except ValueError:
+        return redirect_to(f"/admin-ui/tenants/{company_code}")
     message, error, license_key = pop_flash(request)
 
     context = build_admin_context(
@@ -364,6 +387,8 @@ def tenant_detail(request: Request, company_code: str, db: Session = Depends(get
         "tenants",
         tenant=tenant,
         licenses=licenses,
+        next_cursor=next_cursor,
+        first_page=not cursor,
         message=message,
         error=error,
         new_license_key=license_key,
@@ -421,6 +446,7 @@ async def update_tenant_status(request: Request, company_code: str, db: Session
 
     tenant.status = status
     db.commit()
+    context_cache.invalidate_tenant(tenant.id, db)
     set_flash(request, message="Status updated")
     return redirect_to(f"/admin-ui/tenants/{company_code}")
 
@@ -475,6 +501,7 @@ async def update_subscription(request: Request, company_code: str, db: Session =
         tenant.subscription_expires_at = base + timedelta(days=add_days)
 
     db.commit()
+    context_cache.invalidate_tenant(tenant.id, db)
     set_flash(request, message="Subscription updated")
     return redirect_to(f"/admin-ui/tenants/{company_code}")
 
@@ -495,20 +522,12 @@ async def delete_tenant(request: Request, company_code: str, db: Session = Depen
         set_flash(request, error="Tenant not found")
         return redirect_to("/admin-ui/tenants")
 
-    device_ids = [
-        row.id for row in db.query(Device.id).filter(Device.tenant_id == tenant.id).all()
-    ]
-    audit_query = db.query(AuditLog)
-    if device_ids:
-        audit_query = audit_query.filter(
-            (AuditLog.tenant_id == tenant.id) | (AuditLog.device_id.in_(device_ids))
-        )
-    else:
-        audit_query = audit_query.filter(AuditLog.tenant_id == tenant.id)
-    audit_query.delete(synchronize_session=False)
+    delete_tenant_audit(db, tenant.id)
 
+    tenant_id = tenant.id
     db.delete(tenant)
     db.commit()
+    context_cache.invalidate_tenant(tenant_id, db)
     set_flash(request, message="Tenant deleted")
     return redirect_to("/admin-ui/tenants")
 
@@ -638,8 +657,10 @@ def ota_dashboard(request: Request, db: Session = Depends(get_db)):
     total_firmwares = db.query(Firmware).count()
     active_firmwares = db.query(Firmware).filter(Firmware.is_active == True).count()
     stable_firmwares = db.query(Firmware).filter(Firmware.is_stable == True).count()
-    total_logs = db.query(DeviceOTALog).count()
-    failed_logs = db.query(DeviceOTALog).filter(DeviceOTALog.status == "failed").count()
+    # Per-firmware aggregates instead of counting device_ota_log
+    stats = ota_service.get_rollout_stats(db)
+    total_logs = sum(sum(counts.values()) for counts in stats.values())
+    failed_logs = sum(counts.get("failed", 0) for counts in stats.values())
 
     context = build_admin_context(
         request,
@@ -691,7 +712,9 @@ def ota_releases(request: Request, db: Session = Depends(get_db), device_type: s
 
 
 @router.post("/ota/releases")
-async def create_ota_release(request: Request, db: Session = Depends(get_db)):
+async def create_ota_release(
+    request: Request, background_tasks: BackgroundTasks, db: Session = Depends(get_db)
+):
     redirect_response = require_admin_or_redirect(request)
     if redirect_response:
         return redirect_response
@@ -714,12 +737,46 @@ async def create_ota_release(request: Request, db: Session = Depends(get_db)):
         set_flash(request, error="Device type and firmware file are required")
         return redirect_to("/admin-ui/ota/releases")
 
-    file_bytes = await upload.read()
-    if not file_bytes:
+    staged = await ota_service.stage_upload(upload)
+    try:
+        return _register_staged_release(
+            request,
+            db,
+            staged,
+            upload,
+            background_tasks,
+            device_type=device_type,
+            version=version,
+            build_raw=build_raw,
+            description=description,
+            release_notes=release_notes,
+            min_current_version=min_current_version,
+            is_stable=is_stable,
+        )
+    finally:
+        ota_service.discard_upload(staged)
+
+
+def _register_staged_release(
+    request: Request,
+    db: Session,
+    staged: StagedUpload,
+    upload,
+    background_tasks: BackgroundTasks,
+    *,
+    device_type: str,
+    version: str,
+    build_raw: str,
+    description: str | None,
+    release_notes: str | None,
+    min_current_version: str | None,
+    is_stable: bool,
+):
+    if not staged.file_size:
         set_flash(request, error="Uploaded file is empty")
         return redirect_to("/admin-ui/ota/releases")
 
-    parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(file_bytes)
+    parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(staged.header)
     if parsed_version:
         if version and version != parsed_version:
             set_flash(request, error="Version does not match firmware binary")
@@ -771,21 +828,19 @@ async def create_ota_release(request: Request, db: Session = Depends(get_db)):
         set_flash(request, error="Firmware with same device type, version, and build already exists")
         return redirect_to("/admin-ui/ota/releases")
 
-    binary_path = f"{safe_device_type}/v{version}_b{build_number}.bin"
-    file_path = ota_service.firmware_path / binary_path
-    file_path.parent.mkdir(parents=True, exist_ok=True)
-
-    file_path.write_bytes(file_bytes)
-    file_hash = ota_service.calculate_file_hash(file_path)
-    file_size = file_path.stat().st_size
+    # Held until the row is committed, so a concurrent delete keeps the shared object
+    lock_objects(db, [object_relative_path(staged.file_hash)])
+    binary_path = ota_service.commit_upload(
+        staged, app_desc_metadata(parsed_version, parsed_build, raw_version)
+    )
 
     firmware = Firmware(
         device_type=device_type,
         version=version,
         build_number=build_number,
         filename=filename,
-        file_size=file_size,
-        file_hash=file_hash,
+        file_size=staged.file_size,
+        file_hash=staged.file_hash,
         binary_path=binary_path,
         description=description,
         release_notes=release_notes,
@@ -796,6 +851,10 @@ async def create_ota_release(request: Request, db: Session = Depends(get_db)):
     )
     db.add(firmware)
     db.commit()
+    firmware_index.invalidate()
+    background_tasks.add_task(generate_patches_task, firmware.id, str(ota_service.firmware_path))
+    if settings.ota_compress_firmware:
+        background_tasks.add_task(compress_firmware_task, firmware.id, str(ota_service.firmware_path))
     set_flash(request, message="Firmware uploaded and registered")
     return redirect_to("/admin-ui/ota/releases")
 
@@ -815,8 +874,8 @@ async def inspect_ota_binary(request: Request) -> JSONResponse:
     if not upload:
         return JSONResponse({"ok": False, "error": "No file provided"}, status_code=400)
 
-    file_bytes = await upload.read()
-    parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(file_bytes)
+    header = await upload.read(UPLOAD_CHUNK_SIZE)
+    parsed_version, parsed_build, raw_version = parse_esp_app_desc_version(header)
     if not parsed_version:
         return JSONResponse({"ok": False, "error": "Unable to parse version from firmware"}, status_code=400)
 
@@ -961,6 +1020,7 @@ async def update_ota_release(request: Request, firmware_id: int, db: Session = D
         firmware.released_at = utcnow()
 
     db.commit()
+    firmware_index.invalidate()
     set_flash(request, message="Firmware updated")
     return redirect_to("/admin-ui/ota/releases")
 
@@ -981,32 +1041,39 @@ async def delete_ota_release(request: Request, firmware_id: int, db: Session = D
         set_flash(request, error="Firmware not found")
         return redirect_to("/admin-ui/ota/releases")
 
-    binary_path = ota_service.get_firmware_binary_path(firmware)
+    # Objects may be shared with other releases; only unreferenced ones go
+    paths = {firmware.binary_path, firmware.compressed_path}
+    paths.update(
+        patch.patch_path
+        for patch in db.query(FirmwarePatch).filter(
+            (FirmwarePatch.firmware_id == firmware.id)
+            | (FirmwarePatch.source_firmware_id == firmware.id)
+        )
+    )
+    db.delete(firmware)
+    db.commit()
+    firmware_index.invalidate()
     try:
-        if binary_path.exists():
-            binary_path.unlink()
+        remove_unreferenced(db, ota_service.store, paths, settings.ota_object_grace_seconds)
     except OSError:
-        set_flash(request, error="Firmware file could not be deleted")
+        set_flash(request, error="Firmware deleted, but its files could not be removed")
         return redirect_to("/admin-ui/ota/releases")
-
-    db.delete(firmware)
-    db.commit()
     set_flash(request, message="Firmware deleted")
     return redirect_to("/admin-ui/ota/releases")
 
 
 @router.get("/ota/devices")
-def ota_devices(request: Request, db: Session = Depends(get_db)):
+def ota_devices(request: Request, db: Session = Depends(get_db), cursor: str | None = None):
     redirect_response = require_admin_or_redirect(request)
     if redirect_response:
         return redirect_response
 
-    logs = (
-        db.query(DeviceOTALog)
-        .order_by(DeviceOTALog.updated_at.desc())
-        .limit(50)
-        .all()
-    )
+    try:
+        logs, next_cursor = keyset_page(
+            db.query(DeviceOTALog), DeviceOTALog.created_at, DeviceOTALog.id, cursor, PAGE_SIZE
+        )
+    except ValueError:
+        return redirect_to("/admin-ui/ota/devices")
 
     context = build_admin_context(
         request,
@@ -1014,6 +1081,8 @@ def ota_devices(request: Request, db: Session = Depends(get_db)):
         "ota",
         "ota-devices",
         logs=logs,
+        next_cursor=next_cursor,
+        first_page=not cursor,
     )
     return templates.TemplateResponse("ota_devices.html", context)
 
@@ -1034,33 +1103,108 @@ def ota_channels(request: Request):
 
 
 @router.get("/ota/policies")
-def ota_policies(request: Request):
+def ota_policies(request: Request, db: Session = Depends(get_db)):
     redirect_response = require_admin_or_redirect(request)
     if redirect_response:
         return redirect_response
 
+    firmwares = (
+        db.query(Firmware)
+        .filter(Firmware.is_active == True, Firmware.is_stable == True)
+        .order_by(Firmware.device_type, Firmware.created_at.desc())
+        .all()
+    )
     context = build_admin_context(
         request,
         "OTA Policies",
         "ota",
         "ota-policies",
+        firmwares=firmwares,
+        inflight=rollout_scheduler.inflight(db),
+        stats=ota_service.get_rollout_stats(db, [firmware.id for firmware in firmwares]),
+        default_cap=settings.ota_rollout_max_concurrent,
+        retry_seconds=settings.ota_rollout_retry_seconds,
+        csrf_token=get_csrf_token(request),
     )
     return templates.TemplateResponse("ota_policies.html", context)
 
 
+@router.post("/ota/policies/{firmware_id}")
+async def update_ota_policy(request: Request, firmware_id: int, db: Session = Depends(get_db)):
+    redirect_response = require_admin_or_redirect(request)
+    if redirect_response:
+        return redirect_response
+
+    form = await request.form()
+    csrf_error = require_csrf(request, form, "/admin-ui/ota/policies")
+    if csrf_error:
+        return csrf_error
+
+    firmware = db.query(Firmware).filter(Firmware.id == firmware_id).first()
+    if not firmware:
+        set_flash(request, error="Firmware not found")
+        return redirect_to("/admin-ui/ota/policies")
+
+    try:
+        rollout_percent = int(str(form.get("rollout_percent") or "100").strip())
+        cap_raw = str(form.get("max_concurrent_downloads") or "").strip()
+        max_concurrent_downloads = int(cap_raw) if cap_raw else None
+    except ValueError:
+        set_flash(request, error="Rollout percent and concurrency cap must be numbers")
+        return redirect_to("/admin-ui/ota/policies")
+    if not 0 <= rollout_percent <= 100 or (max_concurrent_downloads is not None and max_concurrent_downloads < 0):
+        set_flash(request, error="Rollout percent must be 0-100 and the cap non-negative")
+        return redirect_to("/admin-ui/ota/policies")
+
+    firmware.rollout_percent = rollout_percent
+    firmware.max_concurrent_downloads = max_concurrent_downloads
+    db.commit()
+    firmware_index.invalidate()
+    set_flash(request, message="Rollout updated")
+    return redirect_to("/admin-ui/ota/policies")
+
+
 @router.get("/ota/monitoring")
 def ota_monitoring(request: Request, db: Session = Depends(get_db)):
     redirect_response = require_admin_or_redirect(request)
     if redirect_response:
         return redirect_response
 
+    # Newest attempts first, read through the (status, created_at) index
     failed_logs = (
         db.query(DeviceOTALog)
         .filter(DeviceOTALog.status == "failed")
-        .order_by(DeviceOTALog.updated_at.desc())
+        .order_by(DeviceOTALog.created_at.desc())
         .limit(25)
         .all()
     )
+    # Most recently active first, among the newest downloads (bounded by the same index)
+    recent_downloads = (
+        db.query(DeviceOTALog.id)
+        .filter(DeviceOTALog.status == "downloading")
+        .order_by(DeviceOTALog.created_at.desc())
+        .limit(500)
+        .subquery()
+    )
+    active_logs = (
+        db.query(DeviceOTALog)
+        .options(joinedload(DeviceOTALog.firmware))
+        .filter(DeviceOTALog.id.in_(select(recent_downloads.c.id)))
+        .order_by(DeviceOTALog.updated_at.desc())
+        .limit(50)
+        .all()
+    )
+    # Progress not yet flushed to the database is read from the buffer
+    active_downloads = []
+    for log in active_logs:
+        live_bytes = progress_buffer.live_bytes(log.id)
+        active_downloads.append(
+            {
+                "log": log,
+                "bytes_downloaded": live_bytes if live_bytes is not None else (log.bytes_downloaded or 0),
+                "file_size": log.firmware.file_size if log.firmware else None,
+            }
+        )
 
     context = build_admin_context(
         request,
@@ -1068,6 +1212,9 @@ def ota_monitoring(request: Request, db: Session = Depends(get_db)):
         "ota",
         "ota-monitoring",
         failed_logs=failed_logs,
+        active_downloads=active_downloads,
+        rollout_stats=sorted(ota_service.get_rollout_stats(db).items(), reverse=True),
+        statuses=["pending", "downloading", "installing", "success", "failed"],
     )
     return templates.TemplateResponse("ota_monitoring.html", context)
 
@@ -1124,6 +1271,7 @@ async def seed_allowlist(request: Request, db: Session = Depends(get_db)):
         return redirect_to("/admin-ui/erp-allowlist")
 
     seed_allowlist_from_settings(db)
+    allowlist_cache.invalidate()
     if has_allowlist_entries(db):
         set_flash(request, message="Defaults loaded into allowlist")
     else:
@@ -1168,6 +1316,7 @@ async def add_allowlist_doctype(request: Request, db: Session = Depends(get_db))
         set_flash(request, error="Doctype already exists")
         return redirect_to("/admin-ui/erp-allowlist")
 
+    allowlist_cache.invalidate()
     set_flash(request, message="Doctype added")
     return redirect_to("/admin-ui/erp-allowlist")
 
@@ -1209,6 +1358,7 @@ async def add_allowlist_method(request: Request, db: Session = Depends(get_db)):
         set_flash(request, error="Method already exists")
         return redirect_to("/admin-ui/erp-allowlist")
 
+    allowlist_cache.invalidate()
     set_flash(request, message="Method added")
     return redirect_to("/admin-ui/erp-allowlist")
 
@@ -1237,5 +1387,6 @@ async def delete_allowlist_entry(request: Request, entry_id: str, db: Session =
 
     db.delete(entry)
     db.commit()
+    allowlist_cache.invalidate()
     set_flash(request, message="Allowlist entry deleted")
     return redirect_to("/admin-ui/erp-allowlist")
@@ -0,0 +1,44 @@
+"""Compare a benchmark run against the stored baseline, or record a new one.
+
+    python -m benchmarks.compare results/micro.json benchmarks/baseline/micro.json
+    python -m benchmarks.compare results/fleet_stats.csv benchmarks/baseline/fleet.json --write-baseline
+
+Exits with 1 when any operation regressed beyond the tolerance.
+"""
+import argparse
+import json
+import sys
+from pathlib import Path
+
+from benchmarks.report import compare, format_table, load_results
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Compare benchmark results with a baseline")
+    parser.add_argument("results", help="micro-benchmark JSON or locust *_stats.csv")
+    parser.add_argument("baseline", help="baseline JSON")
+    parser.add_argument("--tolerance", type=float, default=0.15, help="allowed regression, 0.15 = 15%%")
+    parser.add_argument("--write-baseline", action="store_true", help="store results as the new baseline")
+    args = parser.parse_args()
+
+    current = load_results(args.results)
+    print(format_table(current))
+
+    baseline_path = Path(args.baseline)
+    if args.write_baseline:
+        baseline_path.parent.mkdir(parents=True, exist_ok=True)
+        baseline_path.write_text(json.dumps(current, indent=2, sort_keys=True) + "\n")
+        print(f"Baseline written: {baseline_path}")
+        return 0
+    if not baseline_path.exists():
+        print(f"Baseline not found: {baseline_path} (record one with --write-baseline)")
+        return 1
+
+    problems = compare(current, load_results(baseline_path), args.tolerance)
+    for problem in problems:
+        print(f"REGRESSION {problem}")
+    return 1 if problems else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
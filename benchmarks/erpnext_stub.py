@@ -0,0 +1,65 @@
+"""Stand-in ERPNext for load tests: canned list and document responses.
+
+    uvicorn benchmarks.erpnext_stub:app --host 0.0.0.0 --port 9000
+
+Rows are generated once per doctype so responses cost the stub almost
+nothing; STUB_LATENCY_MS adds a fixed upstream delay and STUB_ROWS sets the
+size of each listing (honouring limit_start / limit_page_length).
+"""
+import asyncio
+import json
+import os
+from functools import lru_cache
+
+from fastapi import FastAPI, Query
+from fastapi.responses import Response
+
+LATENCY_SECONDS = float(os.environ.get("STUB_LATENCY_MS", "20")) / 1000
+ROWS = int(os.environ.get("STUB_ROWS", "2000"))
+
+app = FastAPI(title="ERPNext stub")
+
+
+@lru_cache(maxsize=64)
+def _rows(doctype: str) -> tuple[dict, ...]:
+    return tuple(
+        {
+            "name": f"{doctype[:4].upper()}-{i:06d}",
+            "item_code": f"ITEM-{i:06d}",
+            "item_name": f"Item {i}",
+            "warehouse": f"Stores {i % 8} - B",
+            "actual_qty": float(i % 500),
+            "status": "Open",
+            "modified": f"2026-01-01 00:{i // 60 % 60:02d}:{i % 60:02d}.000000",
+            "creation": "2026-01-01 00:00:00.000000",
+        }
+        for i in range(ROWS)
+    )
+
+
+def _json(payload: dict) -> Response:
+    return Response(json.dumps(payload, separators=(",", ":")), media_type="application/json")
+
+
+@app.get("/api/resource/{doctype}")
+async def list_resource(
+    doctype: str,
+    limit_start: int = Query(default=0),
+    limit_page_length: int = Query(default=20),
+) -> Response:
+    await asyncio.sleep(LATENCY_SECONDS)
+    rows = _rows(doctype)
+    return _json({"data": list(rows[limit_start:limit_start + max(0, limit_page_length)])})
+
+
+@app.get("/api/resource/{doctype}/{name}")
+async def get_resource(doctype: str, name: str) -> Response:
+    await asyncio.sleep(LATENCY_SECONDS)
+    row = dict(_rows(doctype)[0], name=name)
+    return _json({"data": {**row, "items": [dict(r) for r in _rows("Pick List Item")[:20]]}})
+
+
+@app.get("/api/method/{method}")
+async def call_method(method: str) -> Response:
+    await asyncio.sleep(LATENCY_SECONDS)
+    return _json({"message": {}})
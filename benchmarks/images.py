@@ -0,0 +1,19 @@
+"""Synthetic ESP-IDF images: random payload behind a valid app descriptor."""
+import os
+
+_APP_DESC_MAGIC = 0xABCD5432
+_APP_DESC_OFFSET = 24 + 8  # esp_image_header_t + esp_image_segment_header_t
+_APP_DESC_SIZE = 256
+_VERSION_OFFSET = 16
+_VERSION_LEN = 32
+
+
+def make_image(raw_version: str, size: int = 1024 * 1024) -> bytes:
+    """Image of `size` bytes whose app descriptor carries `raw_version` (e.g. "1.2.3+4")."""
+    desc = bytearray(_APP_DESC_SIZE)
+    desc[0:4] = _APP_DESC_MAGIC.to_bytes(4, "little")
+    encoded = raw_version.encode("utf-8")[: _VERSION_LEN - 1]
+    desc[_VERSION_OFFSET:_VERSION_OFFSET + len(encoded)] = encoded
+    header = bytes([0xE9]) + bytes(_APP_DESC_OFFSET - 1)
+    body = os.urandom(max(0, size - _APP_DESC_OFFSET - _APP_DESC_SIZE))
+    return header + bytes(desc) + body
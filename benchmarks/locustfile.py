@@ -0,0 +1,167 @@
+"""Device fleet load test: the protocol of ESP32_OTA_CLIENT_EXAMPLE.c at scale.
+
+    locust -f benchmarks/locustfile.py --host http://localhost:8000 \
+        --users 5000 --spawn-rate 100 --run-time 10m --headless --csv results/fleet
+
+Each simulated device activates once, then loops: POST /api/ota/check with
+its last ETag, and when an update is offered downloads the signed URL and
+reports progress through /api/ota/status/batch the way the client does
+(coalesced "downloading" events, then "installing" and "success"). The
+server's X-Next-Check-After is honoured, multiplied by LOADTEST_TIME_SCALE
+so an hour-long poll interval fits in a test run. Scanner users read the
+ERPNext proxy, which should point at benchmarks.erpnext_stub.
+
+Every device sends its own X-Forwarded-For, so per-IP rate limits behave as
+they would for a real fleet. Environment:
+  BENCH_COMPANY_CODE, BENCH_LICENSE_KEY  from benchmarks.seed
+  LOADTEST_TIME_SCALE                    default 0.001 (3600 s -> 3.6 s)
+  LOADTEST_CURRENT_VERSION               version devices start on, default 1.0.0
+  LOADTEST_DEVICE_ID_BASE                first device id, default 100000
+"""
+import itertools
+import json
+import os
+import random
+
+from locust import between, task
+from locust.contrib.fasthttp import FastHttpUser
+
+from benchmarks.micro import DEVICE_TYPE
+
+COMPANY_CODE = os.environ.get("BENCH_COMPANY_CODE", "bench")
+LICENSE_KEY = os.environ.get("BENCH_LICENSE_KEY", "")
+TIME_SCALE = float(os.environ.get("LOADTEST_TIME_SCALE", "0.001"))
+START_VERSION = os.environ.get("LOADTEST_CURRENT_VERSION", "1.0.0")
+# One counter per locust process; give each worker its own base when distributed
+_device_ids = itertools.count(int(os.environ.get("LOADTEST_DEVICE_ID_BASE", "100000")))
+
+
+class ActivatedDevice(FastHttpUser):
+    abstract = True
+
+    def on_start(self) -> None:
+        self.device_id = next(_device_ids)
+        self.ip = f"10.{self.device_id >> 16 & 255}.{self.device_id >> 8 & 255}.{self.device_id & 255}"
+        self.token = None
+        with self.client.post(
+            "/activate",
+            json={"license_key": LICENSE_KEY, "device_id": str(self.device_id), "company_code": COMPANY_CODE},
+            headers={"X-Forwarded-For": self.ip},
+            name="/activate",
+            catch_response=True,
+        ) as response:
+            if response.status_code != 200:
+                response.failure(f"activate {response.status_code}")
+                return
+            self.token = response.json()["access_token"]
+
+    def headers(self, **extra: str) -> dict[str, str]:
+        return {"Authorization": f"Bearer {self.token}", "X-Forwarded-For": self.ip, **extra}
+
+
+class Device(ActivatedDevice):
+    weight = 10
+
+    def on_start(self) -> None:
+        super().on_start()
+        self.version = START_VERSION
+        self.build = 1
+        self.etag = None
+        self.next_wait = random.uniform(0, 3600) * TIME_SCALE  # Fleets do not boot in lockstep
+
+    def wait_time(self) -> float:
+        return self.next_wait
+
+    @task
+    def poll(self) -> None:
+        if not self.token:
+            self.next_wait = 60 * TIME_SCALE
+            return
+        headers = self.headers(**({"If-None-Match": self.etag} if self.etag else {}))
+        with self.client.post(
+            "/api/ota/check",
+            json={
+                "device_id": self.device_id,
+                "device_type": DEVICE_TYPE,
+                "current_version": self.version,
+                "current_build": self.build,
+            },
+            headers=headers,
+            name="/api/ota/check",
+            catch_response=True,
+        ) as response:
+            if response.status_code not in (200, 304):
+                response.failure(f"check {response.status_code}")
+                self.next_wait = 60 * TIME_SCALE
+                return
+            self.etag = response.headers.get("ETag") or self.etag
+            self.next_wait = float(response.headers.get("X-Next-Check-After") or 3600) * TIME_SCALE
+            offer = response.json() if response.status_code == 200 else {}
+        if offer.get("update_available"):
+            self.install(offer)
+
+    def install(self, offer: dict) -> None:
+        firmware_id = offer["firmware_id"]
+        with self.client.get(
+            offer["download_url"],
+            headers=self.headers(),
+            name="/api/ota/download/{firmware_id}",
+            catch_response=True,
+        ) as response:
+            size = len(response.content or b"")
+            if response.status_code != 200 or size != offer["file_size"]:
+                response.failure(f"download {response.status_code}, {size} bytes")
+                self.report(firmware_id, [("failed", size)])
+                return
+        # The client coalesces progress and flushes it with the next state change
+        progress = [("downloading", size * step // 4) for step in range(1, 5)]
+        self.report(firmware_id, progress + [("installing", size), ("success", size)])
+        self.version, self.build = offer["version"], offer["build_number"]
+        self.etag = None
+
+    def report(self, firmware_id: int, events: list[tuple[str, int]]) -> None:
+        self.client.post(
+            "/api/ota/status/batch",
+            data=json.dumps(
+                {
+                    "device_id": self.device_id,
+                    "events": [
+                        {"firmware_id": firmware_id, "status": status, "bytes_downloaded": done}
+                        for status, done in events
+                    ],
+                }
+            ),
+            headers=self.headers(**{"Content-Type": "application/json"}),
+            name="/api/ota/status/batch",
+        )
+
+
+class Scanner(ActivatedDevice):
+    """Handheld reading stock through the ERPNext proxy."""
+
+    weight = 1
+    wait_time = between(1, 5)
+
+    @task(4)
+    def bin(self) -> None:
+        item = f"ITEM-{random.randrange(2000):06d}"
+        self.client.get(
+            "/bin",
+            params={"filters": json.dumps([["item_code", "=", item]])},
+            headers=self.headers(),
+            name="/bin",
+        )
+
+    @task(2)
+    def item_by_product_code(self) -> None:
+        code = f"ITEM-{random.randrange(2000):06d}"
+        self.client.get(
+            "/items/by-product-code",
+            params={"filters": json.dumps([["item_code", "=", code]])},
+            headers=self.headers(),
+            name="/items/by-product-code",
+        )
+
+    @task(1)
+    def warehouses(self) -> None:
+        self.client.get("/warehouses", headers=self.headers(), name="/warehouses")
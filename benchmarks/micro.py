@@ -0,0 +1,168 @@
+"""Micro-benchmarks for the hot paths of the device protocol.
+
+    python -m benchmarks.micro --output results/micro.json
+
+`check_update_available`, `parse_esp_app_desc_version` and `RateLimiter.allow`
+run in-process without a database: the firmware index and the rollout
+scheduler are fed synthetic releases. `_activate` needs the database from
+DATABASE_URL seeded by `benchmarks.seed`; it is skipped unless
+BENCH_COMPANY_CODE and BENCH_LICENSE_KEY are set. Its per-IP rate limits are
+bypassed so the run measures lookup, bcrypt and the commit.
+"""
+import argparse
+import json
+import os
+import sys
+import tempfile
+import time
+from pathlib import Path
+from types import SimpleNamespace
+from typing import Callable
+
+from benchmarks.images import make_image
+from benchmarks.report import format_table, summarize
+
+DEVICE_TYPE = "bench-device"
+
+
+def run(fn: Callable[[int], object], iterations: int, warmup: int) -> dict[str, float]:
+    for i in range(warmup):
+        fn(i)
+    samples = []
+    clock = time.perf_counter
+    started = clock()
+    for i in range(iterations):
+        t0 = clock()
+        fn(i)
+        samples.append(clock() - t0)
+    return summarize(samples, clock() - started)
+
+
+def bench_parse_version(iterations: int) -> dict[str, float]:
+    from app.services.ota_binary import parse_esp_app_desc_version
+
+    header = make_image("1.4.2+17", size=24 + 8 + 256)
+    assert parse_esp_app_desc_version(header) == ("1.4.2", 17, "1.4.2+17")
+    return run(lambda _: parse_esp_app_desc_version(header), iterations, warmup=1000)
+
+
+def bench_rate_limiter(iterations: int, keys: int) -> dict[str, float]:
+    from app.services.rate_limit import RateLimiter
+
+    # A fleet behind many IPs: mostly distinct keys, each well under its limit
+    limiter = RateLimiter(max_requests=60, window_seconds=60, name="bench")
+    names = [f"10.{i >> 16 & 255}.{i >> 8 & 255}.{i & 255}" for i in range(keys)]
+    return run(lambda i: limiter.allow(names[i % keys]), iterations, warmup=keys)
+
+
+def _firmware(id: int, version: str, build: int, rollout_percent: int) -> SimpleNamespace:
+    return SimpleNamespace(
+        id=id,
+        device_type=DEVICE_TYPE,
+        version=version,
+        build_number=build,
+        file_hash=f"{id:064x}",
+        file_size=1536 * 1024,
+        description=None,
+        min_current_version=None,
+        compressed_path=f"{DEVICE_TYPE}/v{version}_b{build}.bin.hs",
+        compressed_hash=f"{id + 1:064x}",
+        compressed_size=1024 * 1024,
+        compression="heatshrink",
+        rollout_percent=rollout_percent,
+        max_concurrent_downloads=None,
+    )
+
+
+def bench_check_update(iterations: int, releases: int) -> dict[str, float]:
+    import app.services.ota as ota_module
+    from app.schemas.ota import OTACheckRequest
+    from app.services.ota_index import FirmwareIndex, build_index
+    from app.services.ota_rollout import RolloutScheduler
+
+    # Newest release on a 25% wave, so most devices fall through to older ones
+    firmwares = [
+        _firmware(id, f"1.{id}.0", 1, 25 if id == releases else 100) for id in range(1, releases + 1)
+    ]
+    entries = build_index(firmwares)
+
+    class StaticIndex(FirmwareIndex):
+        def _load_stamp(self, db):
+            return (len(firmwares),)
+
+        def _load_entries(self, db):
+            return entries
+
+    class IdleScheduler(RolloutScheduler):
+        def _load_counts(self, db, cutoff):
+            return {}
+
+        def _is_downloading(self, db, firmware_id, device_id, cutoff):
+            return False
+
+    ota_module.firmware_index = StaticIndex(refresh_interval_seconds=3600)
+    ota_module.rollout_scheduler = IdleScheduler(refresh_interval_seconds=3600, stale_seconds=1800, default_cap=0)
+    service = ota_module.OTAService(firmware_base_path=tempfile.mkdtemp(prefix="ota-bench-"))
+
+    requests = [
+        OTACheckRequest(device_id=device_id, device_type=DEVICE_TYPE, current_version="1.0.0", current_build=1)
+        for device_id in range(1, 1001)
+    ]
+    return run(lambda i: service.check_update_available(None, requests[i % len(requests)]), iterations, warmup=100)
+
+
+def bench_activate(iterations: int) -> dict[str, float] | None:
+    company_code = os.environ.get("BENCH_COMPANY_CODE")
+    license_key = os.environ.get("BENCH_LICENSE_KEY")
+    if not company_code or not license_key:
+        return None
+
+    from starlette.requests import Request
+
+    import app.api.routes.auth as auth_routes
+    from app.db import SessionLocal
+    from app.schemas import ActivateRequest
+
+    auth_routes.rate_limit_activate = lambda request, key: None
+    request = Request({"type": "http", "method": "POST", "path": "/activate", "headers": [], "client": ("10.0.0.1", 0)})
+
+    def activate(i: int) -> None:
+        payload = ActivateRequest(license_key=license_key, device_id=str(900000 + i % 100), company_code=company_code)
+        db = SessionLocal()
+        try:
+            auth_routes._activate(payload, request, db, allow_ota_access=False)
+        finally:
+            db.close()
+
+    return run(activate, iterations, warmup=5)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Run OTA/licensing micro-benchmarks")
+    parser.add_argument("--iterations", type=int, default=20000)
+    parser.add_argument("--activate-iterations", type=int, default=200)
+    parser.add_argument("--releases", type=int, default=20, help="stable releases in the synthetic index")
+    parser.add_argument("--keys", type=int, default=10000, help="distinct rate limiter keys")
+    parser.add_argument("--output", help="write results as JSON for benchmarks.compare")
+    args = parser.parse_args()
+
+    results = {
+        "parse_esp_app_desc_version": bench_parse_version(args.iterations * 5),
+        "RateLimiter.allow": bench_rate_limiter(args.iterations * 5, args.keys),
+        "check_update_available": bench_check_update(args.iterations, args.releases),
+    }
+    activate = bench_activate(args.activate_iterations)
+    if activate is not None:
+        results["_activate"] = activate
+    else:
+        print("_activate skipped: set BENCH_COMPANY_CODE and BENCH_LICENSE_KEY (see benchmarks.seed)")
+
+    print(format_table(results))
+    if args.output:
+        Path(args.output).parent.mkdir(parents=True, exist_ok=True)
+        Path(args.output).write_text(json.dumps(results, indent=2, sort_keys=True) + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
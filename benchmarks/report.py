@@ -0,0 +1,80 @@
+"""Benchmark result format and comparison against a stored baseline.
+
+Results are a JSON object keyed by operation name (a micro-benchmark or a
+"METHOD /route" from a load test), each holding throughput in operations per
+second and p50/p99 latency in milliseconds. Locust `--csv` stats files are
+read into the same shape.
+"""
+import csv
+import json
+import math
+from pathlib import Path
+from typing import Iterable
+
+Results = dict[str, dict[str, float]]
+
+
+def percentile(sorted_samples: list[float], fraction: float) -> float:
+    if not sorted_samples:
+        return 0.0
+    index = min(len(sorted_samples) - 1, max(0, math.ceil(fraction * len(sorted_samples)) - 1))
+    return sorted_samples[index]
+
+
+def summarize(samples_seconds: Iterable[float], elapsed_seconds: float) -> dict[str, float]:
+    samples = sorted(samples_seconds)
+    return {
+        "ops_per_sec": round(len(samples) / elapsed_seconds, 1) if elapsed_seconds > 0 else 0.0,
+        "p50_ms": round(percentile(samples, 0.50) * 1000, 4),
+        "p99_ms": round(percentile(samples, 0.99) * 1000, 4),
+        "count": len(samples),
+    }
+
+
+def _load_locust_stats(path: Path) -> Results:
+    results: Results = {}
+    with path.open(newline="") as handle:
+        for row in csv.DictReader(handle):
+            if row["Name"] == "Aggregated" or not int(row["Request Count"] or 0):
+                continue
+            results[f"{row['Type']} {row['Name']}"] = {
+                "ops_per_sec": float(row["Requests/s"]),
+                "p50_ms": float(row["50%"]),
+                "p99_ms": float(row["99%"]),
+                "count": int(row["Request Count"]),
+                "failures": int(row["Failure Count"]),
+            }
+    return results
+
+
+def load_results(path: str | Path) -> Results:
+    path = Path(path)
+    if path.suffix == ".csv":
+        return _load_locust_stats(path)
+    return json.loads(path.read_text())
+
+
+def compare(current: Results, baseline: Results, tolerance: float) -> list[str]:
+    """Regressions beyond `tolerance` (0.15 = 15%), one message per metric."""
+    problems = []
+    for name, base in sorted(baseline.items()):
+        now = current.get(name)
+        if now is None:
+            problems.append(f"{name}: missing from current run")
+            continue
+        for key in ("p50_ms", "p99_ms"):
+            if base.get(key) and now[key] > base[key] * (1 + tolerance):
+                problems.append(f"{name}: {key} {now[key]:.3f} > baseline {base[key]:.3f}")
+        if base.get("ops_per_sec") and now["ops_per_sec"] < base["ops_per_sec"] * (1 - tolerance):
+            problems.append(f"{name}: ops_per_sec {now['ops_per_sec']:.1f} < baseline {base['ops_per_sec']:.1f}")
+        if now.get("failures"):
+            problems.append(f"{name}: {now['failures']} failed requests")
+    return problems
+
+
+def format_table(results: Results) -> str:
+    width = max([len(name) for name in results] + [9])
+    lines = [f"{'operation':<{width}}  {'ops/s':>10}  {'p50 ms':>10}  {'p99 ms':>10}"]
+    for name, row in sorted(results.items()):
+        lines.append(f"{name:<{width}}  {row['ops_per_sec']:>10.1f}  {row['p50_ms']:>10.3f}  {row['p99_ms']:>10.3f}")
+    return "\n".join(lines)
@@ -0,0 +1,103 @@
+"""Seed a tenant, a license key and a stable firmware release for load tests.
+
+    python -m benchmarks.seed --server-url http://localhost:8000 --admin-token "$ADMIN_TOKEN" \
+        --erpnext-url http://erpnext-stub:9000
+
+The tenant and key are written straight to DATABASE_URL; the firmware goes
+through the admin upload API so the staged-upload path is exercised too.
+Prints the environment for `benchmarks/locustfile.py` and `benchmarks.micro`.
+Re-running reuses the tenant and adds a new key.
+"""
+import argparse
+import secrets
+import sys
+from datetime import datetime, timedelta, timezone
+
+import httpx
+
+from app.db import SessionLocal
+from app.models import LicenseKey, LicenseKeyStatus, Tenant, TenantStatus
+from app.services.license import fingerprint_license_key, hash_license_key
+from benchmarks.images import make_image
+from benchmarks.micro import DEVICE_TYPE
+
+
+def seed_tenant(company_code: str, erpnext_url: str) -> str:
+    license_key = secrets.token_urlsafe(32)
+    db = SessionLocal()
+    try:
+        tenant = db.query(Tenant).filter(Tenant.company_code == company_code).first()
+        if not tenant:
+            tenant = Tenant(
+                company_code=company_code,
+                erpnext_url=erpnext_url.rstrip("/"),
+                api_key="bench",
+                api_secret="bench",
+                status=TenantStatus.active,
+                subscription_expires_at=datetime.now(timezone.utc) + timedelta(days=365),
+            )
+            db.add(tenant)
+            db.flush()
+        db.add(
+            LicenseKey(
+                tenant_id=tenant.id,
+                hashed_key=hash_license_key(license_key),
+                fingerprint=fingerprint_license_key(license_key) or None,
+                status=LicenseKeyStatus.active,
+            )
+        )
+        db.commit()
+    finally:
+        db.close()
+    return license_key
+
+
+def seed_firmware(server_url: str, admin_token: str, version: str, build: int, size: int) -> int:
+    headers = {"X-Admin-Token": admin_token}
+    with httpx.Client(base_url=server_url.rstrip("/"), headers=headers, timeout=60) as client:
+        upload = client.post(
+            "/api/ota/admin/upload",
+            params={"device_type": DEVICE_TYPE},
+            files={"file": (f"bench-{version}.bin", make_image(f"{version}+{build}", size))},
+        )
+        upload.raise_for_status()
+        uploaded = upload.json()
+        created = client.post(
+            "/api/ota/admin/firmware",
+            json={
+                "device_type": DEVICE_TYPE,
+                "version": version,
+                "build_number": build,
+                "filename": f"bench-{version}-{build}.bin",
+                "file_size": uploaded["file_size"],
+                "file_hash": uploaded["file_hash"],
+                "binary_path": uploaded["binary_path"],
+                "is_stable": True,
+                "description": "Load test release",
+            },
+        )
+        created.raise_for_status()
+        return created.json()["id"]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Seed data for the load test")
+    parser.add_argument("--server-url", required=True)
+    parser.add_argument("--admin-token", required=True)
+    parser.add_argument("--erpnext-url", required=True, help="URL of benchmarks.erpnext_stub")
+    parser.add_argument("--company-code", default="bench")
+    parser.add_argument("--version", default="9.0.0", help="release offered to simulated devices")
+    parser.add_argument("--build", type=int, default=1)
+    parser.add_argument("--size", type=int, default=1024 * 1024, help="firmware image size in bytes")
+    args = parser.parse_args()
+
+    license_key = seed_tenant(args.company_code, args.erpnext_url)
+    firmware_id = seed_firmware(args.server_url, args.admin_token, args.version, args.build, args.size)
+    print(f"# firmware {firmware_id} ({DEVICE_TYPE} {args.version}+{args.build})")
+    print(f"export BENCH_COMPANY_CODE={args.company_code}")
+    print(f"export BENCH_LICENSE_KEY={license_key}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
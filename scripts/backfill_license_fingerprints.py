@@ -0,0 +1,61 @@
+import argparse
+import sys
+
+from app.db import SessionLocal
+from app.models import LicenseKey, LicenseKeyStatus
+from app.services.license import fingerprint_license_key, verify_license_key_flexible
+from app.services.license_lookup import count_legacy_keys
+
+
+def backfill(db, raw_keys: list[str]) -> int:
+    legacy_keys = (
+        db.query(LicenseKey)
+        .filter(LicenseKey.status == LicenseKeyStatus.active, LicenseKey.fingerprint.is_(None))
+        .all()
+    )
+    matched = 0
+    for raw_key in raw_keys:
+        fingerprint = fingerprint_license_key(raw_key)
+        if not fingerprint or not legacy_keys:
+            continue
+        if db.query(LicenseKey).filter(LicenseKey.fingerprint == fingerprint).first():
+            continue
+        key = next((key for key in legacy_keys if verify_license_key_flexible(raw_key, key.hashed_key)), None)
+        if not key:
+            continue
+        key.fingerprint = fingerprint
+        legacy_keys.remove(key)
+        db.commit()
+        matched += 1
+    return matched
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description="Backfill fingerprints for legacy license keys from known plaintext keys"
+    )
+    parser.add_argument(
+        "keys_file",
+        nargs="?",
+        help="File with one plaintext license key per line (default: stdin)",
+    )
+    parser.add_argument("--status", action="store_true", help="Only print the number of legacy keys left")
+    args = parser.parse_args()
+
+    db = SessionLocal()
+    try:
+        if not args.status:
+            if args.keys_file:
+                with open(args.keys_file, encoding="utf-8") as f:
+                    raw_keys = [line.strip() for line in f if line.strip()]
+            else:
+                raw_keys = [line.strip() for line in sys.stdin if line.strip()]
+            print(f"Backfilled: {backfill(db, raw_keys)}")
+        print(f"Legacy keys without fingerprint: {count_legacy_keys(db)}")
+        return 0
+    finally:
+        db.close()
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,83 @@
+import argparse
+from pathlib import Path
+
+from app.db import SessionLocal
+from app.models import Firmware, FirmwarePatch
+from app.services.firmware_store import (
+    FirmwareStore,
+    app_desc_metadata,
+    hash_file,
+    object_hash,
+    object_relative_path,
+)
+from app.services.ota_binary import parse_esp_app_desc_version
+
+
+def migrate_file(store: FirmwareStore, relative_path: str, expected_hash: str, parse_header: bool = False) -> str | None:
+    """Move a legacy file into the store; returns its object path, or None if it cannot be moved."""
+    target = object_relative_path(expected_hash)
+    path = store.path_for(relative_path)
+    if store.verified_hash(target) == expected_hash.lower():
+        # Already stored, e.g. by an earlier interrupted run
+        path.unlink(missing_ok=True)
+        return target
+    if not path.exists():
+        print(f"Missing: {relative_path}")
+        return None
+    if hash_file(path) != expected_hash.lower():
+        print(f"Hash mismatch, left in place: {relative_path}")
+        return None
+    app_desc = None
+    if parse_header:
+        with open(path, "rb") as f:
+            app_desc = app_desc_metadata(*parse_esp_app_desc_version(f.read(24 + 8 + 256)))
+    return store.put(path, expected_hash, path.stat().st_size, app_desc)
+
+
+def migrate(db, store: FirmwareStore) -> int:
+    moved = 0
+    for firmware in db.query(Firmware).order_by(Firmware.id).all():
+        if not object_hash(firmware.binary_path):
+            new_path = migrate_file(store, firmware.binary_path, firmware.file_hash, parse_header=True)
+            if new_path:
+                firmware.binary_path = new_path
+                moved += 1
+        if firmware.compressed_path and not object_hash(firmware.compressed_path):
+            new_path = migrate_file(store, firmware.compressed_path, firmware.compressed_hash)
+            if new_path:
+                firmware.compressed_path = new_path
+                moved += 1
+        db.commit()
+    for patch in db.query(FirmwarePatch).order_by(FirmwarePatch.id).all():
+        if not object_hash(patch.patch_path):
+            new_path = migrate_file(store, patch.patch_path, patch.patch_hash)
+            if new_path:
+                patch.patch_path = new_path
+                moved += 1
+                db.commit()
+    return moved
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description="Move firmware files from the per-device-type layout into the content-addressed store"
+    )
+    parser.add_argument("--firmware-dir", default="firmware", help="Firmware directory (default: firmware)")
+    parser.add_argument("--verify", action="store_true", help="Afterwards re-hash every stored object")
+    args = parser.parse_args()
+
+    store = FirmwareStore(Path(args.firmware_dir))
+    db = SessionLocal()
+    try:
+        print(f"Moved into store: {migrate(db, store)}")
+    finally:
+        db.close()
+    if args.verify:
+        result = store.scan(full=True)
+        print(f"Objects: {result.objects}, corrupt: {result.corrupt}")
+        return 1 if result.corrupt else 0
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,34 @@
+import pytest
+
+from app.services import allowlist as allowlist_module
+from app.services.allowlist import Allowlist, AllowlistCache
+
+
+def test_compiled_allowlist_is_immutable_and_normalized():
+    allowlist = Allowlist.compile(["  Pick   List ", "Item"], ["get", " post "])
+
+    assert dict(allowlist.doctypes) == {"pick list": "Pick List", "item": "Item"}
+    assert allowlist.methods == frozenset({"GET", "POST"})
+    with pytest.raises(TypeError):
+        allowlist.doctypes["bin"] = "Bin"
+
+
+def test_cache_reloads_only_when_stamp_changes(monkeypatch):
+    stamps = [(2, "t1")]
+    loads = []
+
+    def load(db):
+        loads.append(1)
+        return Allowlist.compile(["Item"], ["GET"])
+
+    monkeypatch.setattr(allowlist_module, "load_allowlist", load)
+    monkeypatch.setattr(AllowlistCache, "_load_stamp", staticmethod(lambda db: stamps[-1]))
+    cache = AllowlistCache(refresh_interval_seconds=0)
+
+    first = cache.get(None)
+    assert cache.get(None) is first
+    assert len(loads) == 1
+
+    stamps.append((3, "t2"))
+    assert cache.get(None) is not first
+    assert len(loads) == 2
@@ -0,0 +1,106 @@
+import uuid
+from datetime import date, datetime, timezone
+
+import pytest
+
+from app.services.audit import AuditBuffer, add_months, expired_partitions, maintain_partitions, partition_ddl
+
+
+class FakeResult:
+    def __init__(self, rows):
+        self.rows = rows
+
+    def scalars(self):
+        return iter(self.rows)
+
+    def scalar(self):
+        return self.rows[0] if self.rows else None
+
+
+class FakeSession:
+    def __init__(self, fail=False, tenants=(), answers=None):
+        self.fail = fail
+        self.tenants = list(tenants)
+        # Canned results keyed by a fragment of the SQL text
+        self.answers = answers or {}
+        self.statements = []
+        self.committed = False
+        self.rolled_back = False
+
+    def execute(self, statement, params=None):
+        if self.fail:
+            raise RuntimeError("db down")
+        self.statements.append(statement)
+        if "tenants" in str(statement):
+            return FakeResult(self.tenants)
+        for fragment, rows in self.answers.items():
+            if fragment in str(statement):
+                return FakeResult(rows)
+        return FakeResult([])
+
+    def commit(self):
+        self.committed = True
+
+    def rollback(self):
+        self.rolled_back = True
+
+
+def test_partition_ranges_cover_whole_months():
+    assert add_months(date(2026, 11, 1), 2) == date(2027, 1, 1)
+    assert add_months(date(2026, 1, 1), -1) == date(2025, 12, 1)
+    assert partition_ddl(date(2026, 12, 1)).endswith(
+        "audit_logs_p202612 PARTITION OF audit_logs "
+        "FOR VALUES FROM ('2026-12-01 00:00:00+00') TO ('2027-01-01 00:00:00+00')"
+    )
+
+
+def test_only_partitions_fully_past_retention_expire():
+    names = ["audit_logs_p202508", "audit_logs_p202509", "audit_logs_p202510", "audit_logs_default"]
+    now = datetime(2026, 10, 14, tzinfo=timezone.utc)
+
+    assert expired_partitions(names, now, retention_months=12) == ["audit_logs_p202508", "audit_logs_p202509"]
+
+
+def test_flush_batches_rows_and_requeues_on_failure():
+    buffer = AuditBuffer(max_rows=3)
+    tenant, other = uuid.uuid4(), uuid.uuid4()
+    for action in ("a", "b", "c", "d"):
+        buffer.record(action, tenant_id=tenant)
+    buffer.record("e", tenant_id=other)
+    buffer.discard_tenant(other)
+    assert len(buffer) == 2  # Oldest rows dropped past max_rows, then "e" discarded
+
+    with pytest.raises(RuntimeError):
+        buffer.flush(FakeSession(fail=True))
+    assert len(buffer) == 2
+
+    db = FakeSession(tenants=[tenant])
+    assert buffer.flush(db) == 2
+    assert len(db.statements) == 2 and db.committed
+    assert len(buffer) == 0
+
+
+def test_flush_drops_rows_of_deleted_tenants():
+    buffer = AuditBuffer(max_rows=10)
+    live, deleted = uuid.uuid4(), uuid.uuid4()
+    buffer.record("a", tenant_id=live)
+    buffer.record("b", tenant_id=deleted)
+    buffer.record("c")
+
+    assert buffer.flush(FakeSession(tenants=[live])) == 2
+
+
+def test_rows_stranded_in_default_partition_are_moved_first():
+    db = FakeSession(
+        answers={
+            "pg_inherits": ["audit_logs_default", "audit_logs_p202610"],
+            "FROM audit_logs_default WHERE": [True],
+        }
+    )
+    maintain_partitions(db, datetime(2026, 10, 14, tzinfo=timezone.utc), months_ahead=1, retention_months=0)
+
+    sql = [str(statement) for statement in db.statements]
+    detach = sql.index("ALTER TABLE audit_logs DETACH PARTITION audit_logs_default")
+    assert sql[detach + 1] == partition_ddl(date(2026, 11, 1))
+    assert sql[detach + 4] == "ALTER TABLE audit_logs ATTACH PARTITION audit_logs_default DEFAULT"
+    assert not any("audit_logs_p202610 PARTITION OF" in statement for statement in sql)
@@ -0,0 +1,89 @@
+import asyncio
+
+from app.services.erp_cache import ResponseCache, cache_key
+
+
+class FakeResponse:
+    def __init__(self, content: bytes, status_code: int = 200) -> None:
+        self.content = content
+        self.status_code = status_code
+        self.headers = {"content-type": "application/json"}
+
+
+def make_fetch(calls: list, status_code: int = 200):
+    async def fetch():
+        calls.append(1)
+        await asyncio.sleep(0)
+        return FakeResponse(b"v%d" % len(calls), status_code)
+
+    return fetch
+
+
+def test_concurrent_misses_share_one_fetch():
+    async def scenario():
+        cache = ResponseCache(ttl_seconds=60, stale_seconds=60, max_entries=10)
+        calls = []
+        key = cache_key("t1", "Item", "/api/resource/Item", {"fields": "x"})
+        results = await asyncio.gather(*(cache.get_or_fetch(key, make_fetch(calls)) for _ in range(5)))
+        assert len(calls) == 1
+        assert {r[0].content for r in results} == {b"v1"}
+        assert (await cache.get_or_fetch(key, make_fetch(calls)))[1] == "HIT"
+
+    asyncio.run(scenario())
+
+
+def test_stale_entry_is_served_while_refreshing():
+    async def scenario():
+        cache = ResponseCache(ttl_seconds=10, stale_seconds=60, max_entries=10)
+        calls = []
+        key = cache_key("t1", "Warehouse", "/api/resource/Warehouse", None)
+        first, _ = await cache.get_or_fetch(key, make_fetch(calls))
+
+        cached, state = await cache.get_or_fetch(key, make_fetch(calls), now=first.fetched_at + 20)
+        assert (cached.content, state) == (b"v1", "STALE")
+        await asyncio.sleep(0.01)
+        assert len(calls) == 2
+        assert (await cache.get_or_fetch(key, make_fetch(calls)))[0].content == b"v2"
+
+    asyncio.run(scenario())
+
+
+def test_invalidate_drops_tenant_doctype_and_errors_are_not_cached():
+    async def scenario():
+        cache = ResponseCache(ttl_seconds=60, stale_seconds=60, max_entries=10)
+        calls = []
+        item = cache_key("t1", "Item", "/api/resource/Item", None)
+        other_tenant = cache_key("t2", "Item", "/api/resource/Item", None)
+        await cache.get_or_fetch(item, make_fetch(calls))
+        await cache.get_or_fetch(other_tenant, make_fetch(calls))
+
+        cache.invalidate("t1", "item")
+        assert (await cache.get_or_fetch(item, make_fetch(calls)))[1] == "MISS"
+        assert (await cache.get_or_fetch(other_tenant, make_fetch(calls)))[1] == "HIT"
+
+        missing = cache_key("t1", "Item", "/api/resource/Item/nope", None)
+        await cache.get_or_fetch(missing, make_fetch(calls, status_code=404))
+        assert (await cache.get_or_fetch(missing, make_fetch(calls, status_code=404)))[1] == "MISS"
+
+    asyncio.run(scenario())
+
+
+def test_cache_is_bounded_by_body_size():
+    async def scenario():
+        cache = ResponseCache(ttl_seconds=60, stale_seconds=60, max_entries=10, max_bytes=5, max_entry_bytes=3)
+        calls = []
+        keys = [cache_key("t1", "Item", f"/api/resource/Item/{i}", None) for i in range(3)]
+        for key in keys:
+            await cache.get_or_fetch(key, make_fetch(calls))
+        assert cache.size_bytes <= 5
+        assert (await cache.get_or_fetch(keys[0], make_fetch(calls)))[1] == "MISS"
+        assert (await cache.get_or_fetch(keys[2], make_fetch(calls)))[1] == "HIT"
+
+        async def big_fetch():
+            return FakeResponse(b"too large")
+
+        big = cache_key("t1", "Item", "/api/resource/Item", None)
+        await cache.get_or_fetch(big, big_fetch)
+        assert (await cache.get_or_fetch(big, big_fetch))[1] == "MISS"
+
+    asyncio.run(scenario())
@@ -0,0 +1,56 @@
+import asyncio
+
+from app.services.erp_delta import Watermark, decode_watermark, encode_watermark, fetch_delta, trim_page
+
+
+def test_watermark_round_trip():
+    mark = Watermark(modified="2024-05-01 10:00:00.000001", deleted="", modified_name="I-1")
+    assert decode_watermark(encode_watermark(mark)) == mark
+    assert decode_watermark(None) == Watermark()
+
+
+def test_full_page_marks_the_last_row_by_timestamp_and_name():
+    rows = [{"name": "A", "modified": "1"}, {"name": "B", "modified": "2"}, {"name": "C", "modified": "2"}]
+    page, mark, has_more = trim_page(rows, "modified", limit=2, mark=(None, None))
+    assert [row["name"] for row in page] == ["A", "B"]
+    assert (mark, has_more) == (("2", "B"), True)
+
+    page, mark, has_more = trim_page([], "modified", limit=2, mark=("2", "B"))
+    assert (page, mark, has_more) == ([], ("2", "B"), False)
+
+
+def test_delta_returns_changes_and_deletions_after_watermark():
+    async def scenario():
+        calls = []
+
+        async def fetch(doctype, params):
+            calls.append((doctype, params["filters"], params.get("or_filters")))
+            if doctype == "Deleted Document":
+                return [{"name": "DD-2", "deleted_name": "OLD", "creation": "5"}]
+            return [{"name": "NEW", "modified": "6"}]
+
+        delta = await fetch_delta(fetch, "Item", ["name", "modified"], Watermark("4", "3", "I-4", "DD-1"), limit=10)
+        assert delta["upserts"] == [{"name": "NEW", "modified": "6"}]
+        assert delta["deletes"] == ["OLD"]
+        assert decode_watermark(delta["watermark"]) == Watermark("6", "5", "NEW", "DD-2")
+        assert not delta["has_more"]
+        assert calls[0] == ("Item", '[["modified",">=","4"]]', '[["modified",">","4"],["name",">","I-4"]]')
+
+    asyncio.run(scenario())
+
+
+def test_empty_doctype_keeps_its_deletion_mark():
+    async def scenario():
+        async def fetch(doctype, params):
+            if doctype == "Deleted Document" and params["limit_page_length"] == 1:
+                return [{"name": "DD-9", "creation": "9"}]
+            return []
+
+        first = await fetch_delta(fetch, "Item", ["name", "modified"], Watermark(), limit=10)
+        mark = decode_watermark(first["watermark"])
+        assert mark == Watermark(None, "9", None, "DD-9")
+
+        second = await fetch_delta(fetch, "Item", ["name", "modified"], mark, limit=10)
+        assert decode_watermark(second["watermark"]) == mark
+
+    asyncio.run(scenario())
@@ -0,0 +1,49 @@
+import asyncio
+
+from app.services.erp_export import iter_pages, resume_filters
+
+
+def fetch_after(rows, requested, fail_after=None):
+    async def fetch_page(after, length):
+        requested.append(after)
+        if fail_after is not None and after == fail_after:
+            raise RuntimeError("upstream down")
+        remaining = [row for row in rows if after is None or row["name"] > after]
+        return remaining[:length]
+
+    return fetch_page
+
+
+def test_pages_follow_name_keyset_and_walk_stops_on_short_page():
+    async def scenario():
+        rows = [{"name": f"I{n:03d}"} for n in range(25)]
+        requested = []
+
+        pages = [page async for page in iter_pages(fetch_after(rows, requested), page_size=10)]
+        assert [row["name"] for page in pages for row in page] == [row["name"] for row in rows]
+        assert requested == [None, "I009", "I019"]
+
+        requested.clear()
+        resumed = [page async for page in iter_pages(fetch_after(rows, requested), page_size=10, after="I019")]
+        assert [row["name"] for page in resumed for row in page] == [f"I{n:03d}" for n in range(20, 25)]
+
+    asyncio.run(scenario())
+
+
+def test_failed_page_stops_the_walk():
+    async def scenario():
+        rows = [{"name": f"I{n:03d}"} for n in range(30)]
+        seen = []
+        try:
+            async for page in iter_pages(fetch_after(rows, [], fail_after="I009"), page_size=10):
+                seen.append(page)
+        except RuntimeError:
+            pass
+        assert len(seen) == 1
+
+    asyncio.run(scenario())
+
+
+def test_resume_filters_append_name_cursor():
+    assert resume_filters([["disabled", "=", 0]], "I010") == [["disabled", "=", 0], ["name", ">", "I010"]]
+    assert resume_filters(None, None) == []
@@ -0,0 +1,27 @@
+from app.services.erpnext import CircuitBreaker
+
+
+def test_breaker_opens_after_threshold_and_allows_one_trial():
+    breaker = CircuitBreaker(threshold=2, reset_seconds=30)
+
+    breaker.record_failure(now=100.0)
+    assert breaker.allow(now=100.0)
+    breaker.record_failure(now=100.0)
+    assert not breaker.allow(now=120.0)
+
+    assert breaker.allow(now=131.0)
+    assert not breaker.allow(now=131.0)
+
+
+def test_failed_trial_reopens_and_success_closes():
+    breaker = CircuitBreaker(threshold=1, reset_seconds=10)
+    breaker.record_failure(now=100.0)
+
+    assert breaker.allow(now=111.0)
+    breaker.record_failure(now=111.0)
+    assert not breaker.allow(now=115.0)
+
+    assert breaker.allow(now=122.0)
+    breaker.record_success()
+    assert breaker.allow(now=122.0)
+    assert breaker.allow(now=122.0)
@@ -0,0 +1,37 @@
+import asyncio
+
+from app.services.erpnext import iter_raw_body
+
+
+class FakeStreamResponse:
+    def __init__(self, body: bytes) -> None:
+        self.body = body
+        self.closed = False
+
+    async def aiter_raw(self, chunk_size: int):
+        for start in range(0, len(self.body), chunk_size):
+            yield self.body[start : start + chunk_size]
+
+    async def aclose(self) -> None:
+        self.closed = True
+
+
+def test_raw_body_is_relayed_in_chunks_and_closed():
+    async def scenario():
+        upstream = FakeStreamResponse(b"x" * 10)
+        chunks = [chunk async for chunk in iter_raw_body(upstream, chunk_size=4)]
+        assert [len(chunk) for chunk in chunks] == [4, 4, 2]
+        assert upstream.closed
+
+    asyncio.run(scenario())
+
+
+def test_response_is_closed_when_client_stops_reading():
+    async def scenario():
+        upstream = FakeStreamResponse(b"x" * 10)
+        body = iter_raw_body(upstream, chunk_size=4)
+        await body.__anext__()
+        await body.aclose()
+        assert upstream.closed
+
+    asyncio.run(scenario())
@@ -0,0 +1,126 @@
+import hashlib
+import os
+
+from app.services import firmware_store
+from app.services.firmware_store import (
+    FirmwareStore,
+    object_hash,
+    object_relative_path,
+    remove_unreferenced,
+    sweep_unreferenced,
+)
+
+
+def put_bytes(store: FirmwareStore, data: bytes, app_desc: dict | None = None) -> str:
+    tmp_path = store.base_path / ".test.part"
+    tmp_path.write_bytes(data)
+    return store.put(tmp_path, hashlib.sha256(data).hexdigest(), len(data), app_desc)
+
+
+def test_object_hash_only_matches_store_paths():
+    digest = hashlib.sha256(b"x").hexdigest()
+
+    assert object_hash(object_relative_path(digest)) == digest
+    assert object_hash(f"/objects/{digest[:2]}/{digest}") == digest
+    assert object_hash(f"objects/00/{digest}") is None
+    assert object_hash("scales/v1.0.0_b1.bin") is None
+    assert object_hash(None) is None
+
+
+def test_put_records_metadata(tmp_path):
+    store = FirmwareStore(tmp_path)
+    app_desc = {"version": "1.2.3", "build": 4, "raw": "1.2.3+4"}
+
+    path = put_bytes(store, b"firmware", app_desc)
+    meta = store.metadata(path)
+
+    assert meta["sha256"] == hashlib.sha256(b"firmware").hexdigest()
+    assert meta["size"] == len(b"firmware")
+    assert meta["app_desc"] == app_desc
+    assert store.verified_hash(path) == meta["sha256"]
+
+
+def test_scan_rehashes_only_changed_objects(tmp_path):
+    store = FirmwareStore(tmp_path)
+    good = put_bytes(store, b"good image")
+    bad = put_bytes(store, b"bad image")
+
+    first = store.scan()
+    assert (first.objects, first.rehashed, first.corrupt) == (2, 0, 0)
+
+    bad_path = store.path_for(bad)
+    bad_path.write_bytes(b"bit rot!!")
+    os.utime(bad_path, ns=(0, 0))
+    assert store.verified_hash(bad) is None
+
+    second = store.scan()
+    assert (second.objects, second.rehashed, second.corrupt) == (2, 1, 1)
+    assert not bad_path.exists()
+    assert bad_path.with_name(bad_path.name + ".corrupt").exists()
+    assert store.verified_hash(good)
+
+    # A re-upload of the same image stores a good copy again
+    assert put_bytes(store, b"bad image") == bad
+    assert store.verified_hash(bad)
+
+
+def test_scan_restores_missing_sidecar(tmp_path):
+    store = FirmwareStore(tmp_path)
+    path = put_bytes(store, b"image")
+    store.path_for(path + ".json").unlink()
+
+    result = store.scan()
+
+    assert (result.rehashed, result.corrupt) == (1, 0)
+    assert store.verified_hash(path)
+
+
+def test_remove_drops_sidecar(tmp_path):
+    store = FirmwareStore(tmp_path)
+    path = put_bytes(store, b"image")
+
+    store.remove(path)
+
+    assert [p for p in (tmp_path / "objects").rglob("*") if p.is_file()] == []
+
+
+class FakeSession:
+    def __init__(self):
+        self.locks = []
+        self.committed = False
+
+    def execute(self, statement, params=None):
+        self.locks.append(params["key"])
+
+    def commit(self):
+        self.committed = True
+
+
+def test_remove_unreferenced_locks_and_keeps_adopted_objects(tmp_path, monkeypatch):
+    store = FirmwareStore(tmp_path)
+    kept, dropped = put_bytes(store, b"kept"), put_bytes(store, b"dropped")
+    monkeypatch.setattr(firmware_store, "referenced_paths", lambda db, paths: {kept} & paths)
+
+    db = FakeSession()
+    assert remove_unreferenced(db, store, [kept, dropped, None], grace_seconds=0) == {dropped}
+    assert store.path_for(kept).exists() and not store.path_for(dropped).exists()
+    assert len(db.locks) == 2 and db.committed
+
+
+def test_unreferenced_objects_survive_the_grace_period(tmp_path, monkeypatch):
+    store = FirmwareStore(tmp_path)
+    staged = put_bytes(store, b"staged")
+    monkeypatch.setattr(firmware_store, "referenced_paths", lambda db, paths: set())
+
+    assert remove_unreferenced(FakeSession(), store, [staged], grace_seconds=3600) == set()
+    assert store.path_for(staged).exists()
+
+
+def test_sweep_removes_old_unreferenced_objects(tmp_path, monkeypatch):
+    store = FirmwareStore(tmp_path)
+    kept, orphan = put_bytes(store, b"kept"), put_bytes(store, b"orphan")
+    monkeypatch.setattr(firmware_store, "referenced_paths", lambda db, paths: {kept} & paths)
+    monkeypatch.setattr(firmware_store.time, "time", lambda: 10**10)
+
+    assert sweep_unreferenced(FakeSession(), store, grace_seconds=3600) == 1
+    assert store.path_for(kept).exists() and not store.path_for(orphan).exists()
@@ -0,0 +1,41 @@
+from types import SimpleNamespace
+
+from app.services import license_lookup
+from app.services.license_lookup import FingerprintMissCache, miss_key
+
+
+def test_miss_cache_expires_entries():
+    cache = FingerprintMissCache()
+    cache.add("fp", ttl_seconds=10, now=100.0)
+
+    assert cache.contains("fp", now=105.0)
+    assert not cache.contains("fp", now=111.0)
+    assert not cache.contains("other", now=105.0)
+
+
+def test_miss_cache_is_bounded():
+    cache = FingerprintMissCache(max_size=2)
+    cache.add("a", ttl_seconds=10, now=100.0)
+    cache.add("b", ttl_seconds=10, now=100.0)
+    cache.add("c", ttl_seconds=10, now=100.0)
+
+    assert not cache.contains("a", now=101.0)
+    assert cache.contains("b", now=101.0)
+    assert cache.contains("c", now=101.0)
+
+
+def test_miss_key_is_per_tenant():
+    cache = FingerprintMissCache()
+    cache.add(miss_key("tenant-a", "fp"), ttl_seconds=10, now=100.0)
+
+    assert cache.contains(miss_key("tenant-a", "fp"), now=101.0)
+    assert not cache.contains(miss_key("tenant-b", "fp"), now=101.0)
+    assert not cache.contains(miss_key(None, "fp"), now=101.0)
+
+
+def test_legacy_scan_needs_a_tenant(monkeypatch):
+    settings = SimpleNamespace(license_legacy_scan_limit=50, license_legacy_scan_max_keys=500)
+    monkeypatch.setattr(license_lookup, "get_settings", lambda: settings)
+
+    # No query may run: db is None
+    assert license_lookup._scan_legacy_keys(None, "raw", "fp", None) is None
@@ -0,0 +1,24 @@
+from app.services.metrics import Counter, Histogram
+
+
+def test_histogram_renders_cumulative_buckets():
+    histogram = Histogram("op_seconds", "Operation time", ("route",), buckets=(0.1, 1.0))
+    histogram.observe(0.05, "/a")
+    histogram.observe(0.5, "/a")
+    histogram.observe(5.0, "/a")
+
+    lines = histogram.render()
+
+    assert 'op_seconds_bucket{route="/a",le="0.1"} 1' in lines
+    assert 'op_seconds_bucket{route="/a",le="1.0"} 2' in lines
+    assert 'op_seconds_bucket{route="/a",le="+Inf"} 3' in lines
+    assert 'op_seconds_count{route="/a"} 3' in lines
+    assert histogram.count("/a") == 3
+
+
+def test_counter_escapes_label_values():
+    counter = Counter("hits_total", "Hits", ("host",))
+    counter.inc('erp"1')
+    counter.inc('erp"1', amount=2)
+
+    assert counter.render()[-1] == 'hits_total{host="erp\\"1"} 3'
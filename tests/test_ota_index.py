@@ -0,0 +1,77 @@
+from types import SimpleNamespace
+
+from app.services.ota_index import build_index
+
+
+def _firmware(id, version, build_number=0, device_type="scales", min_current_version=None):
+    return SimpleNamespace(
+        id=id,
+        device_type=device_type,
+        version=version,
+        build_number=build_number,
+        file_hash=f"hash{id}",
+        file_size=1024,
+        description=None,
+        min_current_version=min_current_version,
+        compressed_path=None,
+        compressed_hash=None,
+        compressed_size=None,
+        compression=None,
+        rollout_percent=100,
+        max_concurrent_downloads=None,
+    )
+
+
+def test_build_index_orders_by_version_and_build():
+    index = build_index(
+        [
+            _firmware(1, "1.2.0"),
+            _firmware(2, "1.10.0"),
+            _firmware(3, "1.10.0", build_number=2),
+            _firmware(4, "not-a-version"),
+            _firmware(5, "2.0.0", device_type="printer"),
+        ]
+    )
+
+    assert [entry.firmware_id for entry in index["scales"]] == [3, 2, 1]
+    assert [entry.firmware_id for entry in index["printer"]] == [5]
+
+
+def test_build_index_keys_patches_by_source_build():
+    patch = SimpleNamespace(
+        firmware_id=2, source_firmware_id=1, patch_hash="p", patch_size=10, compression="heatshrink"
+    )
+
+    index = build_index([_firmware(1, "1.0.0"), _firmware(2, "1.1.0")], [(patch, "1.0.0", 0)])
+
+    latest = index["scales"][0]
+    assert latest.patches[("1.0.0", 0)].source_firmware_id == 1
+    assert index["scales"][1].patches == {}
+
+
+def test_build_index_exposes_compressed_variant_only_when_stored():
+    compressed = _firmware(2, "1.1.0")
+    compressed.compressed_path = "scales/v1.1.0.bin.hs"
+    compressed.compressed_hash = "c"
+    compressed.compressed_size = 600
+    compressed.compression = "heatshrink"
+    orphaned = _firmware(1, "1.0.0")
+    orphaned.compression = "heatshrink"
+
+    latest, older = build_index([orphaned, compressed])["scales"]
+
+    assert (latest.compression, latest.compressed_size) == ("heatshrink", 600)
+    assert older.compression is None
+
+
+def test_allows_upgrade_from_respects_min_version():
+    index = build_index(
+        [
+            _firmware(1, "2.0.0", min_current_version="1.5.0"),
+            _firmware(2, "2.0.0", device_type="printer", min_current_version="bad"),
+        ]
+    )
+
+    assert index["scales"][0].allows_upgrade_from((1, 5, 0))
+    assert not index["scales"][0].allows_upgrade_from((1, 4, 9))
+    assert not index["printer"][0].allows_upgrade_from((9, 9, 9))
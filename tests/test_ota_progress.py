@@ -0,0 +1,32 @@
+from app.services.ota_progress import ProgressBuffer
+
+
+def test_untracked_progress_is_not_buffered():
+    buffer = ProgressBuffer()
+
+    assert buffer.record(1, 10, 4096) is None
+    assert buffer.live_bytes(100) is None
+
+
+def test_tracked_progress_keeps_latest_value():
+    buffer = ProgressBuffer()
+    buffer.track(1, 10, log_id=100)
+
+    assert buffer.record(1, 10, 4096) == 100
+    assert buffer.record(1, 10, 8192) == 100
+    assert buffer.live_bytes(100) == 8192
+
+    pending = buffer.take(100)
+    assert pending.bytes_downloaded == 8192
+    assert buffer.live_bytes(100) is None
+
+
+def test_forget_drops_pending_progress():
+    buffer = ProgressBuffer()
+    buffer.track(1, 10, log_id=100)
+    buffer.record(1, 10, 4096)
+
+    buffer.forget(1, 10)
+
+    assert buffer.live_bytes(100) is None
+    assert buffer.record(1, 10, 8192) is None
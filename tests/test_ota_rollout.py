@@ -0,0 +1,37 @@
+from app.services.ota_rollout import ADMITTED, THROTTLED, RolloutScheduler, cohort_bucket, in_wave
+
+
+class FakeScheduler(RolloutScheduler):
+    def __init__(self, counts, downloading=()):
+        super().__init__(refresh_interval_seconds=60, stale_seconds=600, default_cap=0)
+        self.counts = counts
+        self.downloading = set(downloading)
+
+    def _load_counts(self, db, cutoff):
+        return dict(self.counts)
+
+    def _is_downloading(self, db, firmware_id, device_id, cutoff):
+        return (firmware_id, device_id) in self.downloading
+
+
+def test_waves_only_grow_as_percent_rises():
+    devices = range(1, 2001)
+    ten = {d for d in devices if in_wave(7, d, 10)}
+    fifty = {d for d in devices if in_wave(7, d, 50)}
+
+    assert ten < fifty
+    assert 100 < len(ten) < 300
+    assert all(in_wave(7, d, 100) for d in devices)
+    assert not any(in_wave(7, d, 0) for d in devices)
+    assert cohort_bucket(7, 42) == cohort_bucket(7, 42)
+
+
+def test_cap_counts_inflight_and_local_admissions():
+    scheduler = FakeScheduler({1: 2}, downloading={(1, 50)})
+
+    assert scheduler.admit(None, 1, 10, cap=3) == ADMITTED
+    assert scheduler.admit(None, 1, 10, cap=3) == ADMITTED  # Re-poll keeps its slot
+    assert scheduler.admit(None, 1, 11, cap=3) == THROTTLED
+    assert scheduler.admit(None, 1, 50, cap=3) == ADMITTED  # Already downloading
+    assert scheduler.admit(None, 2, 11, cap=None) == ADMITTED  # No default cap
+    assert scheduler.inflight(None) == {1: 3}
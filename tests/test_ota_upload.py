@@ -0,0 +1,58 @@
+import asyncio
+import hashlib
+import io
+
+from app.services.ota import OTAService
+
+
+class FakeUpload:
+    def __init__(self, data: bytes) -> None:
+        self._buffer = io.BytesIO(data)
+
+    async def read(self, size: int = -1) -> bytes:
+        return self._buffer.read(size)
+
+
+def test_stage_and_commit_upload(tmp_path):
+    service = OTAService(firmware_base_path=str(tmp_path))
+    data = bytes(range(256)) * 1000
+
+    staged = asyncio.run(service.stage_upload(FakeUpload(data), chunk_size=4096))
+
+    assert staged.file_size == len(data)
+    assert staged.file_hash == hashlib.sha256(data).hexdigest()
+    assert staged.header == data[:4096]
+
+    binary_path = service.commit_upload(staged)
+    file_path = tmp_path / binary_path
+
+    assert binary_path == f"objects/{staged.file_hash[:2]}/{staged.file_hash}"
+    assert file_path.read_bytes() == data
+    assert not staged.path.exists()
+    assert service.calculate_file_hash(file_path) == staged.file_hash
+
+
+def test_identical_uploads_share_one_object(tmp_path):
+    service = OTAService(firmware_base_path=str(tmp_path))
+    data = b"same image for two device types"
+
+    first = service.commit_upload(asyncio.run(service.stage_upload(FakeUpload(data))))
+    staged = asyncio.run(service.stage_upload(FakeUpload(data)))
+    second = service.commit_upload(staged)
+
+    assert first == second
+    assert not staged.path.exists()
+    assert [path.name for path in (tmp_path / "objects").rglob("*") if path.is_file()] == [
+        staged.file_hash,
+        f"{staged.file_hash}.json",
+    ]
+
+
+def test_discard_upload_removes_temp_file(tmp_path):
+    service = OTAService(firmware_base_path=str(tmp_path))
+
+    staged = asyncio.run(service.stage_upload(FakeUpload(b"firmware")))
+    service.discard_upload(staged)
+
+    assert not staged.path.exists()
+    assert list(tmp_path.iterdir()) == []
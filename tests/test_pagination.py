@@ -0,0 +1,78 @@
+import uuid
+from datetime import datetime, timezone
+from types import SimpleNamespace
+
+import pytest
+
+from app.services import pagination
+from app.services.pagination import decode_cursor, encode_cursor, keyset_page, page_from, uuid_id
+
+
+def test_cursor_round_trips_timestamp_and_id():
+    moment = datetime(2026, 10, 14, 12, 30, 5, 123456, tzinfo=timezone.utc)
+    row_id = uuid.uuid4()
+
+    assert decode_cursor(encode_cursor(moment, 42)) == (moment, 42)
+    assert decode_cursor(encode_cursor(moment, row_id), uuid_id) == (moment, row_id)
+    with pytest.raises(ValueError):
+        decode_cursor("not-a-cursor")
+
+
+def test_page_from_trims_extra_row_and_points_at_last_kept():
+    rows = [SimpleNamespace(created_at=datetime(2026, 1, day), id=day) for day in (5, 4, 3)]
+
+    page, cursor = page_from(rows, 2, lambda row: (row.created_at, row.id))
+    assert [row.id for row in page] == [5, 4]
+    assert decode_cursor(cursor) == (datetime(2026, 1, 4), 4)
+
+    assert page_from(rows, 3, lambda row: (row.created_at, row.id)) == (rows, None)
+
+
+class FakeColumn:
+    def __init__(self, key):
+        self.key = key
+
+    def desc(self):
+        return self
+
+
+class FakeKey:
+    def __init__(self, parts):
+        self.parts = parts
+
+    def __lt__(self, other):
+        columns = self.parts
+        return lambda row: tuple(getattr(row, column.key) for column in columns) < other.parts
+
+
+class FakeQuery:
+    def __init__(self, rows):
+        self.rows = rows
+
+    def filter(self, predicate):
+        return FakeQuery([row for row in self.rows if predicate(row)])
+
+    def order_by(self, *columns):
+        return FakeQuery(sorted(self.rows, key=lambda row: [getattr(row, c.key) for c in columns], reverse=True))
+
+    def limit(self, count):
+        return FakeQuery(self.rows[:count])
+
+    def all(self):
+        return list(self.rows)
+
+
+def test_keyset_page_walks_rows_sharing_a_timestamp(monkeypatch):
+    monkeypatch.setattr(pagination, "tuple_", lambda *parts: FakeKey(parts))
+    same = datetime(2026, 10, 14, 12, 0)
+    rows = [SimpleNamespace(created_at=same, id=row_id) for row_id in range(1, 8)]
+    query = FakeQuery(rows)
+    created_at, row_id = FakeColumn("created_at"), FakeColumn("id")
+
+    seen, cursor = [], None
+    while True:
+        page, cursor = keyset_page(query, created_at, row_id, cursor, limit=3)
+        seen += [row.id for row in page]
+        if cursor is None:
+            break
+    assert seen == [7, 6, 5, 4, 3, 2, 1]
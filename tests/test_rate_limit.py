@@ -0,0 +1,38 @@
+from app.services.rate_limit import RateLimiter
+
+
+def test_allows_burst_then_one_per_interval():
+    limiter = RateLimiter(max_requests=3, window_seconds=60)
+    now = 1000.0
+
+    assert [limiter.allow("ip", now=now) for _ in range(4)] == [True, True, True, False]
+    assert not limiter.allow("ip", now=now + 19)
+    assert limiter.allow("ip", now=now + 20)
+    assert not limiter.allow("ip", now=now + 20)
+
+
+def test_keys_are_limited_independently():
+    limiter = RateLimiter(max_requests=1, window_seconds=60)
+
+    assert limiter.allow("a", now=1000.0)
+    assert not limiter.allow("a", now=1000.0)
+    assert limiter.allow("b", now=1000.0)
+
+
+def test_idle_keys_are_evicted():
+    limiter = RateLimiter(max_requests=5, window_seconds=1, shards=1)
+
+    for i in range(5000):
+        limiter.allow(f"key-{i}", now=1000.0 + i)
+
+    assert len(limiter) <= 1
+
+
+def test_shard_size_is_capped():
+    limiter = RateLimiter(max_requests=1, window_seconds=3600, shards=1, max_keys_per_shard=100)
+
+    for i in range(5000):
+        limiter.allow(f"key-{i}", now=1000.0)
+
+    assert len(limiter) == 100
+    assert not limiter.allow("key-4999", now=1000.0)
@@ -0,0 +1,59 @@
+import uuid
+from types import SimpleNamespace
+
+from app.services.request_cache import RequestContextCache
+
+
+def _device(tenant_id, device_id="device-1", revoked=False):
+    return SimpleNamespace(id=uuid.uuid4(), tenant_id=tenant_id, device_id=device_id, revoked=revoked)
+
+
+def test_cached_device_is_served_without_db():
+    cache = RequestContextCache(ttl_seconds=60)
+    tenant_id = uuid.uuid4()
+    stored = cache.store_device(_device(tenant_id))
+
+    assert cache.get_device(None, tenant_id, "device-1") == stored
+
+
+def test_invalidate_tenant_drops_its_devices():
+    cache = RequestContextCache(ttl_seconds=60)
+    tenant_id = uuid.uuid4()
+    other_tenant_id = uuid.uuid4()
+    cache.store_device(_device(tenant_id))
+    kept = cache.store_device(_device(other_tenant_id))
+
+    cache.invalidate_tenant(tenant_id)
+
+    assert (tenant_id, "device-1") not in cache._devices
+    assert cache.get_device(None, other_tenant_id, "device-1") == kept
+
+
+def test_device_cache_is_bounded():
+    cache = RequestContextCache(ttl_seconds=60, max_devices=2)
+    tenant_id = uuid.uuid4()
+    for device_id in ("a", "b", "c"):
+        cache.store_device(_device(tenant_id, device_id))
+
+    assert list(cache._devices) == [(tenant_id, "b"), (tenant_id, "c")]
+
+
+class RevisionSession:
+    def __init__(self, revision):
+        self.revision = revision
+
+    def execute(self, statement):
+        return SimpleNamespace(scalar=lambda: self.revision)
+
+
+def test_published_revision_drops_other_workers_entries():
+    cache = RequestContextCache(ttl_seconds=60, revalidate_seconds=0)
+    tenant_id = uuid.uuid4()
+    db = RevisionSession(revision=1)
+    stored = cache.store_device(_device(tenant_id))
+    assert cache.get_device(db, tenant_id, "device-1") == stored
+
+    db.revision = 2
+    assert cache.get_device(None, tenant_id, "device-1") == stored  # No db: no revalidation
+    cache._revalidate(db, now=cache._checked_at + 1)
+    assert (tenant_id, "device-1") not in cache._devices
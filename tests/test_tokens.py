@@ -51,3 +51,78 @@ def test_decode_invalid_token():
 
     with pytest.raises(TokenInvalid):
         decode_access_token(token, secret="wrong-secret", algorithm="HS256")
+
+
+def _use_keyring(monkeypatch, keys, active_kid=None, accept_legacy=True):
+    from app.services import auth
+
+    secret_key = auth.JWTKey(None, "HS256", "legacy-secret", "legacy-secret")
+    legacy = secret_key if accept_legacy else None
+    ring = auth.KeyRing(keys=keys, legacy=legacy, active=keys[active_kid] if active_kid else secret_key)
+    monkeypatch.setattr(auth, "get_keyring", lambda: ring)
+    monkeypatch.setattr(auth, "get_token_cache", lambda: cache)
+    cache = auth.VerifiedTokenCache(max_entries=10)
+    return cache
+
+
+def test_rotated_keys_verify_by_kid(monkeypatch):
+    from app.services.auth import JWTKey
+
+    old = JWTKey("old", "HS256", "old-secret", "old-secret")
+    new = JWTKey("new", "HS256", "new-secret", "new-secret")
+    _use_keyring(monkeypatch, {"old": old, "new": new}, active_kid="old")
+    old_token, _ = create_access_token(uuid4(), issued_at=datetime.now(timezone.utc), ttl_days=7)
+
+    _use_keyring(monkeypatch, {"old": old, "new": new}, active_kid="new")
+    new_token, _ = create_access_token(uuid4(), issued_at=datetime.now(timezone.utc), ttl_days=7)
+
+    assert decode_access_token(old_token).expires_at > datetime.now(timezone.utc)
+    assert decode_access_token(new_token).expires_at > datetime.now(timezone.utc)
+
+    _use_keyring(monkeypatch, {"new": new}, active_kid="new")
+    with pytest.raises(TokenInvalid):
+        decode_access_token(old_token)
+
+
+def test_asymmetric_key_verifies_with_public_key_only(monkeypatch):
+    from cryptography.hazmat.primitives.asymmetric import ec
+
+    from app.services.auth import JWTKey
+
+    private_key = ec.generate_private_key(ec.SECP256R1())
+    signer = JWTKey("es", "ES256", private_key, private_key.public_key())
+    _use_keyring(monkeypatch, {"es": signer}, active_kid="es")
+    token, data = create_access_token(uuid4(), issued_at=datetime.now(timezone.utc), ttl_days=7)
+
+    verifier = JWTKey("es", "ES256", None, private_key.public_key())
+    _use_keyring(monkeypatch, {"es": verifier})
+    assert decode_access_token(token).tenant_id == data.tenant_id
+
+
+def test_cached_token_skips_verification_but_not_expiry(monkeypatch):
+    from app.services import auth
+
+    cache = _use_keyring(monkeypatch, {})
+    token, _ = create_access_token(uuid4(), issued_at=datetime.now(timezone.utc), ttl_days=7)
+    decoded = decode_access_token(token)
+
+    monkeypatch.setattr(auth, "_verify", lambda *args: pytest.fail("cache miss"))
+    assert decode_access_token(token) is decoded
+
+    digest = next(iter(cache._entries))
+    cache.put(digest, auth.TokenData(decoded.tenant_id, decoded.issued_at, decoded.issued_at))
+    with pytest.raises(TokenExpired):
+        decode_access_token(token)
+
+
+def test_legacy_tokens_can_be_turned_off(monkeypatch):
+    from app.services.auth import JWTKey
+
+    new = JWTKey("new", "HS256", "new-secret", "new-secret")
+    _use_keyring(monkeypatch, {"new": new})
+    legacy_token, _ = create_access_token(uuid4(), issued_at=datetime.now(timezone.utc), ttl_days=7)
+    assert decode_access_token(legacy_token).expires_at > datetime.now(timezone.utc)
+
+    _use_keyring(monkeypatch, {"new": new}, active_kid="new", accept_legacy=False)
+    with pytest.raises(TokenInvalid):
+        decode_access_token(legacy_token)
@@ -0,0 +1,40 @@
+import pytest
+
+from app.services.verify_pool import VerificationPool, VerificationPoolSaturated
+
+
+def _noop():
+    return None
+
+
+def test_jobs_are_taken_round_robin_across_tenants():
+    pool = VerificationPool(workers=1, max_queued=10, max_queued_per_key=5, autostart=False)
+    futures = {}
+    for name, key in [("a1", "a"), ("a2", "a"), ("a3", "a"), ("b1", "b")]:
+        futures[name] = pool.submit(key, _noop)
+
+    order = []
+    for _ in range(4):
+        future, _, _ = pool._take()
+        order.append(next(name for name, f in futures.items() if f is future))
+
+    assert order == ["a1", "b1", "a2", "a3"]
+
+
+def test_submit_rejects_when_saturated():
+    pool = VerificationPool(workers=1, max_queued=3, max_queued_per_key=2, autostart=False)
+    pool.submit("a", _noop)
+    pool.submit("a", _noop)
+
+    with pytest.raises(VerificationPoolSaturated):
+        pool.submit("a", _noop)
+
+    pool.submit("b", _noop)
+    with pytest.raises(VerificationPoolSaturated):
+        pool.submit("c", _noop)
+
+
+def test_run_returns_worker_result():
+    pool = VerificationPool(workers=1, max_queued=4, max_queued_per_key=4)
+
+    assert pool.run("a", lambda x: x * 2, 21) == 42